@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include "yjson.h"
+#include "yjson_cache.h"
+#include "yjson_memory.h"
+#include "yjson_parallel.h"
+#include "yjson_render.h"
+#include "yjson_source.h"
+#include "yjson_writer.h"
+#include "yjson_validate.h"
+
+using namespace std;
+using namespace yph;
+
+/*
+ * yjson_bench [--scale N] [--runs N] [--warmup N] [--corpus NAME]
+ *             [--benchmark NAME]
+ * Generates the corpora locally and prints one JSON document with the
+ * results, so that runs can be diffed or fed into other tools.
+ */
+struct Options {
+  int scale = 1;
+  int runs = 10;
+  int warmup = 2;
+  string corpus;
+  string benchmark;
+};
+
+struct Corpus {
+  string name;
+  string json;
+  size_t nodes;
+};
+
+struct Result {
+  string corpus;
+  string benchmark;
+  size_t bytes;
+  size_t nodes;
+  vector<double> samples;  // ns per run
+};
+
+/* CORPORA */
+static mt19937_64 rng(20201017);
+
+static double uniform(double lo, double hi) {
+  return uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static long long integer(long long lo, long long hi) {
+  return uniform_int_distribution<long long>(lo, hi)(rng);
+}
+
+static string number(double d) {
+  char buffer[32];
+  sprintf(buffer, "%.15g", d);
+  return buffer;
+}
+
+static string word(size_t len) {
+  static const char* letters = "abcdefghijklmnopqrstuvwxyz";
+  string s;
+  for (size_t i = 0; i < len; i++) {
+    s += letters[integer(0, 25)];
+  }
+  return s;
+}
+
+static string sentence(size_t words) {
+  // mix in escapes and multi-byte UTF-8 like real user text
+  static const char* extras[] = {"\\n", "\\\"", "\\u00e9", "\xE2\x9C\x93",
+                                 "\xF0\x9F\x98\x80", "\\/", "#tag", "@user"};
+  string s;
+  for (size_t i = 0; i < words; i++) {
+    if (i > 0) {
+      s += ' ';
+    }
+    s += integer(0, 5) == 0 ? extras[integer(0, 7)] : word(integer(2, 9));
+  }
+  return s;
+}
+
+// numeric: GeoJSON polygons with long coordinate rings
+static string canadaLike(int scale) {
+  string s = "{\"type\":\"FeatureCollection\",\"features\":[";
+  for (int f = 0; f < 4; f++) {
+    s += f ? "," : "";
+    s += "{\"type\":\"Feature\",\"properties\":{\"name\":\"Canada\"},";
+    s += "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[";
+    for (int r = 0; r < 4 * scale; r++) {
+      s += r ? ",[" : "[";
+      for (int p = 0; p < 256; p++) {
+        s += p ? ",[" : "[";
+        s += number(uniform(-141.0, -52.0)) + "," + number(uniform(41.0, 83.0));
+        s += "]";
+      }
+      s += "]";
+    }
+    s += "]}}";
+  }
+  s += "]}";
+  return s;
+}
+
+// string and key heavy: timeline of statuses with nested user objects
+static string twitterLike(int scale) {
+  string s = "{\"statuses\":[";
+  for (int i = 0; i < 50 * scale; i++) {
+    auto id = to_string(integer(100000000000000000LL, 999999999999999999LL));
+    s += i ? "," : "";
+    s += "{\"created_at\":\"Sun Aug 31 00:29:15 +0000 2014\",";
+    s += "\"id\":" + id + ",\"id_str\":\"" + id + "\",";
+    s += "\"text\":\"" + sentence(integer(5, 25)) + "\",";
+    s += "\"source\":\"<a href=\\\"https://example.com\\\">web</a>\",";
+    s += "\"truncated\":false,\"in_reply_to_status_id\":null,";
+    s += "\"user\":{\"id\":" + to_string(integer(1, 1LL << 40)) + ",";
+    s += "\"name\":\"" + sentence(2) + "\",";
+    s += "\"screen_name\":\"" + word(10) + "\",";
+    s += "\"location\":\"" + sentence(2) + "\",";
+    s += "\"description\":\"" + sentence(integer(5, 20)) + "\",";
+    s += "\"followers_count\":" + to_string(integer(0, 100000)) + ",";
+    s += "\"verified\":" + string(integer(0, 1) ? "true" : "false") + ",";
+    s += "\"lang\":\"ja\"},";
+    s += "\"entities\":{\"hashtags\":[";
+    for (int h = 0, n = integer(0, 3); h < n; h++) {
+      s += h ? "," : "";
+      s += "{\"text\":\"" + word(6) + "\",\"indices\":[" +
+           to_string(integer(0, 70)) + "," + to_string(integer(70, 140)) +
+           "]}";
+    }
+    s += "],\"urls\":[]},";
+    s += "\"retweet_count\":" + to_string(integer(0, 5000)) + ",";
+    s += "\"favorited\":false,\"lang\":\"ja\"}";
+  }
+  s += "],\"search_metadata\":{\"completed_in\":0.087,\"count\":100}}";
+  return s;
+}
+
+// nested: keyed lookup tables and events with arrays of small records
+static string citmLike(int scale) {
+  string s = "{\"areaNames\":{";
+  for (int i = 0; i < 20 * scale; i++) {
+    s += i ? "," : "";
+    s += "\"" + to_string(205705993 + i) + "\":\"" + sentence(3) + "\"";
+  }
+  s += "},\"events\":{";
+  for (int i = 0; i < 40 * scale; i++) {
+    auto id = to_string(138586341 + i);
+    s += i ? "," : "";
+    s += "\"" + id + "\":{\"description\":null,\"id\":" + id +
+         ",\"logo\":null,\"name\":\"" + sentence(4) +
+         "\",\"subTopicIds\":[337184269,337184283],\"topicIds\":[324846099]}";
+  }
+  s += "},\"performances\":[";
+  for (int i = 0; i < 40 * scale; i++) {
+    s += i ? "," : "";
+    s += "{\"eventId\":" + to_string(138586341 + i) + ",\"prices\":[";
+    for (int p = 0; p < 4; p++) {
+      s += p ? "," : "";
+      s += "{\"amount\":" + to_string(integer(10, 200) * 1000) +
+           ",\"audienceSubCategoryId\":337100890,\"seatCategoryId\":" +
+           to_string(338937295 + p) + "}";
+    }
+    s += "],\"seatCategories\":[";
+    for (int c = 0; c < 4; c++) {
+      s += c ? "," : "";
+      s += "{\"areas\":[{\"areaId\":205705999,\"blockIds\":[]},"
+           "{\"areaId\":205705998,\"blockIds\":[]}],\"seatCategoryId\":" +
+           to_string(338937295 + c) + "}";
+    }
+    s += "],\"start\":1372701600000,\"venueCode\":\"PLEYEL_PLEYEL\"}";
+  }
+  s += "]}";
+  return s;
+}
+
+// deeply nested arrays and objects
+static string deepLike(int scale) {
+  const int depth = 200;
+  string s = "[";
+  for (int i = 0; i < 20 * scale; i++) {
+    s += i ? "," : "";
+    for (int d = 0; d < depth; d++) {
+      s += d % 2 ? "{\"k\":" : "[1,";
+    }
+    s += "null";
+    for (int d = depth - 1; d >= 0; d--) {
+      s += d % 2 ? "}" : "]";
+    }
+  }
+  s += "]";
+  return s;
+}
+
+/* MEASUREMENT */
+static size_t countNodes(const Value& v) {
+  size_t n = 1;
+  if (v.type == Type::ARRAY) {
+    for (auto& el : std::get<vector<Value>>(v.data)) {
+      n += countNodes(el);
+    }
+  } else if (v.type == Type::OBJECT) {
+    for (auto& en : std::get<vector<Entry>>(v.data)) {
+      n += countNodes(en.val);
+    }
+  }
+  return n;
+}
+
+// touches every node and scalar so that nothing can be skipped
+static double traverse(const Value& v) {
+  switch (v.type) {
+    case Type::NUMBER: {
+      return std::get<double>(v.data);
+    }
+    case Type::STRING: {
+      return static_cast<double>(std::get<string>(v.data).length());
+    }
+    case Type::TRUE: {
+      return 1.0;
+    }
+    case Type::ARRAY: {
+      double sum = 0.0;
+      for (auto& el : std::get<vector<Value>>(v.data)) {
+        sum += traverse(el);
+      }
+      return sum;
+    }
+    case Type::OBJECT: {
+      double sum = 0.0;
+      for (auto& en : std::get<vector<Entry>>(v.data)) {
+        sum += en.key.length() + traverse(en.val);
+      }
+      return sum;
+    }
+    default: { return 0.0; }
+  }
+}
+
+// the calls a row-by-row producer makes, here replayed from a tree
+static void writeTree(Writer& w, const Value& v) {
+  switch (v.type) {
+    case Type::NVLL: {
+      w.value(nullptr);
+      break;
+    }
+    case Type::FALSE:
+    case Type::TRUE: {
+      w.value(v.type == Type::TRUE);
+      break;
+    }
+    case Type::NUMBER: {
+      w.value(std::get<double>(v.data));
+      break;
+    }
+    case Type::STRING: {
+      w.value(std::string_view(std::get<string>(v.data)));
+      break;
+    }
+    case Type::ARRAY: {
+      w.startArray();
+      for (auto& el : std::get<vector<Value>>(v.data)) {
+        writeTree(w, el);
+      }
+      w.end();
+      break;
+    }
+    case Type::OBJECT: {
+      w.startObject();
+      for (auto& en : std::get<vector<Entry>>(v.data)) {
+        w.key(en.key);
+        writeTree(w, en.val);
+      }
+      w.end();
+      break;
+    }
+  }
+}
+
+static volatile double sink;
+
+static Result measure(const Options& opt, const Corpus& c,
+                      const string& benchmark, size_t bytes,
+                      const function<void()>& run) {
+  Result r{c.name, benchmark, bytes, c.nodes, {}};
+  if (!opt.benchmark.empty() && opt.benchmark != benchmark) {
+    return r;
+  }
+  for (int i = 0; i < opt.warmup; i++) {
+    run();
+  }
+  for (int i = 0; i < opt.runs; i++) {
+    auto start = chrono::steady_clock::now();
+    run();
+    auto stop = chrono::steady_clock::now();
+    r.samples.push_back(
+        chrono::duration<double, nano>(stop - start).count());
+  }
+  return r;
+}
+
+static void benchCorpus(const Options& opt, const Corpus& c,
+                        vector<Result>& results) {
+  auto v = make_shared<Value>();
+  if (parse(v, c.json) != Status::PARSE_OK) {
+    fprintf(stderr, "corpus %s does not parse\n", c.name.c_str());
+    exit(1);
+  }
+  results.push_back(measure(opt, c, "parse", c.json.size(), [&]() {
+    auto tmp = make_shared<Value>();
+    parse(tmp, c.json);
+  }));
+  {
+    // the steady state of a file-backed document: no I/O, no parsing
+    string path = "yjson_bench_" + c.name + ".json";
+    FILE* fp = fopen(path.c_str(), "wb");
+    fwrite(c.json.data(), 1, c.json.size(), fp);
+    fclose(fp);
+    DocumentCache cache;
+    DocumentPtr doc;
+    cache.get(path, doc);
+    results.push_back(measure(opt, c, "cache_get", c.json.size(),
+                              [&]() { cache.get(path, doc); }));
+    remove(path.c_str());
+  }
+  results.push_back(measure(opt, c, "validate", c.json.size(),
+                            [&]() { sink = validate(c.json).second; }));
+  Context context;
+  Value reused;
+  results.push_back(measure(opt, c, "parse_reuse", c.json.size(),
+                            [&]() { context.parse(reused, c.json); }));
+  context.parse(reused, c.json);
+  results.push_back(measure(opt, c, "compact", c.json.size(), [&]() {
+    // on a copy, so that every run starts from the parsed capacities
+    Value tmp = reused;
+    compact(tmp);
+  }));
+  Context lazy;
+  lazy.setLazyNumbers(true);
+  results.push_back(measure(opt, c, "parse_lazy", c.json.size(), [&]() {
+    Value tmp;
+    lazy.parse(tmp, c.json);
+  }));
+  Context packed;
+  packed.setPackedArrays(true);
+  results.push_back(measure(opt, c, "parse_packed", c.json.size(), [&]() {
+    Value tmp;
+    packed.parse(tmp, c.json);
+  }));
+  Value packedTree;
+  packed.parse(packedTree, c.json);
+  results.push_back(
+      measure(opt, c, "stringify_packed", c.json.size(), [&]() {
+        string out;
+        stringifyValue(packedTree, out);
+      }));
+  results.push_back(
+      measure(opt, c, "parse_parallel", c.json.size(), [&]() {
+        auto tmp = make_shared<Value>();
+        parseParallel(tmp, c.json);
+      }));
+  results.push_back(measure(opt, c, "stringify", c.json.size(), [&]() {
+    auto out = make_shared<string>();
+    stringify(v, out);
+  }));
+  results.push_back(measure(opt, c, "write_stream", c.json.size(), [&]() {
+    size_t written = 0;
+    Writer w([&written](std::string_view bytes) {
+      written += bytes.size();
+      return true;
+    });
+    writeTree(w, *v);
+    w.finish();
+    sink = written;
+  }));
+  SourceDocument source;
+  source.parse(c.json);
+  size_t middle = c.json.size() / 2;
+  results.push_back(measure(opt, c, "edit", c.json.size(), [&]() {
+    // a keystroke in the middle of the text, the byte it replaces
+    source.edit(middle, 1, std::string_view(c.json).substr(middle, 1));
+  }));
+  RenderCache cache;
+  results.push_back(
+      measure(opt, c, "stringify_cached", c.json.size(), [&]() {
+        // as after an edit of a member of the root
+        invalidateHash(*v);
+        string out;
+        cache.stringify(*v, out);
+      }));
+  results.push_back(
+      measure(opt, c, "stringify_parallel", c.json.size(), [&]() {
+        auto out = make_shared<string>();
+        stringifyParallel(v, out);
+      }));
+  results.push_back(measure(opt, c, "traverse", c.json.size(),
+                            [&]() { sink = traverse(*v); }));
+  results.push_back(measure(opt, c, "roundtrip", c.json.size(), [&]() {
+    auto tmp = make_shared<Value>();
+    auto out = make_shared<string>();
+    parse(tmp, c.json);
+    stringify(tmp, out);
+  }));
+}
+
+static void report(const Options& opt, vector<Result>& results) {
+#ifdef NDEBUG
+  const char* build = "release";
+#else
+  const char* build = "debug";
+#endif
+  printf("{\"build\":\"%s\",\"scale\":%d,\"runs\":%d,\"warmup\":%d,", build,
+         opt.scale, opt.runs, opt.warmup);
+  printf("\"results\":[");
+  bool first = true;
+  for (auto& r : results) {
+    if (r.samples.empty()) {
+      continue;  // filtered out
+    }
+    sort(r.samples.begin(), r.samples.end());
+    double median = r.samples[r.samples.size() / 2];
+    double mean = 0.0;
+    for (auto s : r.samples) {
+      mean += s;
+    }
+    mean /= r.samples.size();
+    printf("%s\n{\"corpus\":\"%s\",\"benchmark\":\"%s\",\"bytes\":%zu,"
+           "\"nodes\":%zu,\"min_ns\":%.0f,\"median_ns\":%.0f,"
+           "\"mean_ns\":%.0f,\"mb_per_s\":%.2f,\"ns_per_node\":%.2f}",
+           first ? "" : ",", r.corpus.c_str(), r.benchmark.c_str(), r.bytes,
+           r.nodes, r.samples.front(), median, mean,
+           r.bytes / median * 1e9 / (1024.0 * 1024.0), median / r.nodes);
+    first = false;
+  }
+  printf("\n]}\n");
+}
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--scale") == 0) {
+      opt.scale = max(1, atoi(argv[i + 1]));
+    } else if (strcmp(argv[i], "--runs") == 0) {
+      opt.runs = max(1, atoi(argv[i + 1]));
+    } else if (strcmp(argv[i], "--warmup") == 0) {
+      opt.warmup = max(0, atoi(argv[i + 1]));
+    } else if (strcmp(argv[i], "--corpus") == 0) {
+      opt.corpus = argv[i + 1];
+    } else if (strcmp(argv[i], "--benchmark") == 0) {
+      opt.benchmark = argv[i + 1];
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  vector<Corpus> corpora = {
+      {"canada", canadaLike(opt.scale), 0},
+      {"twitter", twitterLike(opt.scale), 0},
+      {"citm", citmLike(opt.scale), 0},
+      {"deep", deepLike(opt.scale), 0},
+  };
+  vector<Result> results;
+  for (auto& c : corpora) {
+    if (!opt.corpus.empty() && opt.corpus != c.name) {
+      continue;
+    }
+    auto v = make_shared<Value>();
+    parse(v, c.json);
+    c.nodes = countNodes(*v);
+    benchCorpus(opt, c, results);
+  }
+  report(opt, results);
+  return 0;
+}
@@ -1,6 +1,23 @@
+#include <cmath>
 #include <cstring>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 #include "yjson.h"
+#include "yjson_cache.h"
+#include "yjson_memory.h"
+#include "yjson_parallel.h"
+#include "yjson_patch.h"
+#include "yjson_persistent.h"
+#include "yjson_render.h"
+#include "yjson_schema.h"
+#include "yjson_source.h"
+#include "yjson_snapshot.h"
+#include "yjson_static.h"
+#include "yjson_stats.h"
+#include "yjson_tape.h"
+#include "yjson_validate.h"
+#include "yjson_writer.h"
 
 using namespace std;
 using namespace yph;
@@ -118,26 +135,23 @@ static void testParseNumber() {
   TEST_NUMBER(-1E-10, "-1E-10");
   TEST_NUMBER(1.234E+10, "1.234E+10");
   TEST_NUMBER(1.234E-10, "1.234E-10");
-  // TEST_NUMBER(0.0, "1e-10000"); // Underflow
+  TEST_NUMBER(0.0, "1e-10000");  // Underflow
 
   /* boundary */
   TEST_NUMBER(1.0000000000000002,
               "1.0000000000000002");  // The smallest number > 1
-  /* something wrong in stod ...
   TEST_NUMBER(4.9406564584124654e-324,
-              "4.9406564584124654e-324"); // Min denormal
-  cout << "here" << endl;
+              "4.9406564584124654e-324");  // Min denormal
   TEST_NUMBER(-4.9406564584124654e-324, "-4.9406564584124654e-324");
   TEST_NUMBER(2.2250738585072009e-308,
-              "2.2250738585072009e-308"); // Max subnormal
+              "2.2250738585072009e-308");  // Max subnormal
   TEST_NUMBER(-2.2250738585072009e-308, "-2.2250738585072009e-308");
   TEST_NUMBER(2.2250738585072014e-308,
-              "2.2250738585072014e-308"); // Min normal
+              "2.2250738585072014e-308");  // Min normal
   TEST_NUMBER(-2.2250738585072014e-308, "-2.2250738585072014e-308");
   TEST_NUMBER(1.7976931348623157e+308,
-              "1.7976931348623157e+308"); // Max normal
+              "1.7976931348623157e+308");  // Max normal
   TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
-  */
 }
 
 static void testParseNumberTooBig() {
@@ -159,6 +173,11 @@ static void testParseString() {
               "\"\\uD834\\uDD1E\""); /* G clef sign U+1D11E */
   TEST_STRING("\xF0\x9D\x84\x9E",
               "\"\\ud834\\udd1e\""); /* G clef sign U+1D11E */
+  /* raw UTF-8, the longest forms in block-sized runs */
+  TEST_STRING("caf\xC3\xA9 \xEF\xBF\xBD \xF4\x8F\xBF\xBF 0123456789 "
+              "0123456789 \xE2\x82\xAC",
+              "\"caf\xC3\xA9 \xEF\xBF\xBD \xF4\x8F\xBF\xBF 0123456789 "
+              "0123456789 \xE2\x82\xAC\"");
 }
 
 static void testParseMissingQuotationMark() {
@@ -178,6 +197,27 @@ static void testParseInvalidStringChar() {
   TEST_NULL(Status::PARSE_INVALID_STRING_CHAR, "\"\x1F\"");
 }
 
+static void testParseInvalidUtf8() {
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\x80\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xFF\"");
+  /* overlong */
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xC0\xAF\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xE0\x80\xAF\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xF0\x80\x80\xAF\"");
+  /* surrogates, above U+10FFFF */
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xED\xA0\x80\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xF4\x90\x80\x80\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xF5\x80\x80\x80\"");
+  /* truncated */
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xC3\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xE2\x82\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xF0\x9D\x84\\n\"");
+  TEST_NULL(Status::PARSE_INVALID_UTF8, "\"\xE2\x82");
+  /* past a block of ASCII */
+  TEST_NULL(Status::PARSE_INVALID_UTF8,
+            "{\"key\": \"0123456789 0123456789 0123456789 \xC3\xA9\xC3\"}");
+}
+
 static void testParseInvalidUnicodeHex() {
   TEST_NULL(Status::PARSE_INVALID_UNICODE_HEX, "\"\\u\"");
   TEST_NULL(Status::PARSE_INVALID_UNICODE_HEX, "\"\\u0\"");
@@ -320,6 +360,24 @@ static void testParseMissCommaOrCurlyBracket() {
   TEST_NULL(Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+static void testParseDepthExceeded() {
+  // would overflow the C++ stack with a recursive parser
+  string deep(100000, '[');
+  TEST_NULL(Status::PARSE_DEPTH_EXCEEDED, deep);
+  deep = string(kDefaultMaxDepth, '[') + string(kDefaultMaxDepth, ']');
+  TEST(Status::PARSE_OK, Type::ARRAY, deep);
+  TEST_NULL(Status::PARSE_DEPTH_EXCEEDED, "[" + deep + "]");
+
+  Context context;
+  Value v;
+  context.setMaxDepth(2);
+  EXPECT_EQ(2, context.getMaxDepth());
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, "[{\"a\":1},[]]"));
+  EXPECT_EQ(Status::PARSE_DEPTH_EXCEEDED, context.parse(v, "[{\"a\":[]}]"));
+  EXPECT_EQ(Status::PARSE_DEPTH_EXCEEDED, context.parse(v, "{\"a\":[[1]]}"));
+  EXPECT_EQ(Type::NVLL, v.type);
+}
+
 static void testAccessNull() {
   auto v = make_shared<Value>();
   setString(v, "Hello");
@@ -364,16 +422,14 @@ static void testStringifyNumber() {
   TEST_ROUNDTRIP("1.234e-20");
   TEST_ROUNDTRIP("1.0000000000000002");  // the smallest number > 1
 
-  /* something wrong in stod ...
-  TEST_ROUNDTRIP("4.9406564584124654e-324"); // minimum denormal
+  TEST_ROUNDTRIP("4.9406564584124654e-324");  // minimum denormal
   TEST_ROUNDTRIP("-4.9406564584124654e-324");
-  TEST_ROUNDTRIP("2.2250738585072009e-308"); // Max subnormal double
+  TEST_ROUNDTRIP("2.2250738585072009e-308");  // Max subnormal double
   TEST_ROUNDTRIP("-2.2250738585072009e-308");
-  TEST_ROUNDTRIP("2.2250738585072014e-308"); // Min normal positive double
+  TEST_ROUNDTRIP("2.2250738585072014e-308");  // Min normal positive double
   TEST_ROUNDTRIP("-2.2250738585072014e-308");
-  TEST_ROUNDTRIP("1.7976931348623157e+308"); // Max double
+  TEST_ROUNDTRIP("1.7976931348623157e+308");  // Max double
   TEST_ROUNDTRIP("-1.7976931348623157e+308");
-  */
 }
 
 static void testStringifyString() {
@@ -381,12 +437,15 @@ static void testStringifyString() {
   TEST_ROUNDTRIP("\"Hello\"");
   TEST_ROUNDTRIP("\"Hello\\nWorld\"");
   TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
+  TEST_ROUNDTRIP("\"\\u0001 \\u001F\"");
+  TEST_ROUNDTRIP("\"\xE2\x82\xAC \xF0\x9D\x84\x9E\"");
   // TEST_ROUNDTRIP("\"Hello\\u0000World\"");
 }
 
 static void testStringifyArray() {
   TEST_ROUNDTRIP("[]");
   TEST_ROUNDTRIP("[null,false,true,123,\"abc\",[1,2,3]]");
+  TEST_ROUNDTRIP("[1,[],[[]],{}]");
 }
 
 static void testStringifyObject() {
@@ -394,6 +453,7 @@ static void testStringifyObject() {
   TEST_ROUNDTRIP(
       "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3]"
       ",\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+  TEST_ROUNDTRIP("{\"a\":{},\"b\":[],\"c\":{\"d\":[]}}");
 }
 
 static void testStringify() {
@@ -406,6 +466,1526 @@ static void testStringify() {
   testStringifyObject();
 }
 
+static void testContext() {
+  Context context;
+  Value v;
+  EXPECT_EQ(Status::PARSE_OK,
+            context.parse(v, "{\"name\":\"first document\",\"ids\":[1,2,3]}"));
+  auto names = &std::get<vector<Entry>>(v.data);
+  auto ids = &std::get<vector<Value>>((*names)[1].val.data);
+  // same shape: the containers are reused in place
+  EXPECT_EQ(Status::PARSE_OK,
+            context.parse(v, "{\"name\":\"second document\",\"ids\":[4,5]}"));
+  EXPECT_EQ(true, (names == &std::get<vector<Entry>>(v.data)));
+  EXPECT_EQ(true, (ids == &std::get<vector<Value>>((*names)[1].val.data)));
+  EXPECT_EQ("second document", std::get<string>((*names)[0].val.data));
+  EXPECT_EQ(2, ids->size());
+  EXPECT_EQ(5.0, std::get<double>((*ids)[1].data));
+  // different shape
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, "[\"x\", {\"y\": null}]"));
+  EXPECT_EQ(Type::ARRAY, v.type);
+  EXPECT_EQ(2, std::get<vector<Value>>(v.data).size());
+  EXPECT_EQ(Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+            context.parse(v, "[1 2]"));
+  EXPECT_EQ(Type::NVLL, v.type);
+  EXPECT_EQ(3, context.position());
+  EXPECT_EQ(Status::PARSE_NULL_POINTER, context.parse(ValuePtr(), "1"));
+
+  // prefix parsing, as used by the StringPtr parsers
+  EXPECT_EQ(Status::PARSE_OK, context.parseValue(v, "[1,2] tail"));
+  EXPECT_EQ(5, context.position());
+  auto s = make_shared<string>("\"abc\" , 1");
+  auto sv = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK, parseValue(s, sv));
+  EXPECT_EQ("abc", getString(sv));
+  EXPECT_EQ(" , 1", *s);
+
+#ifdef YJSON_STATS
+  const char* json =
+      "{\"key that is not short\":[\"a string value that is long\","
+      "1.5,true,{\"k\":[null]}]}";
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, json));
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, json));
+  EXPECT_EQ(0, lastStats().allocations);
+#endif
+}
+
+static void testLazyNumbers() {
+  Context context;
+  context.setLazyNumbers(true);
+  auto v = make_shared<Value>();
+  const char* json =
+      "[9007199254740993,-9223372036854775808,18446744073709551615,1.50,"
+      "-0,1e2,0.1,123456789012345678901234567890123456789]";
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, json));
+  // untouched numbers are written back verbatim
+  auto out = make_shared<string>();
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(v, out));
+  EXPECT_EQ(json, *out);
+
+  std::int64_t i = 0;
+  std::uint64_t u = 0;
+  auto id = getArrayElement(v, 0);
+  EXPECT_EQ(Type::NUMBER, getType(id));
+  EXPECT_EQ(true, getInt64(id, i));
+  EXPECT_EQ(9007199254740993, i);
+  EXPECT_EQ(9007199254740992.0, getNumber(id));
+  EXPECT_EQ("9007199254740993", getNumberText(id));
+  EXPECT_EQ(true, getInt64(getArrayElement(v, 1), i));
+  EXPECT_EQ(INT64_MIN, i);
+  EXPECT_EQ(false, getUint64(getArrayElement(v, 1), u));
+  EXPECT_EQ(false, getInt64(getArrayElement(v, 2), i));
+  EXPECT_EQ(true, getUint64(getArrayElement(v, 2), u));
+  EXPECT_EQ(UINT64_MAX, u);
+  EXPECT_EQ(1.5, getNumber(getArrayElement(v, 3)));
+  EXPECT_EQ(false, getInt64(getArrayElement(v, 3), i));
+  EXPECT_EQ(true, getUint64(getArrayElement(v, 4), u));
+  EXPECT_EQ(0, u);
+  // whole numbers written with an exponent still convert exactly
+  EXPECT_EQ(true, getInt64(getArrayElement(v, 5), i));
+  EXPECT_EQ(100, i);
+  EXPECT_EQ(0.1, getNumber(getArrayElement(v, 6)));
+  auto big = getArrayElement(v, 7);
+  EXPECT_EQ(1.2345678901234568e38, getNumber(big));
+  EXPECT_EQ(false, getUint64(big, u));
+  EXPECT_EQ("123456789012345678901234567890123456789", getNumberText(big));
+
+  // numbers compare by value, 64-bit integers exactly
+  auto eager = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK, parse(eager, json));
+  EXPECT_EQ(false, (*v == *eager));
+  EXPECT_EQ(true, (*getArrayElement(v, 0) != *getArrayElement(eager, 0)));
+  // 2^64 - 1 became 2^64 as a double
+  EXPECT_EQ(true, (*getArrayElement(v, 2) != *getArrayElement(eager, 2)));
+  for (size_t k = 3; k < getArraySize(v); k++) {
+    EXPECT_EQ(true, (*getArrayElement(v, k) == *getArrayElement(eager, k)));
+    EXPECT_EQ(hashValue(*getArrayElement(v, k)),
+              hashValue(*getArrayElement(eager, k)));
+  }
+  EXPECT_EQ("1.5", getNumberText(getArrayElement(eager, 3)));
+  EXPECT_EQ(true, getInt64(getArrayElement(eager, 5), i));
+  EXPECT_EQ(100, i);
+
+  // setters and the eager parse replace the text
+  setNumber(id, 2.5);
+  EXPECT_EQ("2.5", getNumberText(id));
+  EXPECT_EQ(Status::PARSE_NUMBER_TOO_BIG, context.parse(v, "[1, 1e309]"));
+  EXPECT_EQ(Status::PARSE_INVALID_VALUE, context.parse(v, "[1.]"));
+  context.setLazyNumbers(false);
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, "12345678901234567890"));
+  out->clear();
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(v, out));
+  EXPECT_EQ("1.2345678901234567e+19", *out);
+}
+
+static void testPackedArrays() {
+  Context context;
+  context.setPackedArrays(true);
+  auto v = make_shared<Value>();
+  const char* json =
+      "{\"coordinates\":[[-65.61361699999999,43.420273000000009],[1,2]],"
+      "\"mixed\":[1,\"a\"],\"empty\":[],\"tags\":[\"x\"]}";
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, json));
+  auto coordinates = getObjectValue(v, 0);
+  EXPECT_EQ(true, (getNumberArray(coordinates) == nullptr));
+  auto point = getArrayElement(coordinates, 0);
+  auto numbers = getNumberArray(point);
+  EXPECT_EQ(true, (numbers != nullptr));
+  EXPECT_EQ(2, numbers->size());
+  EXPECT_EQ(-65.61361699999999, (*numbers)[0]);
+  EXPECT_EQ(2, getArraySize(point));
+  EXPECT_EQ(43.420273000000009, getNumber(getArrayElement(point, 1)));
+  EXPECT_EQ(true, (getNumberArray(getObjectValue(v, 1)) == nullptr));
+  EXPECT_EQ(true, (getNumberArray(getObjectValue(v, 2)) == nullptr));
+
+  // the same document as without packing, in every respect
+  auto plain = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK, parse(plain, json));
+  EXPECT_EQ(true, (*v == *plain));
+  EXPECT_EQ(true, (*plain == *v));
+  EXPECT_EQ(hashValue(*plain), hashValue(*v));
+  auto out = make_shared<string>();
+  auto expected = make_shared<string>();
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(v, out));
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(plain, expected));
+  EXPECT_EQ(*expected, *out);
+  Tape tape;
+  Tape plainTape;
+  toTape(v, tape);
+  toTape(plain, plainTape);
+  EXPECT_EQ(true, (tape.words == plainTape.words));
+  Value thawed;
+  thaw(freeze(*v), thawed);
+  EXPECT_EQ(true, (thawed == *plain));
+  EXPECT_EQ(0, getArraySize(diff(v, plain)));
+
+  // edits unpack the array they go into
+  auto patch = make_shared<Value>();
+  parse(patch, "[{\"op\": \"add\", \"path\": \"/coordinates/1/-\", "
+               "\"value\": 3}]");
+  EXPECT_EQ(Status::PATCH_OK, applyPatch(v, patch));
+  auto edited = getArrayElement(getObjectValue(v, 0), 1);
+  EXPECT_EQ(true, (getNumberArray(edited) == nullptr));
+  EXPECT_EQ(3, getArraySize(edited));
+  // reads leave packed arrays packed
+  auto first = getArrayElement(getObjectValue(v, 0), 0);
+  parse(patch, "[{\"op\": \"test\", \"path\": \"/coordinates/0/1\", "
+               "\"value\": 43.420273000000009}, {\"op\": \"copy\", "
+               "\"from\": \"/coordinates/0/0\", \"path\": \"/x\"}]");
+  EXPECT_EQ(Status::PATCH_OK, applyPatch(v, patch));
+  EXPECT_EQ(true, (getNumberArray(first) != nullptr));
+  EXPECT_EQ(-65.61361699999999, getNumber(getObjectValue(v, 4)));
+  parse(patch, "[{\"op\": \"test\", \"path\": \"/coordinates/0/2\", "
+               "\"value\": 1}]");
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, applyPatch(v, patch));
+  parse(patch, "[{\"op\": \"test\", \"path\": \"/coordinates/0/0/a\", "
+               "\"value\": 1}]");
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, applyPatch(v, patch));
+  EXPECT_EQ(true, (getNumberArray(first) != nullptr));
+  setNumberArray(point, {1, 2.5});
+  const Value& packed = *point;
+  EXPECT_EQ(true, (resolvePointer(packed, "") == &packed));
+  EXPECT_EQ(true, (resolvePointer(packed, "/1") == nullptr));
+  EXPECT_EQ(2.5, numberValue(*resolvePointer(*point, "/1")));
+  EXPECT_EQ(true, (getNumberArray(point) == nullptr));
+
+  // errors stop where they would without packing
+  for (const char* bad : {"[1,2", "[1,]", "[1 2]", "[1,-]", "[1,1e309]"}) {
+    Context eager;
+    Value a, b;
+    EXPECT_EQ(eager.parse(a, bad), context.parse(b, bad));
+    EXPECT_EQ(eager.position(), context.position());
+  }
+  // lazy numbers keep their text, so they are not packed
+  context.setLazyNumbers(true);
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, "[1.50]"));
+  EXPECT_EQ(true, (getNumberArray(v) == nullptr));
+}
+
+static void testRenderCache() {
+  auto v = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK,
+            parse(v, "{\"users\": [{\"name\": \"alice\", \"tags\": "
+                     "[\"admin\", \"ops\", \"on-call\", \"eu-west\"]}, "
+                     "{\"name\": \"bob\", \"tags\": [\"dev\", "
+                     "\"frontend\", \"reviewer\", \"us-east\"]}], "
+                     "\"count\": 2}"));
+  auto plain = [&v]() {
+    auto s = make_shared<string>();
+    stringify(v, s);
+    return *s;
+  };
+  string expected = plain();
+  RenderCache cache;
+  string out;
+  EXPECT_EQ(Status::STRINGIFY_OK, cache.stringify(*v, out));
+  EXPECT_EQ(expected, out);
+  EXPECT_EQ(true, (cache.cachedBytes() > out.size()));
+
+  // untouched containers are copied, not walked: an edit that skips
+  // invalidateHash is not seen
+  auto& users = std::get<vector<Entry>>(v->data)[0].val;
+  auto& bob = std::get<vector<Value>>(users.data)[1];
+  auto& name = std::get<vector<Entry>>(bob.data)[0].val;
+  name.data = string("carol");
+  out.clear();
+  cache.stringify(*v, out);
+  EXPECT_EQ(expected, out);
+  for (auto node : {v.get(), &users, &bob}) {
+    invalidateHash(*node);
+  }
+  out.clear();
+  cache.stringify(*v, out);
+  expected = plain();
+  EXPECT_EQ(string::npos, expected.find("bob"));
+  EXPECT_EQ(expected, out);
+
+  // patches, setters and parsing clear the marks themselves
+  auto patch = make_shared<Value>();
+  parse(patch, "[{\"op\": \"remove\", \"path\": \"/users/0\"}, "
+               "{\"op\": \"add\", \"path\": \"/users/0/tags/-\", "
+               "\"value\": \"lead\"}]");
+  EXPECT_EQ(Status::PATCH_OK, applyPatch(v, patch));
+  for (int round = 0; round < 2; round++) {
+    out.clear();
+    cache.stringify(*v, out);
+    expected = plain();
+    EXPECT_EQ(expected, out);
+  }
+  RenderCache other;
+  string copied;
+  Value copy = *v;
+  other.stringify(copy, copied);
+  EXPECT_EQ(expected, copied);
+  EXPECT_EQ(Status::PARSE_OK,
+            parse(v, "[[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, "
+                     "17, 18, 19, 20, 21, 22, 23, 24, 25]]"));
+  out.clear();
+  cache.stringify(*v, out);
+  expected = plain();
+  EXPECT_EQ(expected, out);
+  cache.clear();
+  EXPECT_EQ(0, cache.cachedBytes());
+}
+
+static bool sameSpans(const SourceSpan& a, const SourceSpan& b) {
+  if (a.begin != b.begin || a.length != b.length ||
+      a.children.size() != b.children.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.children.size(); i++) {
+    if (!sameSpans(a.children[i], b.children[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void testSourceDocument() {
+  SourceDocument doc;
+  EXPECT_EQ(Status::PARSE_OK,
+            doc.parse(" {\"servers\": [{\"host\": \"a\", \"port\": 80}, "
+                      "{\"host\": \"b\", \"port\": 81}],\n"
+                      " \"retries\": [1, 2, 3], \"name\": \"x\"} "));
+  size_t begin = 0;
+  size_t end = 0;
+  EXPECT_EQ(true, doc.sourceRange("", begin, end));
+  EXPECT_EQ(1, begin);
+  EXPECT_EQ(doc.text().size() - 1, end);
+  EXPECT_EQ(true, doc.sourceRange("/servers/1/port", begin, end));
+  EXPECT_EQ("81", doc.text().substr(begin, end - begin));
+  EXPECT_EQ(false, doc.sourceRange("/servers/2", begin, end));
+
+  // each edit must leave what a full parse of the new text gives
+  auto check = [&doc](Status status, size_t maxReparsed) {
+    EXPECT_EQ(status, doc.status());
+    SourceDocument full;
+    EXPECT_EQ(status, full.parse(doc.text()));
+    EXPECT_EQ(true, (doc.root() == full.root()));
+    EXPECT_EQ(true, sameSpans(doc.rootSpan(), full.rootSpan()));
+    EXPECT_EQ(true, (doc.reparsedBytes() <= maxReparsed));
+  };
+  // a scalar: only its own text is parsed again
+  doc.sourceRange("/servers/0/port", begin, end);
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(begin, 2, "8080"));
+  check(Status::PARSE_OK, 4);
+  doc.sourceRange("/servers/0/host", begin, end);
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(begin + 1, 1, "alpha"));
+  check(Status::PARSE_OK, 7);
+  // a new member changes the structure of the object around the value
+  doc.sourceRange("/servers/1/port", begin, end);
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(end, 0, ", \"tls\": true"));
+  check(Status::PARSE_OK, 64);
+  EXPECT_EQ(true, doc.sourceRange("/servers/1/tls", begin, end));
+  EXPECT_EQ("true", doc.text().substr(begin, end - begin));
+  // between the members of the root: the whole text
+  doc.sourceRange("/name", begin, end);
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(end, 0, ", \"debug\": false"));
+  check(Status::PARSE_OK, doc.text().size() + 20);
+  // half-typed text fails like parse, and the next edit recovers
+  doc.sourceRange("/retries/1", begin, end);
+  EXPECT_EQ(Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+            doc.edit(begin, 1, "2 4"));
+  check(Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 2 * doc.text().size());
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(begin + 1, 0, ","));
+  check(Status::PARSE_OK, doc.text().size());
+  EXPECT_EQ(4, getArraySize(std::make_shared<Value>(
+                   std::get<vector<Entry>>(doc.root().data)[1].val)));
+
+  // a node deep down is re-parsed with only the depth left above it
+  string deep = string(1000, '[') + string(1000, ']');
+  EXPECT_EQ(Status::PARSE_OK, doc.parse(deep));
+  EXPECT_EQ(Status::PARSE_OK, doc.edit(1000, 0, "[[]]"));
+  check(Status::PARSE_OK, 6);
+  EXPECT_EQ(Status::PARSE_OK, doc.parse(deep));
+  EXPECT_EQ(Status::PARSE_DEPTH_EXCEEDED,
+            doc.edit(1000, 0, string(100, '[') + string(100, ']')));
+  check(Status::PARSE_DEPTH_EXCEEDED, 2 * doc.text().size());
+}
+
+// writes the events back out in a compact notation
+class RecordingHandler : public Handler {
+ public:
+  Status onNull() override { return add("n"); }
+  Status onBoolean(bool b) override { return add(b ? "t" : "f"); }
+  Status onNumber(double d) override {
+    std::ostringstream os;
+    os << d;
+    return add(os.str());
+  }
+  Status onString(std::string_view s) override {
+    return add("\"" + string(s) + "\"");
+  }
+  Status onStartArray() override { return add("["); }
+  Status onEndArray() override { return add("]"); }
+  Status onStartObject() override { return add("{"); }
+  Status onKey(std::string_view key) override {
+    return add(string(key) + ":");
+  }
+  Status onEndObject() override { return add("}"); }
+
+  string events;
+  size_t limit = SIZE_MAX;
+
+ private:
+  Status add(const string& event) {
+    if (limit-- == 0) {
+      return Status::PATCH_TEST_FAILED;  // any status stops the parse
+    }
+    events += event + " ";
+    return Status::PARSE_OK;
+  }
+};
+
+static void testSax() {
+  Context context;
+  RecordingHandler handler;
+  EXPECT_EQ(Status::PARSE_OK,
+            context.parse(" {\"a\" : [1, -2.5e3, \"x\\ty\", {}], \"b\":"
+                          " {\"c\": [null, true, false, []]}} ",
+                          handler));
+  EXPECT_EQ("{ a: [ 1 -2500 \"x\ty\" { } ] b: { c: [ n t f [ ] ] } } ",
+            handler.events);
+  // a handler status ends the parse at once
+  handler.events.clear();
+  handler.limit = 3;
+  EXPECT_EQ(Status::PATCH_TEST_FAILED, context.parse("[1, 2, 3, 4]", handler));
+  EXPECT_EQ("[ 1 2 ", handler.events);
+  EXPECT_EQ(8, context.position());
+
+  // the same syntax errors as building a tree
+  const char* invalid[] = {
+      "",        "nul",        "[1,]",      "{\"a\":1,}", "1 2",
+      "\"abc",   "\"\\v\"",    "\"\\u12\"", "\"\\uD800\"", "[1",
+      "[1}",     "[[]",        "{1:1}",     "{\"a\":1,",  "{\"a\"}",
+      "{\"a\":1]", "{\"a\":{}", "1e309",    "[\"\x01\"]", " ",
+  };
+  handler.limit = SIZE_MAX;
+  for (auto json : invalid) {
+    Value v;
+    EXPECT_EQ(context.parse(v, json), context.parse(json, handler));
+  }
+  context.setMaxDepth(2);
+  EXPECT_EQ(Status::PARSE_OK, context.parse("[[1]]", handler));
+  EXPECT_EQ(Status::PARSE_DEPTH_EXCEEDED, context.parse("[[[1]]]", handler));
+}
+
+static void testValidate() {
+  // long runs take the vectorized paths, short ones the scalar tails
+  string spaces(37, ' ');
+  spaces[5] = '\t';
+  spaces[20] = '\n';
+  spaces[33] = '\r';
+  string text(53, 'x');
+  text[40] = '\\';
+  text[41] = '/';
+  const string valid[] = {
+      "0",
+      spaces + "[" + spaces + "\"" + text + "\"" + spaces + "]" + spaces,
+      "{\"a\":[1,-2.5e3,\"\\u00e9\\ud834\\udd1e\",{}],\"b\":{\"c\":[null]}}",
+      "-12345678901234567890123456789012.5e-7",
+      "1.7976931348623157e308",
+      // just below the overflow threshold of strtod
+      "17976931348623158079372897140530341507993413271003782693617377898044"
+      "49682927647509466490179775872070963302864166928879109465555478519404"
+      "02630657488671505820681908902000708383676273854845817711531764475730"
+      "27006985557136695962284291481986083493647529271907416844436551070434"
+      "2711559699508093042880177904174497791",
+      "0.0000000000000000000017976931348623158079e329",
+      "1e-99999",
+      "\"ab\\u0000\x01\\z\"",
+      "\"" + text + "\xF0\x9D\x84\x9E" + text + "\"",
+  };
+  for (auto& json : valid) {
+    EXPECT_EQ(Status::PARSE_OK, validate(json).first);
+    EXPECT_EQ(json.size(), validate(json).second);
+  }
+  // the same status and position as a failed parse
+  const string invalid[] = {
+      "",
+      spaces,
+      "nul",
+      "[1,]",
+      "{\"a\":1,}",
+      "1 2",
+      "\"" + text,
+      "\"" + text + "\x1F\"",
+      "\"\\v\"",
+      "\"\\u12\"",
+      "\"\\uD800\"",
+      "\"\\uD800\\uE000\"",
+      "\"" + text + "\xE2\x82\"",
+      "[\"\xC3\xA9\xED\xA0\x80\"]",
+      "[1",
+      "[1}",
+      "[[]",
+      "{1:1}",
+      "{\"a\":1,",
+      "{\"a\"}",
+      "{\"a\":1]",
+      "{\"a\":{}",
+      "[-]",
+      "[1.]",
+      "[1e+]",
+      "[0" + spaces + "x]",
+      "1e309",
+      "[1.7976931348623159e308]",
+      "17976931348623158079372897140530341507993413271003782693617377898044"
+      "49682927647509466490179775872070963302864166928879109465555478519404"
+      "02630657488671505820681908902000708383676273854845817711531764475730"
+      "27006985557136695962284291481986083493647529271907416844436551070434"
+      "2711559699508093042880177904174497792",
+      string(kDefaultMaxDepth + 1, '['),
+  };
+  Context context;
+  Value v;
+  for (auto& json : invalid) {
+    Status status = context.parse(v, json);
+    EXPECT_EQ(status, validate(json).first);
+    EXPECT_EQ(context.position(), validate(json).second);
+  }
+  EXPECT_EQ(Status::PARSE_OK,
+            validate(string(kDefaultMaxDepth, '[') +
+                     string(kDefaultMaxDepth, ']'))
+                .first);
+}
+
+static void testParseParallel() {
+  string json = "[";
+  for (int i = 0; i < 200; i++) {
+    json += i ? ", " : "";
+    json += "{\"id\": " + std::to_string(i) +
+            ", \"name\": \"n\\\"[,\", \"tags\": [true, null, -1.5e3]}";
+  }
+  json += "]";
+  ParallelOptions options;
+  options.threads = 4;
+  options.minChunkBytes = 8;
+  auto serial = [](const string& json) {
+    auto v = make_shared<Value>();
+    auto out = make_shared<string>();
+    Status status = parse(v, json);
+    stringify(v, out);
+    return std::make_pair(status, *out);
+  };
+  auto parallel = [&](const string& json) {
+    auto v = make_shared<Value>();
+    auto out = make_shared<string>();
+    Status status = parseParallel(v, json, options);
+    stringify(v, out);
+    return std::make_pair(status, *out);
+  };
+  auto expect = serial(json);
+  EXPECT_EQ(Status::PARSE_OK, expect.first);
+  EXPECT_EQ(expect.second, parallel(json).second);
+  // a top level object, and a big array one level down
+  string object = "{\"a\": 1, \"data\": " + json + ", \"b\": {}}";
+  EXPECT_EQ(serial(object).second, parallel(object).second);
+  EXPECT_EQ(Status::PARSE_OK, parallel(object).first);
+  EXPECT_EQ(serial(" [ ] ").second, parallel(" [ ] ").second);
+
+  // errors come out as in a serial parse
+  string errors[] = {
+      json.substr(0, json.size() - 1),
+      json + " x",
+      json.substr(0, json.size() - 1) + ",]",
+      "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 17, 18]",
+      "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18}",
+      "[1, 2, 3, 4, 5, 6, 7, 8, 9, [10}, 11, 12, 13, 14, 15, 16, 17, 18]",
+      "[1, 2, 3, \"4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18]",
+      "{\"a\": 1, \"b\" 2, \"c\": 3, \"d\": 4, \"e\": 5, \"f\": 6}",
+      "{\"a\": 1, \"b\": 2, 3, \"d\": 4, \"e\": 5, \"f\": 6, \"g\": 7}",
+      "{\"a\": 1, \"b\": 2, \"c\": tru, \"d\": 4, \"e\": 5, \"f\": nul}",
+  };
+  for (auto& e : errors) {
+    EXPECT_EQ(serial(e).first, parallel(e).first);
+    EXPECT_EQ(Type::NVLL, [&]() {
+      auto v = make_shared<Value>();
+      parseParallel(v, e, options);
+      return getType(v);
+    }());
+  }
+
+  // packed arrays come out as with a packing Context, split ones included
+  options.packedArrays = true;
+  Context packing;
+  packing.setPackedArrays(true);
+  string numbers = "[";
+  for (int i = 0; i < 200; i++) {
+    numbers += (i ? ", " : "") + std::to_string(i * 0.5);
+  }
+  numbers += "]";
+  string nested = "{\"a\": [1], \"b\": " + numbers + "}";
+  for (auto& text : {numbers, nested, json}) {
+    auto expected = make_shared<Value>();
+    auto v = make_shared<Value>();
+    EXPECT_EQ(Status::PARSE_OK, packing.parse(expected, text));
+    EXPECT_EQ(Status::PARSE_OK, parseParallel(v, text, options));
+    EXPECT_EQ(true, (*expected == *v));
+    // the array of numbers, or of objects in json
+    auto arrayOf = [](ValuePtr x) {
+      return getType(x) == Type::OBJECT ? getObjectValue(x, 1) : x;
+    };
+    EXPECT_EQ((getNumberArray(arrayOf(expected)) != nullptr),
+              (getNumberArray(arrayOf(v)) != nullptr));
+    EXPECT_EQ((text != json), (getNumberArray(arrayOf(v)) != nullptr));
+  }
+  options.packedArrays = false;
+
+  options.maxDepth = 2;
+  EXPECT_EQ(Status::PARSE_DEPTH_EXCEEDED, parallel(json).first);
+  options.maxDepth = 3;
+  EXPECT_EQ(Status::PARSE_OK, parallel(json).first);
+}
+
+static void testStringifyParallel() {
+  string json = "[";
+  for (int i = 0; i < 300; i++) {
+    json += i ? "," : "";
+    json += "{\"id\":" + std::to_string(i) +
+            ",\"s\":\"a\\tb\",\"list\":[1.5,null,[],{}]}";
+  }
+  json += "]";
+  string object = "{\"head\":true,\"rows\":" + json + ",\"tail\":[]}";
+  ParallelOptions options;
+  options.threads = 4;
+  options.minChunkChildren = 16;
+  for (auto& text : {json, object, string("[]"), string("\"x\"")}) {
+    auto v = make_shared<Value>();
+    EXPECT_EQ(Status::PARSE_OK, parse(v, text));
+    auto serial = make_shared<string>();
+    stringify(v, serial);
+    EXPECT_EQ(text, *serial);
+    auto parallel = make_shared<string>();
+    EXPECT_EQ(Status::STRINGIFY_OK, stringifyParallel(v, parallel, options));
+    EXPECT_EQ(*serial, *parallel);
+  }
+  auto v = make_shared<Value>();
+  parse(v, object);
+  vector<string> chunks;
+  stringifyParallel(*v, chunks, options);
+  EXPECT_EQ(true, (chunks.size() > 4));
+
+  const char* path = "yjson_test_stringify.json";
+  FILE* fp = fopen(path, "w+");
+  EXPECT_EQ(Status::STRINGIFY_OK, stringifyParallel(v, fileno(fp), options));
+  rewind(fp);
+  string written(object.size() + 1, '\0');
+  written.resize(fread(&written[0], 1, written.size(), fp));
+  fclose(fp);
+  remove(path);
+  EXPECT_EQ(object, written);
+  EXPECT_EQ(Status::STRINGIFY_IO_ERROR, stringifyParallel(v, -1, options));
+}
+
+static Value parsed(const char* json) {
+  Value v;
+  Context context;
+  EXPECT_EQ(Status::PARSE_OK, context.parse(v, json));
+  return v;
+}
+
+static string stringified(const Value& v) {
+  string out;
+  stringifyValue(v, out);
+  return out;
+}
+
+static void testWriter() {
+  string out;
+  vector<size_t> flushes;
+  auto collect = [&](std::string_view bytes) {
+    out.append(bytes);
+    flushes.push_back(bytes.size());
+    return true;
+  };
+  Writer w(collect, 8);
+  EXPECT_EQ(Status::STRINGIFY_OK, w.startObject());
+  w.key("rows");
+  w.startArray();
+  for (int i = 0; i < 3; i++) {
+    w.startObject();
+    w.key("id");
+    w.value(i + 0.5);
+    w.key("name");
+    w.value("a\"b\n");
+    w.key("ok");
+    w.value(i % 2 == 0);
+    w.key("none");
+    w.value(nullptr);
+    w.end();
+  }
+  w.end();
+  w.key("tail");
+  w.startArray();
+  w.end();
+  w.key("tree");
+  w.value(parsed("{\"x\":[1,\"\\u0001\"]}"));
+  EXPECT_EQ(Status::STRINGIFY_OK, w.end());
+  EXPECT_EQ(0, w.depth());
+  EXPECT_EQ(Status::STRINGIFY_OK, w.finish());
+  const char* expected =
+      "{\"rows\":[{\"id\":0.5,\"name\":\"a\\\"b\\n\",\"ok\":true,"
+      "\"none\":null},{\"id\":1.5,\"name\":\"a\\\"b\\n\",\"ok\":false,"
+      "\"none\":null},{\"id\":2.5,\"name\":\"a\\\"b\\n\",\"ok\":true,"
+      "\"none\":null}],\"tail\":[],\"tree\":{\"x\":[1,\"\\u0001\"]}}";
+  EXPECT_EQ(string(expected), out);
+  // the same bytes as stringify of the tree
+  EXPECT_EQ(stringified(parsed(expected)), out);
+  // full buffers go out as soon as they fill, at most one token over
+  for (size_t i = 0; i + 1 < flushes.size(); i++) {
+    EXPECT_EQ(true, (flushes[i] >= 8 && flushes[i] < 8 + 20));
+  }
+
+  // misplaced calls write nothing and stick
+  auto misuse = [&](std::function<void(Writer&)> calls, Status status) {
+    out.clear();
+    Writer bad(collect);
+    calls(bad);
+    EXPECT_EQ(status, bad.status());
+    EXPECT_EQ(status, bad.value(1.0));
+    EXPECT_EQ(status, bad.finish());
+    EXPECT_EQ(true, out.empty());
+  };
+  const Status invalid = Status::STRINGIFY_INVALID_CALL;
+  misuse([](Writer& x) { x.startObject(), x.value(1.0); }, invalid);
+  misuse([](Writer& x) { x.startArray(), x.key("k"); }, invalid);
+  misuse([](Writer& x) { x.startObject(), x.key("k"), x.key("k"); },
+         invalid);
+  misuse([](Writer& x) { x.startObject(), x.key("k"), x.end(); }, invalid);
+  misuse([](Writer& x) { x.end(); }, invalid);
+  misuse([](Writer& x) { x.key("k"); }, invalid);
+  misuse([](Writer& x) { x.value(true), x.value(false); }, invalid);
+  misuse([](Writer& x) { x.startArray(), x.end(), x.startArray(); },
+         invalid);
+  misuse([](Writer& x) { x.startArray(), x.value(std::nan("")); }, invalid);
+  misuse([](Writer& x) { x.value(-HUGE_VAL); }, invalid);
+
+  // integers need no cast
+  out.clear();
+  Writer ints(collect);
+  ints.startArray();
+  ints.value(42);
+  ints.value(size_t(7));
+  ints.value(-1LL);
+  ints.value(true);
+  // past 2^53, where a double would round
+  ints.value(std::int64_t(9007199254740993));
+  ints.value(INT64_MIN);
+  ints.value(UINT64_MAX);
+  ints.end();
+  EXPECT_EQ(Status::STRINGIFY_OK, ints.finish());
+  EXPECT_EQ(string("[42,7,-1,true,9007199254740993,-9223372036854775808,"
+                   "18446744073709551615]"),
+            out);
+  // and read back exactly with lazy numbers
+  Context lazy;
+  lazy.setLazyNumbers(true);
+  auto written = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK, lazy.parse(written, out));
+  std::int64_t id = 0;
+  EXPECT_EQ(true, getInt64(getArrayElement(written, 4), id));
+  EXPECT_EQ(9007199254740993, id);
+  out.clear();
+  Writer open(collect);
+  open.startArray();
+  EXPECT_EQ(invalid, open.finish());
+  Writer empty(collect);
+  EXPECT_EQ(invalid, empty.finish());
+  EXPECT_EQ(true, out.empty());
+  Writer shallow(collect, 8, 2);
+  shallow.startArray();
+  shallow.startArray();
+  EXPECT_EQ(invalid, shallow.startObject());
+
+  // a failing sink stops the writer
+  Writer broken([](std::string_view) { return false; }, 4);
+  EXPECT_EQ(Status::STRINGIFY_OK, broken.startArray());
+  EXPECT_EQ(Status::STRINGIFY_IO_ERROR, broken.value("long enough"));
+  EXPECT_EQ(Status::STRINGIFY_IO_ERROR, broken.end());
+  EXPECT_EQ(Status::STRINGIFY_IO_ERROR, broken.finish());
+}
+
+static void testHash() {
+  Value a = parsed("{\"a\":1,\"b\":[true,null,\"x\"],\"c\":{\"d\":-0}}");
+  Value b = parsed("{\"c\":{\"d\":0},\"b\":[true,null,\"x\"],\"a\":1.0}");
+  EXPECT_EQ(true, (a == b));
+  EXPECT_EQ(hashValue(a), hashValue(b));
+  EXPECT_EQ(true, (a == b));  // with cached hashes
+  EXPECT_EQ(true, (parsed("[1,2]") != parsed("[2,1]")));
+  EXPECT_EQ(true, (hashValue(parsed("[1,2]")) != hashValue(parsed("[2,1]"))));
+  EXPECT_EQ(true, (parsed("{\"a\":1}") != parsed("{\"a\":2}")));
+  EXPECT_EQ(true, (parsed("{\"a\":1}") != parsed("{\"b\":1}")));
+  EXPECT_EQ(true, (parsed("\"1\"") != parsed("1")));
+  // duplicate keys count as often as they occur
+  EXPECT_EQ(true, (parsed("{\"a\":1,\"a\":1,\"a\":2}") !=
+                   parsed("{\"a\":1,\"a\":2,\"a\":2}")));
+  EXPECT_EQ(true, (parsed("{\"a\":1,\"b\":2,\"a\":1}") ==
+                   parsed("{\"a\":1,\"a\":1,\"b\":2}")));
+  EXPECT_EQ(true, (parsed("{\"a\":1,\"b\":2,\"a\":3}") ==
+                   parsed("{\"b\":2,\"a\":3,\"a\":1}")));
+  EXPECT_EQ(true, (parsed("{\"a\":1,\"a\":1,\"b\":2}") !=
+                   parsed("{\"a\":1,\"b\":2,\"b\":2}")));
+  // members in reverse order are matched by key
+  string forward = "{";
+  string reverse = "{";
+  for (int i = 0; i < 1000; i++) {
+    forward += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":[" +
+               std::to_string(i) + "]";
+    reverse += (i ? ",\"k" : "\"k") + std::to_string(999 - i) + "\":[" +
+               std::to_string(999 - i) + "]";
+  }
+  Value all = parsed((forward + ",\"x\":1}").c_str());
+  EXPECT_EQ(true, (all == parsed((reverse + ",\"x\":1}").c_str())));
+  EXPECT_EQ(true, (all != parsed((reverse + ",\"x\":2}").c_str())));
+  EXPECT_EQ(true, (all != parsed((reverse + ",\"y\":1}").c_str())));
+
+  // mutation resets the cache
+  auto v = make_shared<Value>();
+  setNumber(v, 1);
+  size_t one = hashValue(*v);
+  setNumber(v, 2);
+  EXPECT_EQ(true, (one != hashValue(*v)));
+  Context context;
+  Value reused = parsed("{\"k\":[1,2,3]}");
+  size_t before = hashValue(reused);
+  EXPECT_EQ(Status::PARSE_OK, context.parse(reused, "{\"k\":[1,2,4]}"));
+  EXPECT_EQ(true, (before != hashValue(reused)));
+  auto& k = std::get<vector<Entry>>(reused.data)[0].val;
+  std::get<vector<Value>>(k.data)[2].data = 3.0;
+  invalidateHash(std::get<vector<Value>>(k.data)[2]);
+  invalidateHash(k);
+  invalidateHash(reused);
+  EXPECT_EQ(before, hashValue(reused));
+
+  std::unordered_set<Value> unique;
+  unique.insert(a);
+  unique.insert(b);
+  unique.insert(parsed("[]"));
+  EXPECT_EQ(2, unique.size());
+
+#ifdef YJSON_STATS
+  Value big = parsed("[{\"name\":\"a long string value\",\"n\":[1,2,3]}]");
+  Value copy = big;
+  {
+    stats::Scope scope(Phase::PARSE);
+    hashValue(big);
+    EXPECT_EQ(true, (big == copy));
+  }
+  EXPECT_EQ(0, lastStats().allocations);
+#endif
+}
+
+static void testMemoryUsage() {
+  const string name(40, 'n');
+  const string key(20, 'k');
+  const string json = "{\"name\": \"" + name + "\", \"" + key +
+                      "\": [1, 2, 3, 4, 5], \"s\": [\"a\", \"b\", \"c\"]}";
+  Value v = parsed(json.c_str());
+  MemoryUsage usage = memoryUsage(v);
+  EXPECT_EQ(3 * sizeof(Entry) + 8 * sizeof(Value), usage.nodes);
+  EXPECT_EQ(name.size() + 1, usage.strings);
+  EXPECT_EQ(key.size() + 1, usage.keys);
+  EXPECT_EQ(0, usage.numbers);
+  // containers below the root are sized exactly when parsed, the root grows
+  // as its members are read (3 in 4 slots), strings as they are read
+  EXPECT_EQ(true, (usage.slack >= sizeof(Entry)));
+  EXPECT_EQ(true, (usage.slack < sizeof(Entry) + name.size() + key.size()));
+  EXPECT_EQ(usage.nodes + usage.strings + usage.keys + usage.slack,
+            usage.total());
+
+  size_t hash = hashValue(v);
+  compact(v);
+  MemoryUsage compacted = memoryUsage(v);
+  EXPECT_EQ(usage.nodes, compacted.nodes);
+  EXPECT_EQ(usage.strings, compacted.strings);
+  EXPECT_EQ(usage.keys, compacted.keys);
+  EXPECT_EQ(0, compacted.slack);
+  EXPECT_EQ(true, (v == parsed(json.c_str())));
+  EXPECT_EQ(hash, hashValue(v));
+  EXPECT_EQ(stringified(parsed(json.c_str())), stringified(v));
+
+  // a reused tree keeps the capacity of the bigger document before it
+  Context context;
+  Value reused;
+  context.parse(reused, "[[1, 2, 3, 4, 5, 6, 7, 8, 9], [1], [2]]");
+  context.parse(reused, "[[1]]");
+  // 3 of the root's 4 slots and 8 of the first element's 9
+  EXPECT_EQ(11 * sizeof(Value), memoryUsage(reused).slack);
+  compact(reused);
+  EXPECT_EQ(0, memoryUsage(reused).slack);
+  EXPECT_EQ(2 * sizeof(Value), memoryUsage(reused).total());
+
+  // packed numbers and long lazy numbers
+  context.setPackedArrays(true);
+  context.parse(reused, "[1, 2, 3]");
+  compact(reused);
+  EXPECT_EQ(3 * sizeof(double), memoryUsage(reused).numbers);
+  context.setLazyNumbers(true);
+  const string digits(40, '7');
+  context.parse(reused, digits);
+  EXPECT_EQ(digits.size() + 1, memoryUsage(reused).numbers);
+}
+
+#define TEST_PATCH(status, doc, patch, expect)               \
+  do {                                                       \
+    Value d = parsed(doc);                                   \
+    EXPECT_EQ(status, applyPatch(d, parsed(patch)));         \
+    EXPECT_EQ(string(expect), stringified(d));               \
+  } while (0)
+
+static void testPatch() {
+  Value doc = parsed("{\"a/b\":[1,{\"m~n\":true}],\"\":0}");
+  EXPECT_EQ(true, (resolvePointer(doc, "") == &doc));
+  EXPECT_EQ(0.0, std::get<double>(resolvePointer(doc, "/")->data));
+  EXPECT_EQ(Type::TRUE, resolvePointer(doc, "/a~1b/1/m~0n")->type);
+  EXPECT_EQ(true, (resolvePointer(doc, "/a~1b/01") == nullptr));
+  EXPECT_EQ(true, (resolvePointer(doc, "/a~1b/2") == nullptr));
+  EXPECT_EQ(true, (resolvePointer(doc, "/a~2b") == nullptr));
+  EXPECT_EQ(true, (resolvePointer(doc, "a") == nullptr));
+
+  // the operations of RFC 6902
+  TEST_PATCH(Status::PATCH_OK, "{\"foo\":\"bar\"}",
+             "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]",
+             "{\"foo\":\"bar\",\"baz\":\"qux\"}");
+  TEST_PATCH(Status::PATCH_OK, "{\"foo\":[\"bar\",\"baz\"]}",
+             "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+             "{\"foo\":[\"bar\",\"qux\",\"baz\"]}");
+  TEST_PATCH(Status::PATCH_OK, "[1,2]",
+             "[{\"op\":\"add\",\"path\":\"/-\",\"value\":[3]}]", "[1,2,[3]]");
+  TEST_PATCH(Status::PATCH_OK, "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+             "[{\"op\":\"remove\",\"path\":\"/baz\"}]", "{\"foo\":\"bar\"}");
+  TEST_PATCH(Status::PATCH_OK, "{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+             "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]",
+             "{\"foo\":[\"bar\",\"baz\"]}");
+  TEST_PATCH(Status::PATCH_OK, "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+             "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+             "{\"baz\":\"boo\",\"foo\":\"bar\"}");
+  TEST_PATCH(Status::PATCH_OK,
+             "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{}}",
+             "[{\"op\":\"move\",\"from\":\"/foo/waldo\","
+             "\"path\":\"/qux/thud\"}]",
+             "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"thud\":\"fred\"}}");
+  TEST_PATCH(Status::PATCH_OK, "[1,2,3,4]",
+             "[{\"op\":\"move\",\"from\":\"/1\",\"path\":\"/3\"}]",
+             "[1,3,4,2]");
+  TEST_PATCH(Status::PATCH_OK, "{\"a\":[1]}",
+             "[{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/b\"}]",
+             "{\"a\":[1],\"b\":[1]}");
+  TEST_PATCH(Status::PATCH_OK, "{\"a\":{\"x\":1,\"y\":[2]}}",
+             "[{\"op\":\"test\",\"path\":\"/a\","
+             "\"value\":{\"y\":[2],\"x\":1.0}}]",
+             "{\"a\":{\"x\":1,\"y\":[2]}}");
+  TEST_PATCH(Status::PATCH_OK, "{\"a\":1}",
+             "[{\"op\":\"replace\",\"path\":\"\",\"value\":[true]}]",
+             "[true]");
+
+  // errors roll every earlier operation back
+  const char* original = "{\"a\":[1,2,3],\"b\":{\"c\":\"d\"}}";
+  const char* steps =
+      "[{\"op\":\"add\",\"path\":\"/a/0\",\"value\":0},"
+      "{\"op\":\"remove\",\"path\":\"/b/c\"},"
+      "{\"op\":\"replace\",\"path\":\"/a/2\",\"value\":null},"
+      "{\"op\":\"move\",\"from\":\"/a/1\",\"path\":\"/b/e\"},"
+      "{\"op\":\"move\",\"from\":\"/a/0\",\"path\":\"/a\"},"
+      "{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/b/f\"},"
+      "{\"op\":\"add\",\"path\":\"/a\",\"value\":{}},";
+  const char* failures[][2] = {
+      {"{\"op\":\"test\",\"path\":\"/b/e\",\"value\":2}]", "PATCH_TEST_FAILED"},
+      {"{\"op\":\"remove\",\"path\":\"/x\"}]", "PATCH_PATH_NOT_FOUND"},
+      {"{\"op\":\"add\",\"path\":\"/a/b/c\",\"value\":1}]",
+       "PATCH_PATH_NOT_FOUND"},
+      {"{\"op\":\"add\",\"path\":\"b\",\"value\":1}]", "PATCH_INVALID_POINTER"},
+      {"{\"op\":\"move\",\"from\":\"/b\",\"path\":\"/b/g\"}]",
+       "PATCH_INVALID_OPERATION"},
+      {"{\"op\":\"move\",\"from\":\"/b/f\",\"path\":\"/a/x/y\"}]",
+       "PATCH_PATH_NOT_FOUND"},
+      {"{\"op\":\"jump\",\"path\":\"/a\"}]", "PATCH_INVALID_OPERATION"},
+      {"{\"op\":\"add\",\"path\":\"/a\"}]", "PATCH_INVALID_OPERATION"},
+  };
+  for (auto& failure : failures) {
+    Value d = parsed(original);
+    size_t hash = hashValue(d);
+    Status status = applyPatch(d, parsed((string(steps) + failure[0]).c_str()));
+    EXPECT_EQ(string(failure[1]), StatusStr[castEnum(status)]);
+    EXPECT_EQ(string(original), stringified(d));
+    EXPECT_EQ(hash, hashValue(d));
+  }
+  Value d = parsed(original);
+  hashValue(d);
+  EXPECT_EQ(Status::PATCH_OK,
+            applyPatch(d, parsed((string(steps) +
+                                  "{\"op\":\"test\",\"path\":\"/b/e\","
+                                  "\"value\":1}]")
+                                     .c_str())));
+  Value expect = parsed("{\"a\":{},\"b\":{\"e\":1,\"f\":0}}");
+  EXPECT_EQ(stringified(expect), stringified(d));
+  EXPECT_EQ(hashValue(expect), hashValue(d));  // caches were reset
+}
+
+static void testMergePatch() {
+  const char* cases[][3] = {
+      {"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+      {"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+      {"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+      {"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+      {"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+      {"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+      {"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}",
+       "{\"a\":{\"b\":\"d\"}}"},
+      {"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+      {"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+      {"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+      {"{\"a\":\"foo\"}", "null", "null"},
+      {"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+      {"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+      {"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+  };
+  for (auto& c : cases) {
+    Value d = parsed(c[0]);
+    hashValue(d);
+    EXPECT_EQ(Status::PATCH_OK, applyMergePatch(d, parsed(c[1])));
+    EXPECT_EQ(string(c[2]), stringified(d));
+    EXPECT_EQ(hashValue(parsed(c[2])), hashValue(d));
+  }
+}
+
+static void testDiff() {
+  const char* pairs[][3] = {
+      {"{\"a\":1,\"b\":[1,2,3,4],\"c\":{\"d\":true}}",
+       "{\"a\":1,\"b\":[1,2,9,3,4],\"c\":{\"d\":true}}", "1"},
+      {"[1,2,3,4,5]", "[1,5]", "3"},
+      {"{\"a\":{\"x\":[1,{\"y\":2}]},\"b\":0}",
+       "{\"b\":0,\"a\":{\"x\":[1,{\"y\":3}]}}", "1"},
+      {"{\"a/b\":1,\"~\":2}", "{\"~\":2,\"c\":3}", "2"},
+      {"[1,[2,3],4]", "{\"x\":null}", "1"},
+      {"[]", "[1,2]", "2"},
+      {"[\"a\",\"b\",\"c\"]", "[\"x\",\"b\",\"y\"]", "2"},
+      {"null", "null", "0"},
+  };
+  for (auto& p : pairs) {
+    Value from = parsed(p[0]);
+    Value to = parsed(p[1]);
+    Value patch = diff(from, to);
+    EXPECT_EQ(std::stoul(p[2]), std::get<vector<Value>>(patch.data).size());
+    EXPECT_EQ(Status::PATCH_OK, applyPatch(from, patch));
+    EXPECT_EQ(true, (from == to));
+  }
+  auto patch = diff(make_shared<Value>(parsed("{\"a/b\":1}")),
+                    make_shared<Value>(parsed("{\"a/b\":2}")));
+  EXPECT_EQ(string("[{\"op\":\"replace\",\"path\":\"/a~1b\",\"value\":2}]"),
+            stringified(*patch));
+}
+
+static string stringified(const PNodePtr& n) {
+  string out;
+  stringifyValue(*n, out);
+  return out;
+}
+
+static void testPersistent() {
+  const char* json = "{\"a\":[1,{\"b\":\"x\"}],\"c\":{\"d\":true},\"e\":null}";
+  PNodePtr v1 = freeze(parsed(json));
+  EXPECT_EQ(string(json), stringified(v1));
+  Value back;
+  thaw(v1, back);
+  EXPECT_EQ(true, (back == parsed(json)));
+  EXPECT_EQ(Type::OBJECT, getType(v1));
+  EXPECT_EQ(3, getObjectSize(v1));
+  EXPECT_EQ("a", getObjectKey(v1, 0));
+  EXPECT_EQ(1.0, getNumber(getArrayElement(getObjectValue(v1, 0), 0)));
+  EXPECT_EQ("x", getString(findPointer(v1, "/a/1/b")));
+  EXPECT_EQ(true, getBoolean(findPointer(v1, "/c/d")));
+  EXPECT_EQ(true, (findPointer(v1, "/a/2") == nullptr));
+
+  // only the path to the change is copied
+  PNodePtr v2 = v1;
+  EXPECT_EQ(Status::PATCH_OK, setIn(v2, "/a/1/b", makeString("y")));
+  EXPECT_EQ(string(json), stringified(v1));
+  EXPECT_EQ("y", getString(findPointer(v2, "/a/1/b")));
+  EXPECT_EQ(true, (v1 != v2));
+  EXPECT_EQ(true, (findPointer(v1, "/a") != findPointer(v2, "/a")));
+  EXPECT_EQ(true, (findPointer(v1, "/a/0") == findPointer(v2, "/a/0")));
+  EXPECT_EQ(true, (findPointer(v1, "/c") == findPointer(v2, "/c")));
+
+  PNodePtr v3 = v2;
+  EXPECT_EQ(Status::PATCH_OK, setIn(v3, "/a/-", makeNumber(2)));
+  EXPECT_EQ(Status::PATCH_OK, setIn(v3, "/f", makeNumber(3)));
+  EXPECT_EQ(Status::PATCH_OK, removeIn(v3, "/c"));
+  EXPECT_EQ(Status::PATCH_OK, removeIn(v3, "/a/0"));
+  EXPECT_EQ(string("{\"a\":[{\"b\":\"y\"},2],\"e\":null,\"f\":3}"),
+            stringified(v3));
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, setIn(v3, "/x/y", makeNumber(1)));
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, removeIn(v3, "/a/5"));
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, removeIn(v3, "/a/-"));
+  EXPECT_EQ(Status::PATCH_INVALID_POINTER, removeIn(v3, "a"));
+  EXPECT_EQ(string("{\"a\":[{\"b\":\"y\"},2],\"e\":null,\"f\":3}"),
+            stringified(v3));
+  EXPECT_EQ(Status::PATCH_OK, setIn(v3, "", makeNumber(4)));
+  EXPECT_EQ(string("4"), stringified(v3));
+
+  // readers always see a complete version while a writer publishes
+  SharedDocument doc(freeze(parsed("{\"n\":0,\"copy\":0}")));
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+  vector<std::thread> readers;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        PNodePtr snapshot = doc.load();
+        if (getNumber(findPointer(snapshot, "/n")) !=
+            getNumber(findPointer(snapshot, "/copy"))) {
+          torn++;
+        }
+      }
+    });
+  }
+  for (int i = 1; i <= 2000; i++) {
+    doc.update([&](PNodePtr& next) {
+      setIn(next, "/n", makeNumber(i));
+      return setIn(next, "/copy", makeNumber(i));
+    });
+  }
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(0, torn.load());
+  EXPECT_EQ(2000.0, getNumber(findPointer(doc.load(), "/n")));
+  EXPECT_EQ(Status::PATCH_PATH_NOT_FOUND, doc.update([](PNodePtr& next) {
+    return removeIn(next, "/missing");
+  }));
+  EXPECT_EQ(2000.0, getNumber(findPointer(doc.load(), "/copy")));
+}
+
+static void testSchema() {
+  Schema schema;
+  EXPECT_EQ(Status::SCHEMA_OK, schema.compile(R"({
+    "title": "order",
+    "type": "object",
+    "required": ["id", "items", "ref"],
+    "properties": {
+      "id": {"type": "integer", "minimum": 1},
+      "status": {"enum": ["open", "closed", null]},
+      "email": {"type": "string", "pattern": "^[^@]+@[^@]+$"},
+      "note": {"type": ["string", "null"], "minLength": 2, "maxLength": 3},
+      "items": {
+        "type": "array",
+        "items": {
+          "type": "object",
+          "required": ["sku"],
+          "properties": {"qty": {"type": "number", "maximum": 10}}
+        }
+      },
+      "meta": true,
+      "never": false
+    }
+  })"));
+  auto check = [&](const char* json) { return schema.validate(json); };
+  EXPECT_EQ(Status::SCHEMA_OK, check(R"({"id": 7, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_OK,
+            check(R"({"ref": {}, "status": null, "email": "a@b", "id": 1,
+                      "note": "été", "meta": [{"any": 1}],
+                      "items": [{"sku": "x", "qty": 2.5}, {"sku": 1}]})"));
+  EXPECT_EQ(Status::SCHEMA_TYPE_MISMATCH, check("[]"));
+  EXPECT_EQ(Status::SCHEMA_TYPE_MISMATCH,
+            check(R"({"id": 1.5, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_TYPE_MISMATCH,
+            check(R"({"id": 1, "ref": 0, "items": [1]})"));
+  EXPECT_EQ(Status::SCHEMA_TYPE_MISMATCH,
+            check(R"({"id": 1, "ref": 0, "items": [], "never": 0})"));
+  EXPECT_EQ(Status::SCHEMA_REQUIRED_MISSING, check(R"({"id": 1, "ref": 0})"));
+  // a duplicate key does not count twice
+  EXPECT_EQ(Status::SCHEMA_REQUIRED_MISSING,
+            check(R"({"id": 1, "id": 2, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_REQUIRED_MISSING,
+            check(R"({"id": 1, "ref": 0, "items": [{"qty": 1}]})"));
+  EXPECT_EQ(Status::SCHEMA_ENUM_MISMATCH,
+            check(R"({"status": "lost", "id": 1, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_ENUM_MISMATCH,
+            check(R"({"status": [], "id": 1, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_OUT_OF_RANGE,
+            check(R"({"id": 0, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_OUT_OF_RANGE,
+            check(R"({"id": 1, "ref": 0, "items": [{"sku": 1, "qty": 11}]})"));
+  // lengths are in code points, not bytes
+  EXPECT_EQ(Status::SCHEMA_OUT_OF_RANGE,
+            check(R"({"note": "é", "id": 1, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_OUT_OF_RANGE,
+            check(R"({"note": "abcd", "id": 1, "ref": 0, "items": []})"));
+  EXPECT_EQ(Status::SCHEMA_PATTERN_MISMATCH,
+            check(R"({"email": "a@b@c", "id": 1, "ref": 0, "items": []})"));
+  // syntax errors win over anything left unchecked
+  EXPECT_EQ(Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+            check(R"({"id": 1 "ref": 0, "items": []})"));
+
+  // validation stops at the first violation
+  Context context;
+  const char* json = R"({"id": 1, "ref": 0, "items": [{"sku": 1, "qty": 99}]})";
+  EXPECT_EQ(Status::SCHEMA_OUT_OF_RANGE, schema.validate(context, json));
+  EXPECT_EQ(size_t(strstr(json, "99") + 2 - json), context.position());
+
+  // schemas parsed with packed arrays compile the same
+  Value packed;
+  Context packing;
+  packing.setPackedArrays(true);
+  EXPECT_EQ(Status::PARSE_OK, packing.parse(packed, R"({"enum": [1, 2, 3]})"));
+  EXPECT_EQ(Status::SCHEMA_OK, schema.compile(packed));
+  EXPECT_EQ(Status::SCHEMA_OK, schema.validate("2"));
+  EXPECT_EQ(Status::SCHEMA_ENUM_MISMATCH, schema.validate("4"));
+  EXPECT_EQ(Status::PARSE_OK, packing.parse(packed, R"({"type": [1]})"));
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile(packed));
+
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile("{\"type\": \"date\"}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile("{\"minLength\": -1}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile("{\"pattern\": \"(\"}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile("{\"enum\": [[1]]}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID,
+            schema.compile("{\"items\": {\"additionalItems\": false}}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID, schema.compile("[]"));
+  // a failed compile leaves a schema that accepts anything
+  EXPECT_EQ(Status::SCHEMA_OK, schema.validate("[1]"));
+}
+
+static void testSchemaPattern() {
+  // pattern and string as JSON text, so backslashes are doubled
+  auto search = [](const string& pattern, const string& s) {
+    Schema schema;
+    EXPECT_EQ(Status::SCHEMA_OK,
+              schema.compile("{\"pattern\": \"" + pattern + "\"}"));
+    return schema.validate("\"" + s + "\"") == Status::SCHEMA_OK;
+  };
+  EXPECT_EQ(true, search("b", "abc"));
+  EXPECT_EQ(false, search("^b", "abc"));
+  EXPECT_EQ(true, search("c$", "abc"));
+  EXPECT_EQ(true, search("^(ab|cd)+$", "abcdab"));
+  EXPECT_EQ(false, search("^(ab|cd)+$", "abca"));
+  EXPECT_EQ(true, search("^(?:a|b)*?c{2,3}$", "abbccc"));
+  EXPECT_EQ(false, search("^c{2,3}$", "cccc"));
+  EXPECT_EQ(true, search("^x{2,}y?$", "xxxxx"));
+  EXPECT_EQ(true, search(R"(^\\d{3}-[A-Z_a-z]\\w*\\s?$)", "123-abc_9 "));
+  EXPECT_EQ(false, search(R"(^\\d{3}$)", "12a"));
+  EXPECT_EQ(true, search(R"(^[^\\d\\s]+$)", "abc"));
+  EXPECT_EQ(false, search(R"(^[^\\d\\s]+$)", "a c"));
+  EXPECT_EQ(true, search(R"(^[\\-.a]+$)", "-.a"));
+  EXPECT_EQ(false, search("^[.]$", "b"));
+  EXPECT_EQ(true, search(R"(\\bcat\\b)", "a cat."));
+  EXPECT_EQ(false, search(R"(\\bcat\\b)", "concat"));
+  EXPECT_EQ(true, search(R"(\\Bcat)", "concat"));
+  EXPECT_EQ(true, search(R"(^\\u00e9\\x41\\.\\/$)", "éA./"));
+  // code points, not bytes
+  EXPECT_EQ(true, search("^.$", "é"));
+  EXPECT_EQ(true, search("^[à-ÿ]{2}$", "éê"));
+  EXPECT_EQ(true, search(R"(^\\uD83D\\uDE00$)", "\U0001F600"));
+  EXPECT_EQ(false, search("^.$", "\\n"));
+  EXPECT_EQ(true, search("^()*a(b*)*$", "abbb"));
+
+  // no recursion and no backtracking, whatever the length of the string
+  string as(100000, 'a');
+  EXPECT_EQ(true, search("^a*$", as));
+  EXPECT_EQ(true, search("^(a|aa)*$", as));
+  EXPECT_EQ(false, search("^(a*)*b$", as));
+  EXPECT_EQ(true, search("^[a-z]{1,}$", as));
+
+  // backreferences and lookahead need backtracking
+  Schema schema;
+  for (const char* pattern :
+       {"(", "a)", "[a", "*a", "a{2,1}", "a{1001}", "a{", "(a)\\\\1",
+        "(?=a)", "(?!a)", "(?<n>a)", "\\\\k", "\\\\q", "^*", "[b-a]",
+        "[\\\\d-z]", "\\\\", "\\\\x4"}) {
+    EXPECT_EQ(Status::SCHEMA_INVALID,
+              schema.compile("{\"pattern\": \"" + string(pattern) + "\"}"));
+  }
+  EXPECT_EQ(Status::SCHEMA_OK,
+            schema.compile("{\"pattern\": \"" + string(60, '(') + "a" +
+                           string(60, ')') + "\"}"));
+  // groups nested too deep, a program too large
+  EXPECT_EQ(Status::SCHEMA_INVALID,
+            schema.compile("{\"pattern\": \"" + string(100, '(') + "a" +
+                           string(100, ')') + "\"}"));
+  EXPECT_EQ(Status::SCHEMA_INVALID,
+            schema.compile(R"({"pattern": "((a{1000}){1000}){2}"})"));
+}
+
+static void testTape() {
+  const char* json =
+      "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\","
+      "\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}";
+  auto v = make_shared<Value>();
+  Tape tape;
+  EXPECT_EQ(Status::PARSE_OK, parseTape(tape, json));
+  auto root = tape.root();
+  EXPECT_EQ(Type::OBJECT, getType(root));
+  EXPECT_EQ(7, getObjectSize(root));
+  EXPECT_EQ("n", getObjectKey(root, 0));
+  EXPECT_EQ(Type::NVLL, getType(getObjectValue(root, 0)));
+  EXPECT_EQ(false, getBoolean(getObjectValue(root, 1)));
+  EXPECT_EQ(true, getBoolean(getObjectValue(root, 2)));
+  EXPECT_EQ(123.0, getNumber(getObjectValue(root, 3)));
+  EXPECT_EQ("abc", getString(getObjectValue(root, 4)));
+  EXPECT_EQ(3, getStringLength(getObjectValue(root, 4)));
+  auto a = getObjectValue(root, 5);
+  EXPECT_EQ(Type::ARRAY, getType(a));
+  EXPECT_EQ(3, getArraySize(a));
+  EXPECT_EQ(3.0, getNumber(getArrayElement(a, 2)));
+  auto o = getObjectValue(root, 6);
+  EXPECT_EQ("3", getObjectKey(o, 2));
+  EXPECT_EQ(1, getObjectKeyLength(o, 2));
+  EXPECT_EQ(3.0, getNumber(getObjectValue(o, 2)));
+  // skipping a subtree lands on its next sibling
+  EXPECT_EQ(o.index, a.sibling().sibling().index);
+
+  // round trip through Value
+  auto res = make_shared<string>();
+  fromTape(root, v);
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(v, res));
+  EXPECT_EQ(json, (*res));
+  EXPECT_EQ(Status::TAPE_OK, toTape(v, tape));
+  EXPECT_EQ(7, getObjectSize(tape.root()));
+
+  // a tape past its word limit fails instead of truncating end indices
+  size_t words = tape.words.size();
+  EXPECT_EQ(Status::TAPE_OK, toTape(v, tape, words));
+  EXPECT_EQ(Status::TAPE_TOO_LARGE, toTape(v, tape, words - 1));
+  EXPECT_EQ(0, tape.words.size());
+  EXPECT_EQ(Status::TAPE_TOO_LARGE,
+            toTape(make_shared<Value>(parsed("[[1,2],3]")), tape, 5));
+
+  EXPECT_EQ(Status::PARSE_MISS_COLON, parseTape(tape, "{\"a\"}"));
+  EXPECT_EQ(0, tape.words.size());
+}
+
+#define STATIC_JSON                                                   \
+  R"( {"name": "yjson", "ok": [true, false, null], "empty": {},)"     \
+  R"( "num": [0, -0, 0.1, 3.141592653589793, -1.5E+3, 1e-320,)"       \
+  R"( 1.7976931348623157e308, 2.2250738585072011e-308, 1e-400,)"      \
+  R"( 12345678901234567890123456789e-29],)"                           \
+  R"( "str": "a\"\\\/\b\f\n\r\té€𝄞", "": ""} )"
+
+static void testStatic() {
+  static constexpr auto doc = YJSON_STATIC(STATIC_JSON);
+  constexpr auto root = doc.root();
+  EXPECT_EQ(Type::OBJECT, getType(root));
+  EXPECT_EQ(6, getObjectSize(root));
+  EXPECT_EQ("yjson", getString(getObjectValue(root, 0)));
+  auto ok = getObjectValue(root, 1);
+  EXPECT_EQ(true, getBoolean(getArrayElement(ok, 0)));
+  EXPECT_EQ(Type::NVLL, getType(getArrayElement(ok, 2)));
+  EXPECT_EQ(0, getObjectSize(getObjectValue(root, 2)));
+  auto num = getObjectValue(root, 3);
+  EXPECT_EQ(10, getArraySize(num));
+  EXPECT_EQ(0.1, getNumber(getArrayElement(num, 2)));
+  EXPECT_EQ(-1500.0, getNumber(getArrayElement(num, 4)));
+  EXPECT_EQ("a\"\\/\b\f\n\r\t\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E",
+            getString(getObjectValue(root, 4)));
+  EXPECT_EQ("", getObjectKey(root, 5));
+
+  // the very same tape as parsing at run time, numbers bit for bit
+  Tape tape;
+  EXPECT_EQ(Status::PARSE_OK, parseTape(tape, STATIC_JSON));
+  EXPECT_EQ(tape.words.size(), std::size(doc.words));
+  EXPECT_EQ(true, std::equal(tape.words.begin(), tape.words.end(), doc.words));
+  EXPECT_EQ(string(tape.strings.data(), tape.strings.size()),
+            string(doc.strings, std::size(doc.strings) - 1));
+
+  static constexpr auto scalar = YJSON_STATIC(" -2.5e-3 ");
+  EXPECT_EQ(-0.0025, getNumber(scalar.root()));
+  static constexpr auto truncated = YJSON_STATIC(R"(["ab\u0000cd", 1])");
+  EXPECT_EQ("ab", getString(getArrayElement(truncated.root(), 0)));
+}
+#undef STATIC_JSON
+
+static void testSnapshot() {
+  const char* path = "yjson_test_snapshot.bin";
+  auto v = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK,
+            parse(v, "{\"id\":7,\"tags\":[\"a\",\"bc\"],\"ok\":true}"));
+  EXPECT_EQ(Status::SNAPSHOT_OK, writeSnapshot(v, path));
+  {
+    Snapshot snapshot;
+    EXPECT_EQ(Status::SNAPSHOT_OK, snapshot.open(path));
+    auto root = snapshot.root();
+    EXPECT_EQ(Type::OBJECT, getType(root));
+    EXPECT_EQ(3, getObjectSize(root));
+    EXPECT_EQ(7.0, getNumber(getObjectValue(root, 0)));
+    EXPECT_EQ("bc", getString(getArrayElement(getObjectValue(root, 1), 1)));
+    EXPECT_EQ(true, getBoolean(getObjectValue(root, 2)));
+    Snapshot moved(std::move(snapshot));
+    EXPECT_EQ(false, snapshot.isOpen());
+    EXPECT_EQ("tags", getObjectKey(moved.root(), 1));
+  }
+  // corrupt tapes: an end index, a string offset, a string length that
+  // overflows the size check, a value where a key belongs
+  Tape tape;
+  toTape(v, tape);
+  auto corrupt = [&](size_t word, std::uint64_t bits, std::uint64_t strings,
+                     Verify verify) {
+    SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.byteOrder = kSnapshotByteOrder;
+    header.wordCount = tape.words.size();
+    header.stringBytes = strings;
+    vector<std::uint64_t> words = tape.words;
+    words[word] = bits;
+    FILE* out = fopen(path, "wb");
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(words.data(), sizeof(std::uint64_t), words.size(), out);
+    fwrite(tape.strings.data(), 1, tape.strings.size(), out);
+    fclose(out);
+    Snapshot bad;
+    return bad.open(path, verify);
+  };
+  size_t n = tape.strings.size();
+  const Verify full = Verify::FULL;
+  const Verify header = Verify::HEADER;
+  EXPECT_EQ(Status::SNAPSHOT_OK, corrupt(0, tape.words[0], n, full));
+  EXPECT_EQ(Status::SNAPSHOT_OK, corrupt(0, tape.words[0], n, header));
+  // the sizes and the root are checked either way
+  for (Verify verify : {full, header}) {
+    EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+              corrupt(0, tape::makeWord('{', (3ULL << 32) | 1000), n, verify));
+    EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+              corrupt(0, tape.words[0], n - 64, verify));
+    EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+              corrupt(tape.words.size() - 1, tape::makeWord('}', 1), n,
+                      verify));
+  }
+  // the words inside only by a full check
+  EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+            corrupt(1, tape::makeWord('s', n), n, full));
+  EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+            corrupt(2, std::uint64_t(1) << 40, n, full));
+  EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT,
+            corrupt(1, tape::makeWord('t', 0), n, full));
+  EXPECT_EQ(Status::SNAPSHOT_OK, corrupt(1, tape::makeWord('t', 0), n, header));
+
+  FILE* fp = fopen(path, "wb");
+  fputs("not a snapshot, just some text", fp);
+  fclose(fp);
+  Snapshot snapshot;
+  EXPECT_EQ(Status::SNAPSHOT_INVALID_FORMAT, snapshot.open(path));
+  EXPECT_EQ(false, snapshot.isOpen());
+  remove(path);
+  EXPECT_EQ(Status::SNAPSHOT_IO_ERROR, snapshot.open(path));
+}
+
+static void testDocumentCache() {
+  const char* path = "yjson_test_cache.json";
+  const char* missing = "yjson_test_cache_missing.json";
+  auto write = [](const char* file, const char* text) {
+    FILE* fp = fopen(file, "wb");
+    fputs(text, fp);
+    fclose(fp);
+  };
+  write(path, "{\"rps\": 100}");
+  remove(missing);
+  {
+    // an hour: only refresh() reloads
+    DocumentCache cache(std::chrono::hours(1));
+    DocumentPtr first;
+    EXPECT_EQ(Status::PARSE_OK, cache.get(path, first));
+    EXPECT_EQ(string("{\"rps\":100}"), stringified(*first));
+    DocumentPtr again;
+    EXPECT_EQ(Status::PARSE_OK, cache.get(path, again));
+    EXPECT_EQ(true, (first == again));
+    cache.refresh();
+    cache.get(path, again);
+    EXPECT_EQ(true, (first == again));
+
+    // a new version is published, readers keep the one they hold
+    write(path, "{\"rps\": 2500}");
+    cache.refresh();
+    DocumentPtr second;
+    EXPECT_EQ(Status::PARSE_OK, cache.get(path, second));
+    EXPECT_EQ(string("{\"rps\":2500}"), stringified(*second));
+    EXPECT_EQ(string("{\"rps\":100}"), stringified(*first));
+
+    // a broken version keeps the last good tree
+    write(path, "{\"rps\": ");
+    cache.refresh();
+    DocumentPtr third;
+    EXPECT_EQ(Status::PARSE_OK, cache.get(path, third));
+    EXPECT_EQ(true, (second == third));
+    // replaced by rename, as deploys do
+    write("yjson_test_cache.tmp", "[1, 2, 3]");
+    rename("yjson_test_cache.tmp", path);
+    cache.refresh();
+    EXPECT_EQ(Status::PARSE_OK, cache.get(path, third));
+    EXPECT_EQ(3, getArraySize(std::make_shared<Value>(*third)));
+
+    DocumentStats stats = cache.stats(path);
+    EXPECT_EQ(1, stats.misses);
+    EXPECT_EQ(5, stats.hits);
+    EXPECT_EQ(0, stats.errors);
+    EXPECT_EQ(2, stats.reloads);
+    EXPECT_EQ(1, stats.failures);
+    EXPECT_EQ(Status::PARSE_OK, stats.lastStatus);
+    EXPECT_EQ(true, (stats.lastReloadNs > 0));
+    EXPECT_EQ(true, (stats.maxReloadNs >= stats.lastReloadNs));
+    EXPECT_EQ(0, cache.stats(missing).misses);
+
+    // a file that appears later
+    DocumentPtr none;
+    EXPECT_EQ(Status::CACHE_IO_ERROR, cache.get(missing, none));
+    EXPECT_EQ(true, (none == nullptr));
+    write(missing, "[");
+    cache.refresh();
+    EXPECT_EQ(Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+              cache.get(missing, none));
+    write(missing, "[true]");
+    cache.refresh();
+    EXPECT_EQ(Status::PARSE_OK, cache.get(missing, none));
+    EXPECT_EQ(Type::ARRAY, none->type);
+    // an error answered from the cache is not a hit
+    stats = cache.stats(missing);
+    EXPECT_EQ(1, stats.misses);
+    EXPECT_EQ(1, stats.errors);
+    EXPECT_EQ(1, stats.hits);
+  }
+  {
+    // the background thread
+    DocumentCache cache(std::chrono::milliseconds(5));
+    DocumentPtr doc;
+    cache.get(path, doc);
+    write(path, "\"reloaded\"");
+    for (int i = 0; i < 400 && doc->type != Type::STRING; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      cache.get(path, doc);
+    }
+    EXPECT_EQ(Type::STRING, doc->type);
+    EXPECT_EQ(1, cache.stats(path).reloads);
+  }
+  remove(path);
+  remove(missing);
+}
+
+static void testStats() {
+#ifdef YJSON_STATS
+  size_t hookCalls = 0;
+  setStatsHook([&hookCalls](const Stats&) { hookCalls++; });
+  auto v = make_shared<Value>();
+  EXPECT_EQ(Status::PARSE_OK, parse(v, "{\"a\":[1,2,[true]],\"b\":\"x\"}"));
+  const Stats& ps = lastStats();
+  EXPECT_EQ(true, (Phase::PARSE == ps.phase));
+  EXPECT_EQ(3, ps.maxDepth);
+  EXPECT_EQ(2, ps.nodes[castEnum(Type::NUMBER)]);
+  EXPECT_EQ(1, ps.nodes[castEnum(Type::TRUE)]);
+  EXPECT_EQ(1, ps.nodes[castEnum(Type::STRING)]);
+  EXPECT_EQ(2, ps.nodes[castEnum(Type::ARRAY)]);
+  EXPECT_EQ(1, ps.nodes[castEnum(Type::OBJECT)]);
+  EXPECT_EQ(true, (ps.allocations > 0));
+  EXPECT_EQ(true, (ps.allocatedBytes > 0));
+  auto res = make_shared<string>();
+  EXPECT_EQ(Status::STRINGIFY_OK, stringify(v, res));
+  EXPECT_EQ(true, (Phase::STRINGIFY == lastStats().phase));
+  EXPECT_EQ(3, lastStats().maxDepth);
+  EXPECT_EQ(2, lastStats().nodes[castEnum(Type::NUMBER)]);
+  EXPECT_EQ(2, hookCalls);
+  setStatsHook(nullptr);
+#endif
+}
+
 static void testParse() {
   testParseNull();
   testParseTrue();
@@ -422,6 +2002,7 @@ static void testParse() {
   testParseMissingQuotationMark();
   testParseInvalidStringEscape();
   testParseInvalidStringChar();
+  testParseInvalidUtf8();
   testParseInvalidUnicodeHex();
   testParseInvalidUnicodeSurrogate();
   testParseMissCommaOrSquareBracket();
@@ -429,12 +2010,36 @@ static void testParse() {
   testParseMissKey();
   testParseMissColon();
   testParseMissCommaOrCurlyBracket();
+  testParseDepthExceeded();
 
   testAccessNull();
   testAccessBoolean();
   testAccessNumber();
   testAccessString();
   testStringify();
+  testContext();
+  testLazyNumbers();
+  testPackedArrays();
+  testRenderCache();
+  testSourceDocument();
+  testWriter();
+  testSax();
+  testValidate();
+  testParseParallel();
+  testStringifyParallel();
+  testHash();
+  testMemoryUsage();
+  testPatch();
+  testMergePatch();
+  testDiff();
+  testPersistent();
+  testSchema();
+  testSchemaPattern();
+  testTape();
+  testStatic();
+  testSnapshot();
+  testDocumentCache();
+  testStats();
 }
 
 int main() {
@@ -1,7 +1,18 @@
 #include "yjson.h"
+#include "yjson_stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 
 namespace yph {
 /* TOOL */
+// yjson.cpp is past the compiler's inline budget for one translation unit,
+// small helpers of the parse loop would otherwise stay calls
+#define YJSON_FORCE_INLINE inline __attribute__((always_inline))
+
 inline bool isDigit09(char c) { return c >= '0' && c <= '9'; }
 inline bool isDigit19(char c) { return c >= '1' && c <= '9'; }
 
@@ -31,7 +42,30 @@ string StatusStr[] = {
     "PARSE_MISS_KEY",
     "PARSE_MISS_COLON",
     "PARSE_MISS_COMMA_OR_CURLY_BRACKET",
+    "PARSE_DEPTH_EXCEEDED",
+    "PARSE_INVALID_UTF8",
     "STRINGIFY_OK",
+    "STRINGIFY_IO_ERROR",
+    "STRINGIFY_INVALID_CALL",
+    "TAPE_OK",
+    "TAPE_TOO_LARGE",
+    "SNAPSHOT_OK",
+    "SNAPSHOT_IO_ERROR",
+    "SNAPSHOT_INVALID_FORMAT",
+    "SNAPSHOT_VERSION_MISMATCH",
+    "PATCH_OK",
+    "PATCH_INVALID_OPERATION",
+    "PATCH_INVALID_POINTER",
+    "PATCH_PATH_NOT_FOUND",
+    "PATCH_TEST_FAILED",
+    "SCHEMA_OK",
+    "SCHEMA_INVALID",
+    "SCHEMA_TYPE_MISMATCH",
+    "SCHEMA_REQUIRED_MISSING",
+    "SCHEMA_ENUM_MISMATCH",
+    "SCHEMA_OUT_OF_RANGE",
+    "SCHEMA_PATTERN_MISMATCH",
+    "CACHE_IO_ERROR",
 };
 
 std::ostream& operator<<(std::ostream& os, Status s) {
@@ -63,329 +97,890 @@ std::pair<bool, unsigned int> parseHex4(StringPtr s, size_t& pos) {
   return std::make_pair(false, u);
 }
 
-void encodeUtf8(ValuePtr v, unsigned int u) {
+static void appendUtf8(string& out, unsigned int u) {
   if (u <= 0x7F) {
-    // std::get return a reference
-    std::get<string>(v->data) += static_cast<char>(u & 0xFF);
+    out += static_cast<char>(u & 0xFF);
   } else if (u <= 0x7FF) {
-    std::get<string>(v->data) += static_cast<char>(0xC0 | ((u >> 6) & 0xFF));
-    std::get<string>(v->data) += static_cast<char>(0x80 | (u & 0x3F));
+    out += static_cast<char>(0xC0 | ((u >> 6) & 0xFF));
+    out += static_cast<char>(0x80 | (u & 0x3F));
   } else if (u <= 0xFFFF) {
-    std::get<string>(v->data) += static_cast<char>(0xE0 | ((u >> 12) & 0xFF));
-
-    std::get<string>(v->data) += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
-    std::get<string>(v->data) += static_cast<char>(0x80 | (u & 0x3F));
+    out += static_cast<char>(0xE0 | ((u >> 12) & 0xFF));
+    out += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (u & 0x3F));
   } else {
     assert(u <= 0x10FFFF);
-    std::get<string>(v->data) += static_cast<char>(0xF0 | ((u >> 18) & 0xFF));
-    std::get<string>(v->data) += static_cast<char>(0x80 | ((u >> 12) & 0x3F));
-
-    std::get<string>(v->data) += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
-    std::get<string>(v->data) += static_cast<char>(0x80 | (u & 0x3F));
+    out += static_cast<char>(0xF0 | ((u >> 18) & 0xFF));
+    out += static_cast<char>(0x80 | ((u >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (u & 0x3F));
   }
 }
 
-/*YJSON PARSER*/
-void parseWhitespace(StringPtr s) noexcept {
-  auto it = s->begin();
-  for (; it < s->end(); ++it) {
-    if ((*it) != ' ' && (*it) != '\t' && (*it) != '\n' && (*it) != '\r') {
+void encodeUtf8(StringPtr s, unsigned int u) { appendUtf8(*s, u); }
+
+/*YJSON CONTEXT*/
+// exact powers of ten, see readNumber
+static const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// bytes of a word that are '"', '\\', below 0x20 or not ASCII, see "Bit
+// Twiddling Hacks"
+static inline std::uint64_t specialBytes(std::uint64_t w) {
+  constexpr std::uint64_t ones = 0x0101010101010101ULL;
+  constexpr std::uint64_t highs = 0x8080808080808080ULL;
+  auto quote = w ^ (ones * '\"');
+  auto backslash = w ^ (ones * '\\');
+  return ((quote - ones) & ~quote & highs) |
+         ((backslash - ones) & ~backslash & highs) |
+         ((w - ones * 0x20) & ~w & highs) | (w & highs);
+}
+
+// skip ASCII characters that can be copied verbatim into a string, eight
+// at a time
+static inline const char* skipPlain(const char* p, const char* end) {
+  for (; end - p >= 8; p += 8) {
+    std::uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    if (auto special = specialBytes(w); special != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      // the lowest flag is exact, borrows only reach the bytes above it
+      return p + __builtin_ctzll(special) / 8;
+#else
       break;
+#endif
     }
   }
-  s->erase(s->begin(), it);
-  return;
+  while (p < end && *p != '\"' && *p != '\\' &&
+         static_cast<unsigned char>(*p) - 0x20u < 0x60u) {
+    p++;
+  }
+  return p;
 }
 
-inline Status parseNull(StringPtr s, ValuePtr v) {
-  return parseLiteral<Type::NVLL>(s, v, "null");
+static bool readHex4(const char* p, const char* end, unsigned int& u) {
+  if (end - p < 4) {
+    return false;
+  }
+  u = 0;
+  for (int i = 0; i < 4; i++) {
+    auto ch = p[i];
+    u <<= 4;
+    if (ch >= '0' && ch <= '9') {
+      u += (ch - '0');
+    } else if (ch >= 'A' && ch <= 'F') {
+      u += (ch - 'A' + 10);
+    } else if (ch >= 'a' && ch <= 'f') {
+      u += (ch - 'a' + 10);
+    } else {
+      return false;
+    }
+  }
+  return true;
 }
 
-inline Status parseTrue(StringPtr s, ValuePtr v) {
-  return parseLiteral<Type::TRUE>(s, v, "true");
+Status Context::parse(Value& v, std::string_view json) {
+  YJSON_STATS_SCOPE(Phase::PARSE);
+  begin = cur = json.data();
+  end = begin + json.size();
+  skipWhitespace();
+  Status status = Status::PARSE_EXPECT_VALUE;
+  if (cur != end) {
+    status = readValue(v);
+    if (status == Status::PARSE_OK) {
+      skipWhitespace();
+      if (cur != end) {
+        status = Status::PARSE_ROOT_NOT_SINGULAR;
+      }
+    }
+  }
+  if (status != Status::PARSE_OK) {
+    v.data = nullptr;
+    v.type = Type::NVLL;
+    invalidateHash(v);
+  }
+  return status;
 }
 
-inline Status parseFalse(StringPtr s, ValuePtr v) {
-  return parseLiteral<Type::FALSE>(s, v, "false");
+Status Context::parse(ValuePtr v, std::string_view json) {
+  if (!v) {
+    return Status::PARSE_NULL_POINTER;
+  }
+  return parse(*v, json);
 }
 
-Status parseNumber(StringPtr s, ValuePtr v) {
-  // only validate
-  string::size_type pos = 0;
-  if ((*s)[pos] == '-') {  // check negtive
-    pos++;
+Status Context::parse(std::string_view json, Handler& handler) {
+  begin = cur = json.data();
+  end = begin + json.size();
+  skipWhitespace();
+  if (cur == end) {
+    return Status::PARSE_EXPECT_VALUE;
   }
-
-  if ((*s)[pos] == '0') {  // check integer
-    pos++;
-  } else {
-    if (!isDigit19((*s)[pos])) {
-      return Status::PARSE_INVALID_VALUE;
-    }
-    for (pos++; isDigit09((*s)[pos]); pos++) {  // simply neglect
+  Status status = readEvents(handler);
+  if (status == Status::PARSE_OK) {
+    skipWhitespace();
+    if (cur != end) {
+      status = Status::PARSE_ROOT_NOT_SINGULAR;
     }
   }
+  return status;
+}
 
-  if ((*s)[pos] == '.') {  // check demical
-    pos++;
-    if (!isDigit09((*s)[pos])) {
-      return Status::PARSE_INVALID_VALUE;
-    }
-    for (pos++; isDigit09((*s)[pos]); pos++) {
-    }
+Status Context::parseValue(Value& v, std::string_view json) {
+  begin = cur = json.data();
+  end = begin + json.size();
+  Status status = readValue(v);
+  if (status != Status::PARSE_OK) {
+    v.data = nullptr;
+    v.type = Type::NVLL;
+    invalidateHash(v);
   }
+  return status;
+}
 
-  if ((*s)[pos] == 'e' || (*s)[pos] == 'E') {  // check exp
-    pos++;
-    if ((*s)[pos] == '+' || (*s)[pos] == '-') {
-      pos++;
-    }
-    for (pos++; isDigit09((*s)[pos]); pos++) {
-    }
+YJSON_FORCE_INLINE void Context::skipWhitespace() {
+  // most tokens are not preceded by whitespace at all
+  if (cur < end && static_cast<unsigned char>(*cur) > ' ') {
+    return;
   }
-  Status status = Status::PARSE_OK;
-  // in c++ std::stod throw errors instead of returning error codes
-  try {
-    v->data = std::stod((*s), nullptr);  // parse it by std lib
-    v->type = Type::NUMBER;
-  } catch (std::out_of_range e) {
-    v->type = Type::NVLL;
-    status = Status::PARSE_NUMBER_TOO_BIG;
-  } catch (...) {
-    v->type = Type::NVLL;
-    status = Status::PARSE_INVALID_VALUE;
+  while (cur < end &&
+         (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r')) {
+    cur++;
   }
-  s->erase(0, pos);
-  return status;
 }
 
-Status parseString(StringPtr s, ValuePtr v) {
-  size_t pos = 1;
-  v->data = "";
-  for (; pos < s->length(); pos++) {
-    auto ch = (*s)[pos];
-    switch (ch) {
-      case '\"': {
-        s->erase(0, pos + 1);
-        v->type = Type::STRING;
+// empties an old vector of children in place, keeping its capacity
+template <typename T>
+static void clearChildren(Data& data) {
+  if (auto old = std::get_if<vector<T>>(&data)) {
+    old->clear();
+  } else {
+    data = vector<T>();
+  }
+}
+
+// iterative: containers push a frame on an explicit stack instead of
+// recursing, so the nesting depth is bounded by maxDepth, not the C++ stack.
+// The innermost frame stays in a local and the helpers are inlined, so a
+// child costs no more than it did in the recursive version.
+Status Context::readValue(Value& root) {
+  stack.clear();
+  // innermost open container, null at the top level
+  Frame* frame = nullptr;
+  Value* v = &root;
+  for (;;) {
+    // every node is (re)written below, reused containers included
+    v->renderedBy.reset();
+    v->hashCache.reset();
+    bool isArray = cur < end && *cur == '[';
+    if (!isArray && (cur == end || *cur != '{')) {
+      if (Status status = readScalar(*v); status != Status::PARSE_OK) {
+        return status;
+      }
+      YJSON_STATS_NODE(v->type);
+    } else if (stack.size() >= maxDepth) {
+      return Status::PARSE_DEPTH_EXCEEDED;
+    } else if (!isArray || !packedArrays || lazyNumbers ||
+               !readNumberArray(*v)) {
+      YJSON_STATS_ENTER();
+      cur++;
+      skipWhitespace();
+      if (cur < end && *cur == (isArray ? ']' : '}')) {
+        // no frame for [] and {}
+        cur++;
+        if (isArray) {
+          clearChildren<Value>(v->data);
+          v->type = Type::ARRAY;
+        } else {
+          clearChildren<Entry>(v->data);
+          v->type = Type::OBJECT;
+        }
+        YJSON_STATS_NODE(v->type);
+        YJSON_STATS_LEAVE();
+      } else {
+        // built in place: copying in a local Frame stalls on the stores
+        // that just wrote it
+        frame = &stack.emplace_back();
+        frame->v = v;
+        if (isArray) {
+          frame->elements = openContainer(v->data, levelElements, *frame);
+        } else {
+          frame->entries = openContainer(v->data, levelEntries, *frame);
+        }
+        Status status =
+            isArray ? nextElement(*frame, v) : nextMember(*frame, v);
+        if (status != Status::PARSE_OK) {
+          return status;
+        }
+        continue;  // descend into the first child
+      }
+    }
+
+    // *v is complete, climb until a container expects another child
+    Status status = Status::PARSE_OK;
+    for (;;) {
+      if (frame == nullptr) {
         return Status::PARSE_OK;
       }
-      case '\\': {
-        auto ch = (*s)[++pos];
-        switch (ch) {
-          case '\"':
-          case '\\':
-          case '/': {
-            std::get<string>(v->data) += ch;
-            break;
-          }
-          case 'b': {
-            std::get<string>(v->data) += '\b';
-            break;
-          }
-          case 'f': {
-            std::get<string>(v->data) += '\f';
-            break;
+      frame->n++;
+      skipWhitespace();
+      if (frame->elements) {
+        if (cur < end && *cur == ',') {
+          cur++;
+          skipWhitespace();
+          if (cur < end && *cur == ']') {
+            return Status::PARSE_INVALID_VALUE;
           }
-          case 'n': {
-            std::get<string>(v->data) += '\n';
-            break;
-          }
-          case 'r': {
-            std::get<string>(v->data) += '\r';
-            break;
-          }
-          case 't': {
-            std::get<string>(v->data) += '\t';
-            break;
+          status = nextElement(*frame, v);
+          break;
+        }
+        if (cur == end || *cur != ']') {
+          return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+      } else {
+        if (cur < end && *cur == ',') {
+          cur++;
+          skipWhitespace();
+          if (cur == end) {
+            return Status::PARSE_MISS_KEY;
           }
-          case 'u': {
-            unsigned int unicode = 0;
-            auto [err1, u1] = parseHex4(s, pos);
-            if (err1) {
-              return Status::PARSE_INVALID_UNICODE_HEX;
-            }
-            if (u1 >= 0xD800 && u1 <= 0xDBFF) {
-              if ((*s)[++pos] != '\\') {
-                return Status::PARSE_INVALID_UNICODE_SURROGATE;
-              }
-              if ((*s)[++pos] != 'u') {
-                return Status::PARSE_INVALID_UNICODE_SURROGATE;
-              }
-              auto [err2, u2] = parseHex4(s, pos);
-              if (err2) {
-                return Status::PARSE_INVALID_UNICODE_HEX;
-              }
-              if (u2 < 0xDC00 || u2 > 0xDFFF) {
-                return Status::PARSE_INVALID_UNICODE_SURROGATE;
-              }
-              unicode = (((u1 - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
-            } else {
-              unicode = u1;
-            }
-            if (unicode == 0) {
-              for (pos++; pos < s->length(); pos++) {
-                if ((*s)[pos] == '\"') {
-                  s->erase(0, pos + 1);
-                  v->type = Type::STRING;
-                  return Status::PARSE_OK;
-                }
-              }
-              return Status::PARSE_MISS_QUOTATION_MARK;
-            }
-            encodeUtf8(v, unicode);
-            break;
+          if (*cur == '}') {
+            return Status::PARSE_INVALID_VALUE;
           }
-          default: { return Status::PARSE_INVALID_STRING_ESCAPE; }
+          status = nextMember(*frame, v);
+          break;
         }
-        break;
-      }
-      default: {
-        // cast to unsigned char, incase of misjudgement
-        if (static_cast<unsigned char>(ch) < 0x20) {
-          return Status::PARSE_INVALID_STRING_CHAR;
+        if (cur == end || *cur != '}') {
+          return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
         }
-        std::get<string>(v->data) += ch;
       }
+      cur++;
+      closeContainer(*frame->v, *frame);
+      stack.pop_back();
+      frame = stack.empty() ? nullptr : &stack.back();
+    }
+    if (status != Status::PARSE_OK) {
+      return status;
     }
   }
-  return Status::PARSE_MISS_QUOTATION_MARK;
 }
 
-Status parseArray(StringPtr s, ValuePtr v) {
-  v->data = vector<Value>();
-  s->erase(0, 1);
-  parseWhitespace(s);
-  while (s->length() > 0) {
-    if ((*s)[0] == ']') {
-      s->erase(0, 1);
-      v->type = Type::ARRAY;
-      return Status::PARSE_OK;
+// anything but an array or object
+YJSON_FORCE_INLINE Status Context::readScalar(Value& v) {
+  if (cur == end) {
+    return Status::PARSE_EXPECT_VALUE;
+  }
+  switch (*cur) {
+    case 'n': {
+      return readLiteral(v, "null", Type::NVLL);
+    }
+    case 't': {
+      return readLiteral(v, "true", Type::TRUE);
     }
-    if ((*s)[0] == '}') {
-      // don't treat it as PARSE_INVALID_VALUE
-      return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+    case 'f': {
+      return readLiteral(v, "false", Type::FALSE);
     }
-    auto el = std::make_shared<Value>();
-    if (Status status = parseValue(s, el); status != Status::PARSE_OK) {
+    case '\"': {
+      if (!std::holds_alternative<string>(v.data)) {
+        v.data = string();
+      }
+      Status status = readString(std::get<string>(v.data));
+      if (status == Status::PARSE_OK) {
+        v.type = Type::STRING;
+      }
       return status;
     }
-    std::get<vector<Value>>(v->data).push_back(*el);
-    parseWhitespace(s);
-    if ((*s)[0] == ',') {
-      s->erase(0, 1);
-      parseWhitespace(s);
-      if ((*s)[0] == ']') {
-        v->type = Type::NVLL;
-        return Status::PARSE_INVALID_VALUE;
+    case '\0': {
+      return Status::PARSE_EXPECT_VALUE;
+    }
+    default: {
+      const char* start = cur;
+      double d = 0;
+      Status status = readNumber(d, !lazyNumbers);
+      if (status != Status::PARSE_OK) {
+        return status;
       }
+      std::string_view text(start, cur - start);
+      if (!lazyNumbers) {
+        v.data = d;
+      } else if (text.size() <= RawNumber::kCapacity) {
+        v.data = RawNumber(text);
+      } else if (auto old = std::get_if<string>(&v.data)) {
+        old->assign(text);
+      } else {
+        v.data = string(text);
+      }
+      v.type = Type::NUMBER;
+      return Status::PARSE_OK;
     }
   }
-  return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
 }
 
-Status parseObject(StringPtr s, ValuePtr v) {
-  v->data = vector<Entry>();
-  s->erase(0, 1);
-  parseWhitespace(s);
-  while (s->length() > 0) {
-    if ((*s)[0] == '}') {
-      s->erase(0, 1);
-      v->type = Type::OBJECT;
-      return Status::PARSE_OK;
+// [ number, ... ] straight into a vector<double>. Anything else, errors
+// included, puts cur back at the '[' and returns false: readValue then
+// reads the array as usual, with its usual statuses.
+bool Context::readNumberArray(Value& v) {
+  const char* open = cur;
+  cur++;
+  skipWhitespace();
+  numbers.clear();
+  while (cur < end && (*cur == '-' || isDigit09(*cur))) {
+    double d = 0;
+    if (readNumber(d, true) != Status::PARSE_OK) {
+      break;
     }
-    if ((*s)[0] == ']') {
-      return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    numbers.push_back(d);
+    skipWhitespace();
+    if (cur < end && *cur == ']') {
+      cur++;
+      if (auto old = std::get_if<vector<double>>(&v.data)) {
+        old->assign(numbers.begin(), numbers.end());
+      } else {
+        v.data = vector<double>(numbers.begin(), numbers.end());
+      }
+      v.type = Type::ARRAY;
+      YJSON_STATS_ENTER();
+      for (size_t i = 0; i < numbers.size(); i++) {
+        YJSON_STATS_NODE(Type::NUMBER);
+      }
+      YJSON_STATS_NODE(Type::ARRAY);
+      YJSON_STATS_LEAVE();
+      return true;
     }
-    auto el = std::make_shared<Entry>();
-    if ((*s)[0] != '\"') {
-      return Status::PARSE_MISS_KEY;
+    if (cur == end || *cur != ',') {
+      break;
     }
-    auto elKey = std::make_shared<Value>();
-    if (Status status = parseValue(s, elKey); status != Status::PARSE_OK) {
-      return status;
+    cur++;
+    skipWhitespace();
+  }
+  cur = open;
+  return false;
+}
+
+bool Context::skipLiteral(std::string_view literal) {
+  if (static_cast<size_t>(end - cur) < literal.length() ||
+      literal.compare(0, literal.length(), cur, literal.length()) != 0) {
+    return false;
+  }
+  cur += literal.length();
+  return true;
+}
+
+Status Context::readLiteral(Value& v, std::string_view literal, Type t) {
+  if (!skipLiteral(literal)) {
+    return Status::PARSE_INVALID_VALUE;
+  }
+  v.data = nullptr;
+  v.type = t;
+  return Status::PARSE_OK;
+}
+
+// Validate the number at cur and convert it into d; without convert, only
+// when it might overflow. cur moves past it, or to the offending byte.
+static Status scanNumber(const char*& cur, const char* end, double& d,
+                         bool convert, string& scratch) {
+  // validate and collect the decimal digits in one pass
+  const char* p = cur;
+  bool negative = false;
+  std::uint64_t mantissa = 0;
+  int digits = 0;  // significant digits in mantissa
+  int exp10 = 0;
+  if (p < end && *p == '-') {  // check negtive
+    negative = true;
+    p++;
+  }
+  if (p < end && *p == '0') {  // check integer
+    p++;
+  } else if (p < end && isDigit19(*p)) {
+    for (; p < end && isDigit09(*p); p++, digits++) {
+      mantissa = mantissa * 10 + (*p - '0');
     }
-    el->key = getString(elKey);
-    parseWhitespace(s);
-    if ((*s)[0] != ':') {
-      return Status::PARSE_MISS_COLON;
+  } else {
+    cur = p;
+    return Status::PARSE_INVALID_VALUE;
+  }
+  if (p < end && *p == '.') {  // check demical
+    p++;
+    if (p == end || !isDigit09(*p)) {
+      cur = p;
+      return Status::PARSE_INVALID_VALUE;
     }
-    s->erase(0, 1);
-    parseWhitespace(s);
-    auto elVal = std::make_shared<Value>();
-    if (Status status = parseValue(s, elVal); status != Status::PARSE_OK) {
-      return status;
+    for (; p < end && isDigit09(*p); p++, exp10--) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
     }
-    el->val = *elVal;
-    std::get<vector<Entry>>(v->data).push_back(*el);
-    parseWhitespace(s);
-    if ((*s)[0] == ',') {
-      s->erase(0, 1);
-      parseWhitespace(s);
-      if (s->length() == 0) {
-        v->type = Type::NVLL;
-        return Status::PARSE_MISS_KEY;
-      }
-      if ((*s)[0] == '}') {
-        v->type = Type::NVLL;
-        return Status::PARSE_INVALID_VALUE;
-      }
-    } else if ((*s)[0] != '}') {
-      v->type = Type::NVLL;
-      return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {  // check exp
+    p++;
+    bool expNegative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+      expNegative = *p == '-';
+      p++;
     }
+    if (p == end || !isDigit09(*p)) {
+      cur = p;
+      return Status::PARSE_INVALID_VALUE;
+    }
+    int exp = 0;
+    for (; p < end && isDigit09(*p); p++) {
+      exp = exp < 100000 ? exp * 10 + (*p - '0') : exp;
+    }
+    exp10 += expNegative ? -exp : exp;
   }
-  return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-}
 
-Status parseValue(StringPtr s, ValuePtr v) {
-  switch ((*s)[0]) {
-    case 'n': {
-      return parseNull(s, v);
+  if (!convert && digits + exp10 < 300) {
+    // below 10^299 (a margin for the digit count), far from DBL_MAX
+    cur = p;
+    return Status::PARSE_OK;
+  }
+  if (digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+    // both the mantissa and 10^|exp10| are exact doubles, so a single
+    // multiplication or division is correctly rounded
+    d = static_cast<double>(mantissa);
+    d = exp10 < 0 ? d / kPow10[-exp10] : d * kPow10[exp10];
+    d = negative ? -d : d;
+  } else {
+    // the input is not NUL-terminated, hand strtod a bounded copy
+    size_t len = p - cur;
+    char buffer[64];
+    const char* text = buffer;
+    if (len < sizeof(buffer)) {
+      std::memcpy(buffer, cur, len);
+      buffer[len] = '\0';
+    } else {
+      scratch.assign(cur, len);
+      text = scratch.c_str();
     }
-    case 't': {
-      return parseTrue(s, v);
+    errno = 0;
+    d = std::strtod(text, nullptr);
+    // underflow is fine, only overflow is reported
+    if (errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL)) {
+      return Status::PARSE_NUMBER_TOO_BIG;
     }
-    case 'f': {
-      return parseFalse(s, v);
+  }
+  cur = p;
+  return Status::PARSE_OK;
+}
+
+Status Context::readNumber(double& d, bool convert) {
+  return scanNumber(cur, end, d, convert, scratch);
+}
+
+Status Context::readString(string& out) {
+  out.clear();
+  cur++;
+  for (;;) {
+    // copy runs of plain characters in one go
+    const char* run = cur;
+    cur = skipPlain(cur, end);
+    // UTF-8 sequences are checked and belong to the run
+    while (cur != end && static_cast<unsigned char>(*cur) >= 0x80) {
+      const char* next = skipUtf8Sequence(cur, end);
+      if (next == nullptr) {
+        return Status::PARSE_INVALID_UTF8;
+      }
+      cur = skipPlain(next, end);
     }
-    case '\"': {
-      return parseString(s, v);
+    out.append(run, cur - run);
+    if (cur == end) {
+      return Status::PARSE_MISS_QUOTATION_MARK;
     }
-    case '[': {
-      return parseArray(s, v);
+    auto ch = *cur++;
+    if (ch == '\"') {
+      return Status::PARSE_OK;
     }
-    case '{': {
-      return parseObject(s, v);
+    if (ch != '\\') {
+      cur--;
+      return Status::PARSE_INVALID_STRING_CHAR;
     }
-    case '\0': {
-      return Status::PARSE_EXPECT_VALUE;
+    if (cur == end) {
+      return Status::PARSE_INVALID_STRING_ESCAPE;
+    }
+    switch (*cur++) {
+      case '\"': {
+        out += '\"';
+        break;
+      }
+      case '\\': {
+        out += '\\';
+        break;
+      }
+      case '/': {
+        out += '/';
+        break;
+      }
+      case 'b': {
+        out += '\b';
+        break;
+      }
+      case 'f': {
+        out += '\f';
+        break;
+      }
+      case 'n': {
+        out += '\n';
+        break;
+      }
+      case 'r': {
+        out += '\r';
+        break;
+      }
+      case 't': {
+        out += '\t';
+        break;
+      }
+      case 'u': {
+        unsigned int u1 = 0;
+        unsigned int unicode = 0;
+        if (!readHex4(cur, end, u1)) {
+          return Status::PARSE_INVALID_UNICODE_HEX;
+        }
+        cur += 4;
+        if (u1 >= 0xD800 && u1 <= 0xDBFF) {
+          if (end - cur < 2 || cur[0] != '\\' || cur[1] != 'u') {
+            return Status::PARSE_INVALID_UNICODE_SURROGATE;
+          }
+          cur += 2;
+          unsigned int u2 = 0;
+          if (!readHex4(cur, end, u2)) {
+            return Status::PARSE_INVALID_UNICODE_HEX;
+          }
+          cur += 4;
+          if (u2 < 0xDC00 || u2 > 0xDFFF) {
+            return Status::PARSE_INVALID_UNICODE_SURROGATE;
+          }
+          unicode = (((u1 - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+        } else {
+          unicode = u1;
+        }
+        if (unicode == 0) {
+          // an escaped NUL terminates the string, the rest is dropped
+          for (; cur < end; cur++) {
+            if (*cur == '\"') {
+              cur++;
+              return Status::PARSE_OK;
+            }
+          }
+          return Status::PARSE_MISS_QUOTATION_MARK;
+        }
+        appendUtf8(out, unicode);
+        break;
+      }
+      default: {
+        cur--;
+        return Status::PARSE_INVALID_STRING_ESCAPE;
+      }
     }
-    default: { return parseNumber(s, v); }
   }
+}
+
+// point v at the slot of the next element of the array of frame
+YJSON_FORCE_INLINE Status Context::nextElement(Frame& frame, Value*& v) {
+  if (cur == end || *cur == '}') {
+    // don't treat it as PARSE_INVALID_VALUE
+    return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+  }
+  auto& elements = *frame.elements;
+  if (frame.n == elements.size()) {
+    elements.emplace_back();
+  }
+  v = &elements[frame.n];
   return Status::PARSE_OK;
 }
 
-Status parse(ValuePtr v, const string& json) {
-  auto s = std::make_shared<string>(json);
-  if (v) {
-    parseWhitespace(s);
-    if (s->length() == 0) {
+// read the key and colon of the next member, point v at its value
+YJSON_FORCE_INLINE Status Context::nextMember(Frame& frame, Value*& v) {
+  if (cur == end || *cur == ']') {
+    return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+  }
+  if (*cur != '\"') {
+    return Status::PARSE_MISS_KEY;
+  }
+  auto& entries = *frame.entries;
+  if (frame.n == entries.size()) {
+    entries.emplace_back();
+  }
+  auto& entry = entries[frame.n];
+  if (Status status = readString(entry.key); status != Status::PARSE_OK) {
+    return status;
+  }
+  skipWhitespace();
+  if (cur == end || *cur != ':') {
+    return Status::PARSE_MISS_COLON;
+  }
+  cur++;
+  skipWhitespace();
+  v = &entry.val;
+  return Status::PARSE_OK;
+}
+
+// the walk of readValue with events instead of nodes, a container only
+// leaves its closing bracket on the stack
+Status Context::readEvents(Handler& handler) {
+  closers.clear();
+  for (;;) {
+    if (cur == end) {
       return Status::PARSE_EXPECT_VALUE;
-    } else {
-      Status ret = parseValue(s, v);
-      if (ret == Status::PARSE_OK) {
-        parseWhitespace(s);
-        if (s->length() != 0) {
-          v->type = Type::NVLL;
-          return Status::PARSE_ROOT_NOT_SINGULAR;
+    }
+    Status status = Status::PARSE_OK;
+    switch (*cur) {
+      case 'n': {
+        status = skipLiteral("null") ? handler.onNull()
+                                     : Status::PARSE_INVALID_VALUE;
+        break;
+      }
+      case 't': {
+        status = skipLiteral("true") ? handler.onBoolean(true)
+                                     : Status::PARSE_INVALID_VALUE;
+        break;
+      }
+      case 'f': {
+        status = skipLiteral("false") ? handler.onBoolean(false)
+                                      : Status::PARSE_INVALID_VALUE;
+        break;
+      }
+      case '\"': {
+        status = readString(text);
+        if (status == Status::PARSE_OK) {
+          status = handler.onString(text);
         }
+        break;
+      }
+      case '[':
+      case '{': {
+        if (closers.size() >= maxDepth) {
+          return Status::PARSE_DEPTH_EXCEEDED;
+        }
+        bool isArray = *cur == '[';
+        auto close = isArray ? ']' : '}';
+        status = isArray ? handler.onStartArray() : handler.onStartObject();
+        if (status != Status::PARSE_OK) {
+          return status;
+        }
+        cur++;
+        skipWhitespace();
+        if (cur < end && *cur == close) {
+          cur++;
+          status = isArray ? handler.onEndArray() : handler.onEndObject();
+          break;
+        }
+        closers.push_back(close);
+        if (isArray && (cur == end || *cur == '}')) {
+          return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+        if (!isArray && (status = nextKey(handler)) != Status::PARSE_OK) {
+          return status;
+        }
+        continue;  // descend into the first child
+      }
+      case '\0': {
+        return Status::PARSE_EXPECT_VALUE;
       }
-      return ret;
+      default: {
+        double d = 0;
+        status = readNumber(d, true);
+        if (status == Status::PARSE_OK) {
+          status = handler.onNumber(d);
+        }
+      }
+    }
+    if (status != Status::PARSE_OK) {
+      return status;
     }
+
+    // climb until a container expects another child
+    for (;;) {
+      if (closers.empty()) {
+        return Status::PARSE_OK;
+      }
+      bool isArray = closers.back() == ']';
+      skipWhitespace();
+      if (cur < end && *cur == ',') {
+        cur++;
+        skipWhitespace();
+        if (isArray) {
+          if (cur < end && *cur == ']') {
+            return Status::PARSE_INVALID_VALUE;
+          }
+          if (cur == end || *cur == '}') {
+            return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+          }
+        } else {
+          if (cur == end) {
+            return Status::PARSE_MISS_KEY;
+          }
+          if (*cur == '}') {
+            return Status::PARSE_INVALID_VALUE;
+          }
+          if (status = nextKey(handler); status != Status::PARSE_OK) {
+            return status;
+          }
+        }
+        break;
+      } else if (cur < end && *cur == closers.back()) {
+        cur++;
+        closers.pop_back();
+        status = isArray ? handler.onEndArray() : handler.onEndObject();
+        if (status != Status::PARSE_OK) {
+          return status;
+        }
+      } else {
+        return isArray ? Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                       : Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+      }
+    }
+  }
+}
+
+// nextMember for readEvents: the key goes to the handler
+Status Context::nextKey(Handler& handler) {
+  if (cur == end || *cur == ']') {
+    return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+  }
+  if (*cur != '\"') {
+    return Status::PARSE_MISS_KEY;
+  }
+  if (Status status = readString(text); status != Status::PARSE_OK) {
+    return status;
+  }
+  if (Status status = handler.onKey(text); status != Status::PARSE_OK) {
+    return status;
+  }
+  skipWhitespace();
+  if (cur == end || *cur != ':') {
+    return Status::PARSE_MISS_COLON;
+  }
+  cur++;
+  skipWhitespace();
+  return Status::PARSE_OK;
+}
+
+// reuse the children (and their capacity) left in data by the last parse,
+// otherwise collect them in the scratch vector of this depth. A new root
+// grows in its own vector instead: allocated before its children, it is
+// not the chunk next to the heap top when the tree is freed, which would
+// make glibc consolidate and trim the heap the next parse regrows.
+// The push_back slack this leaves at the root is what compact gives back.
+template <typename T>
+vector<T>* Context::openContainer(Data& data, std::deque<vector<T>>& levels,
+                                  Frame& frame) {
+  if (auto old = std::get_if<vector<T>>(&data); old && old->capacity() > 0) {
+    return old;
+  }
+  if (stack.size() == 1) {
+    return &data.emplace<vector<T>>();
+  }
+  frame.scratch = true;
+  return &scratchLevel(levels);
+}
+
+template <typename T>
+vector<T>& Context::scratchLevel(std::deque<vector<T>>& levels) {
+  // the frame of the container is already on the stack
+  size_t depth = stack.size() - 1;
+  if (levels.size() <= depth) {
+    levels.resize(depth + 1);
+  }
+  auto& level = levels[depth];
+  level.clear();
+  return level;
+}
+
+// a single allocation of the final size, no growth slack
+template <typename T>
+static void moveChildren(Data& data, vector<T>& children, size_t n) {
+  data = vector<T>(std::make_move_iterator(children.begin()),
+                   std::make_move_iterator(children.begin() + n));
+  children.clear();
+}
+
+template <typename T>
+static void closeChildren(Data& data, vector<T>& children, size_t n,
+                          bool scratch) {
+  if (scratch) {
+    moveChildren(data, children, n);
+  } else if (n < children.size()) {
+    // drop the children left over from a previous, larger document
+    children.erase(children.begin() + n, children.end());
+  }
+}
+
+YJSON_FORCE_INLINE void Context::closeContainer(Value& v, const Frame& frame) {
+  if (frame.elements) {
+    closeChildren(v.data, *frame.elements, frame.n, frame.scratch);
+    v.type = Type::ARRAY;
   } else {
-    return Status::PARSE_NULL_POINTER;
+    closeChildren(v.data, *frame.entries, frame.n, frame.scratch);
+    v.type = Type::OBJECT;
+  }
+  YJSON_STATS_NODE(v.type);
+  YJSON_STATS_LEAVE();
+}
+
+/*YJSON PARSER*/
+void parseWhitespace(StringPtr s) noexcept {
+  auto it = s->begin();
+  for (; it < s->end(); ++it) {
+    if ((*it) != ' ' && (*it) != '\t' && (*it) != '\n' && (*it) != '\r') {
+      break;
+    }
+  }
+  s->erase(s->begin(), it);
+  return;
+}
+
+inline Status parseNull(StringPtr s, ValuePtr v) {
+  return parseLiteral<Type::NVLL>(s, v, "null");
+}
+
+inline Status parseTrue(StringPtr s, ValuePtr v) {
+  return parseLiteral<Type::TRUE>(s, v, "true");
+}
+
+inline Status parseFalse(StringPtr s, ValuePtr v) {
+  return parseLiteral<Type::FALSE>(s, v, "false");
+}
+
+static Context& threadContext() {
+  thread_local Context context;
+  return context;
+}
+
+// the StringPtr parsers consume one value from the front of *s
+static Status parseFront(StringPtr s, ValuePtr v) {
+  auto& context = threadContext();
+  Status status = context.parseValue(*v, *s);
+  s->erase(0, context.position());
+  return status;
+}
+
+Status parseNumber(StringPtr s, ValuePtr v) {
+  if (s->empty() || ((*s)[0] != '-' && !isDigit09((*s)[0]))) {
+    return Status::PARSE_INVALID_VALUE;
   }
+  return parseFront(s, v);
+}
+
+Status parseString(StringPtr s, ValuePtr v) {
+  assert(!s->empty() && (*s)[0] == '\"');
+  return parseFront(s, v);
+}
+
+Status parseArray(StringPtr s, ValuePtr v) {
+  assert(!s->empty() && (*s)[0] == '[');
+  return parseFront(s, v);
+}
+
+Status parseObject(StringPtr s, ValuePtr v) {
+  assert(!s->empty() && (*s)[0] == '{');
+  return parseFront(s, v);
+}
+
+Status parseValue(StringPtr s, ValuePtr v) { return parseFront(s, v); }
+
+Status parse(ValuePtr v, std::string_view json) {
+  return threadContext().parse(v, json);
 }
 
 /*YJSON ACCESSOR*/
@@ -398,13 +993,13 @@ Data getValue(const ValuePtr v) {
   assert(v != nullptr);
   switch (v->type) {
     case Type::FALSE: {
-      return false;
+      return static_cast<double>(false);
     }
     case Type::TRUE: {
-      return true;
+      return static_cast<double>(true);
     }
     case Type::NUMBER: {
-      return std::get<double>(v->data);
+      return numberValue(*v);
     }
     case Type::STRING: {
       return std::get<string>(v->data);
@@ -415,7 +1010,109 @@ Data getValue(const ValuePtr v) {
 
 double getNumber(const ValuePtr v) {
   assert(v != nullptr && v->type == Type::NUMBER);
-  return std::get<double>(v->data);
+  return numberValue(*v);
+}
+
+// text of a lazy number, empty for one held as a double
+static std::string_view numberText(const Value& v) {
+  if (auto raw = std::get_if<RawNumber>(&v.data)) {
+    return raw->text();
+  }
+  if (auto text = std::get_if<string>(&v.data)) {
+    return *text;
+  }
+  return std::string_view();
+}
+
+double numberValue(const Value& v) {
+  assert(v.type == Type::NUMBER);
+  if (auto d = std::get_if<double>(&v.data)) {
+    return *d;
+  }
+  // validated when parsed, only the conversion is left
+  auto text = numberText(v);
+  const char* p = text.data();
+  double d = 0;
+  string scratch;
+  scanNumber(p, p + text.size(), d, true, scratch);
+  return d;
+}
+
+// sign and magnitude of an integer literal, false for fractions, exponents
+// and magnitudes that do not fit in 64 bits
+static bool integerText(std::string_view text, bool& negative,
+                        std::uint64_t& magnitude) {
+  negative = !text.empty() && text[0] == '-';
+  text.remove_prefix(negative);
+  if (text.empty() || text.size() > 20) {
+    return false;
+  }
+  magnitude = 0;
+  for (auto ch : text) {
+    if (!isDigit09(ch)) {
+      return false;
+    }
+    std::uint64_t next = magnitude * 10 + (ch - '0');
+    if (next / 10 != magnitude) {
+      return false;
+    }
+    magnitude = next;
+  }
+  return true;
+}
+
+// v as an exact integer when it is one that fits in 64 bits
+static bool integerValue(const Value& v, bool& negative,
+                         std::uint64_t& magnitude) {
+  if (auto text = numberText(v); !text.empty()) {
+    if (integerText(text, negative, magnitude)) {
+      negative = negative && magnitude != 0;
+      return true;
+    }
+  }
+  double d = numberValue(v);
+  if (d != std::floor(d) || std::fabs(d) >= 18446744073709551616.0) {
+    return false;
+  }
+  negative = d < 0;
+  magnitude = static_cast<std::uint64_t>(std::fabs(d));
+  return true;
+}
+
+bool getInt64(const ValuePtr v, std::int64_t& i) {
+  assert(v != nullptr && v->type == Type::NUMBER);
+  bool negative = false;
+  std::uint64_t magnitude = 0;
+  constexpr auto kMax = std::uint64_t(INT64_MAX);
+  if (!integerValue(*v, negative, magnitude) ||
+      magnitude > kMax + negative) {
+    return false;
+  }
+  // -2^63 has no positive counterpart to negate
+  i = negative ? static_cast<std::int64_t>(0 - magnitude)
+               : static_cast<std::int64_t>(magnitude);
+  return true;
+}
+
+bool getUint64(const ValuePtr v, std::uint64_t& u) {
+  assert(v != nullptr && v->type == Type::NUMBER);
+  bool negative = false;
+  std::uint64_t magnitude = 0;
+  if (!integerValue(*v, negative, magnitude) || negative) {
+    return false;
+  }
+  u = magnitude;
+  return true;
+}
+
+string getNumberText(const ValuePtr v) {
+  assert(v != nullptr && v->type == Type::NUMBER);
+  if (auto text = numberText(*v); !text.empty()) {
+    return string(text);
+  }
+  char buffer[32];
+  int n = snprintf(buffer, sizeof(buffer), "%.17g", std::get<double>(v->data));
+  return string(buffer, n);
 }
 
 bool getBoolean(const ValuePtr v) {
@@ -436,13 +1133,42 @@ auto getStringLength(const ValuePtr v)
 
 auto getArraySize(const ValuePtr v)
     -> decltype(std::get<vector<Value>>(v->data).size()) {
+  if (auto numbers = std::get_if<vector<double>>(&v->data)) {
+    return numbers->size();
+  }
   return std::get<vector<Value>>(v->data).size();
 }
 
+// element of a packed array as a node of its own
+static Value numberNode(double d) {
+  Value v(Type::NUMBER);
+  v.data = d;
+  return v;
+}
+
 ValuePtr getArrayElement(const ValuePtr v, const size_t& i) {
+  if (auto numbers = std::get_if<vector<double>>(&v->data)) {
+    return std::make_shared<Value>(numberNode((*numbers)[i]));
+  }
   return std::make_shared<Value>(std::get<vector<Value>>(v->data)[i]);
 }
 
+const vector<double>* getNumberArray(const ValuePtr v) {
+  assert(v != nullptr);
+  return std::get_if<vector<double>>(&v->data);
+}
+
+void unpackArray(Value& v) {
+  if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+    vector<Value> elements;
+    elements.reserve(numbers->size());
+    for (double d : *numbers) {
+      elements.push_back(numberNode(d));
+    }
+    v.data = std::move(elements);
+  }
+}
+
 size_t getObjectSize(const ValuePtr v) {
   return std::get<vector<Entry>>(v->data).size();
 }
@@ -464,27 +1190,262 @@ void setNull(const ValuePtr v) {
   assert(v != nullptr);
   v->data = nullptr;
   v->type = Type::NVLL;
+  invalidateHash(*v);
 }
 
 void setNumber(const ValuePtr v, const double& num) {
   assert(v != nullptr);
   v->data = num;
   v->type = Type::NUMBER;
+  invalidateHash(*v);
 }
 
 void setBoolean(const ValuePtr v, const bool& bl) {
   assert(v != nullptr);
   v->data = nullptr;
   v->type = bl ? Type::TRUE : Type::FALSE;
+  invalidateHash(*v);
 }
 
 void setString(const ValuePtr v, const string& str) {
   assert(v != nullptr);
   v->data = str;
   v->type = Type::STRING;
+  invalidateHash(*v);
+}
+
+void setNumberArray(const ValuePtr v, vector<double> numbers) {
+  assert(v != nullptr);
+  v->data = std::move(numbers);
+  v->type = Type::ARRAY;
+  invalidateHash(*v);
+}
+
+/*YJSON HASH*/
+static size_t mixHash(std::uint64_t h) {
+  // murmur3 finalizer
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return static_cast<size_t>(h);
+}
+
+static size_t combineHash(size_t seed, size_t h) {
+  return seed ^ (h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
 }
 
+static size_t hashString(const string& str) {
+  return std::hash<std::string_view>()(str);
+}
+
+size_t hashValue(const Value& v) {
+  if (size_t cached = v.hashCache.get()) {
+    return cached;
+  }
+  size_t h = castEnum(v.type);
+  switch (v.type) {
+    case Type::NVLL:
+    case Type::FALSE:
+    case Type::TRUE: {
+      break;
+    }
+    case Type::NUMBER: {
+      // equal numbers hash alike: integers (-0 included) by their exact
+      // value, whether held as text or as a double
+      bool negative = false;
+      std::uint64_t bits = 0;
+      if (integerValue(v, negative, bits)) {
+        h = combineHash(h, negative);
+      } else {
+        double d = numberValue(v);
+        memcpy(&bits, &d, sizeof(bits));
+      }
+      h = combineHash(h, mixHash(bits));
+      break;
+    }
+    case Type::STRING: {
+      h = combineHash(h, hashString(std::get<string>(v.data)));
+      break;
+    }
+    case Type::ARRAY: {
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        // as if every element were a node
+        for (double d : *numbers) {
+          h = combineHash(h, hashValue(numberNode(d)));
+        }
+        break;
+      }
+      for (const auto& x : std::get<vector<Value>>(v.data)) {
+        h = combineHash(h, hashValue(x));
+      }
+      break;
+    }
+    case Type::OBJECT: {
+      // a sum does not depend on the order of the members
+      size_t sum = 0;
+      for (const auto& x : std::get<vector<Entry>>(v.data)) {
+        sum += mixHash(combineHash(hashString(x.key), hashValue(x.val)));
+      }
+      h = combineHash(h, sum);
+      break;
+    }
+  }
+  h = mixHash(h);
+  auto folded = static_cast<std::uint32_t>(h ^ (h >> 16 >> 16));
+  folded = folded ? folded : 1;  // 0 marks "not computed"
+  v.hashCache.set(folded);
+  return folded;
+}
+
+void invalidateHash(const Value& v) {
+  v.renderedBy.reset();
+  v.hashCache.reset();
+}
+
+static bool sameEntry(const Entry& a, const Entry& b) {
+  return a.key == b.key && a.val == b.val;
+}
+
+// the members of entries from i on, ordered by key
+static vector<const Entry*> sortedByKey(const vector<Entry>& entries,
+                                        size_t i) {
+  vector<const Entry*> sorted;
+  sorted.reserve(entries.size() - i);
+  for (; i < entries.size(); i++) {
+    sorted.push_back(&entries[i]);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const Entry* x, const Entry* y) { return x->key < y->key; });
+  return sorted;
+}
+
+static bool equalEntries(const vector<Entry>& a, const vector<Entry>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  // members usually come in the same order
+  size_t i = 0;
+  while (i < a.size() && sameEntry(a[i], b[i])) {
+    i++;
+  }
+  if (i == a.size()) {
+    return true;
+  }
+  // otherwise sort the rest by key, so that each value is compared with
+  // the one under the same key only
+  auto sortedA = sortedByKey(a, i);
+  auto sortedB = sortedByKey(b, i);
+  for (size_t j = 0; j < sortedA.size();) {
+    const string& key = sortedA[j]->key;
+    size_t run = j + 1;
+    while (run < sortedA.size() && sortedA[run]->key == key) {
+      run++;
+    }
+    if (sortedB[run - 1]->key != key || sortedB[j]->key != key ||
+        (run < sortedB.size() && sortedB[run]->key == key)) {
+      return false;
+    }
+    if (run - j == 1) {
+      if (sortedA[j]->val != sortedB[j]->val) {
+        return false;
+      }
+      j = run;
+      continue;
+    }
+    // a key repeated in the object: its values must occur as often on
+    // both sides, counted within the run
+    for (size_t k = j; k < run; k++) {
+      size_t inA = 0;
+      size_t inB = 0;
+      for (size_t m = j; m < run; m++) {
+        inA += sortedA[k]->val == sortedA[m]->val;
+        inB += sortedA[k]->val == sortedB[m]->val;
+      }
+      if (inA != inB) {
+        return false;
+      }
+    }
+    j = run;
+  }
+  return true;
+}
+
+static bool equalNumbers(const vector<double>& numbers,
+                         const vector<Value>& elements) {
+  if (numbers.size() != elements.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < numbers.size(); i++) {
+    if (numberNode(numbers[i]) != elements[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool operator==(const Value& a, const Value& b) {
+  if (&a == &b) {
+    return true;
+  }
+  if (a.type != b.type) {
+    return false;
+  }
+  size_t ha = a.hashCache.get();
+  size_t hb = b.hashCache.get();
+  if (ha && hb && ha != hb) {
+    return false;
+  }
+  switch (a.type) {
+    case Type::NVLL:
+    case Type::FALSE:
+    case Type::TRUE: {
+      return true;
+    }
+    case Type::NUMBER: {
+      if (std::holds_alternative<double>(a.data) &&
+          std::holds_alternative<double>(b.data)) {
+        return std::get<double>(a.data) == std::get<double>(b.data);
+      }
+      // exact for 64-bit integers, so that large ids stay distinct
+      bool na = false, nb = false;
+      std::uint64_t ma = 0, mb = 0;
+      bool ia = integerValue(a, na, ma);
+      bool ib = integerValue(b, nb, mb);
+      if (ia || ib) {
+        return ia && ib && na == nb && ma == mb;
+      }
+      return numberValue(a) == numberValue(b);
+    }
+    case Type::STRING: {
+      return std::get<string>(a.data) == std::get<string>(b.data);
+    }
+    case Type::ARRAY: {
+      auto na = std::get_if<vector<double>>(&a.data);
+      auto nb = std::get_if<vector<double>>(&b.data);
+      if (na && nb) {
+        return *na == *nb;
+      }
+      if (na || nb) {
+        return equalNumbers(na ? *na : *nb,
+                            std::get<vector<Value>>((na ? b : a).data));
+      }
+      return std::get<vector<Value>>(a.data) ==
+             std::get<vector<Value>>(b.data);
+    }
+    case Type::OBJECT: {
+      return equalEntries(std::get<vector<Entry>>(a.data),
+                          std::get<vector<Entry>>(b.data));
+    }
+  }
+  return false;
+}
+
+bool operator!=(const Value& a, const Value& b) { return !(a == b); }
+
 Status stringify(const ValuePtr v, std::shared_ptr<string> s) {
+  YJSON_STATS_SCOPE(Phase::STRINGIFY);
   if (Status status = stringifyValue(v, s); status != Status::STRINGIFY_OK) {
     s.reset();
     return status;
@@ -492,104 +1453,133 @@ Status stringify(const ValuePtr v, std::shared_ptr<string> s) {
   return Status::STRINGIFY_OK;
 }
 
+void stringifyString(std::string_view str, string& s) {
+  s.push_back('\"');
+  for (unsigned char ch : str) {
+    switch (ch) {
+      case '\"': {
+        s.append("\\\"");
+        break;
+      }
+      case '\\': {
+        s.append("\\\\");
+        break;
+      }
+      case '\b': {
+        s.append("\\b");
+        break;
+      }
+      case '\f': {
+        s.append("\\f");
+        break;
+      }
+      case '\n': {
+        s.append("\\n");
+        break;
+      }
+      case '\r': {
+        s.append("\\r");
+        break;
+      }
+      case '\t': {
+        s.append("\\t");
+        break;
+      }
+      default: {
+        // bytes >= 0x80 belong to UTF-8 sequences and are copied as is
+        if (ch < 0x20) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\u%04X", ch);
+          s.append(buffer);
+        } else {
+          s.push_back(static_cast<char>(ch));
+        }
+      }
+    }
+  }
+  s.push_back('\"');
+}
+
 Status stringifyValue(const ValuePtr v, std::shared_ptr<string> s) {
-  switch (v->type) {
+  return stringifyValue(*v, *s);
+}
+
+void stringifyNumber(double d, string& s) {
+  char buffer[32];
+  int n = snprintf(buffer, sizeof(buffer), "%.17g", d);
+  s.append(buffer, n);
+}
+
+Status stringifyValue(const Value& v, string& s) {
+  YJSON_STATS_NODE(v.type);
+  switch (v.type) {
     case Type::NVLL: {
-      s->append("null");
+      s.append("null");
       break;
     }
     case Type::TRUE: {
-      s->append("true");
+      s.append("true");
       break;
     }
     case Type::FALSE: {
-      s->append("false");
+      s.append("false");
       break;
     }
     case Type::NUMBER: {
-      char buffer[32];
-      sprintf(buffer, "%.17g", std::get<double>(v->data));
-      s->append(buffer);
+      if (auto text = numberText(v); !text.empty()) {
+        // untouched lazy numbers are written back verbatim
+        s.append(text);
+        break;
+      }
+      stringifyNumber(std::get<double>(v.data), s);
       break;
     }
     case Type::STRING: {
-      s->append("\"");
-      for (auto ch : std::get<string>(v->data)) {
-        switch (ch) {
-          case '\"': {
-            s->append("\\\"");
-            break;
-          }
-          case '\\': {
-            s->append("\\\\");
-            break;
-          }
-          case '\b': {
-            s->append("\\b");
-            break;
-          }
-          case '\f': {
-            s->append("\\f");
-            break;
-          }
-          case '\n': {
-            s->append("\\n");
-            break;
-          }
-          case '\r': {
-            s->append("\\r");
-            break;
-          }
-          case '\t': {
-            s->append("\\t");
-            break;
-          }
-          case '\0': {
-            s->append("\\u0000");
-            break;
-          }
-          default: {
-            if (ch < 0x20) {
-              std::stringstream ss;
-              string unicode;
-              ss << std::setw(4) << std::setfill('0') << ch;
-              ss >> unicode;
-              *s = (*s) + "\\u" + unicode + "x";
-            } else {
-              s->push_back(ch);
-            }
-          }
-        }
-      }
-      s->append("\"");
+      stringifyString(std::get<string>(v.data), s);
       break;
     }
     case Type::ARRAY: {
-      s->append("[");
-      for (auto x : std::get<vector<Value>>(v->data)) {
-        stringifyValue(std::make_shared<Value>(x), s);
-        s->append(",");
-      }
-      if (s->length() > 2) {
-        s->pop_back();
+      YJSON_STATS_ENTER();
+      s.push_back('[');
+      bool first = true;
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        // no nodes to dispatch on, only numbers
+        for (double d : *numbers) {
+          YJSON_STATS_NODE(Type::NUMBER);
+          if (!first) {
+            s.push_back(',');
+          }
+          first = false;
+          stringifyNumber(d, s);
+        }
+      } else {
+        for (const auto& x : std::get<vector<Value>>(v.data)) {
+          if (!first) {
+            s.push_back(',');
+          }
+          first = false;
+          stringifyValue(x, s);
+        }
       }
-      s->append("]");
+      s.push_back(']');
+      YJSON_STATS_LEAVE();
       break;
     }
     case Type::OBJECT: {
-      s->append("{");
-      for (auto x : std::get<vector<Entry>>(v->data)) {
-        auto key = std::make_shared<Value>();
-        setString(key, x.key);
-        stringifyValue(key, s);
-        s->append(":");
-        stringifyValue(std::make_shared<Value>(x.val), s);
-        s->append(",");
-      }
-      if (s->length() > 2) {
-        s->pop_back();
-      }
-      s->append("}");
+      YJSON_STATS_ENTER();
+      s.push_back('{');
+      bool first = true;
+      for (const auto& x : std::get<vector<Entry>>(v.data)) {
+        if (!first) {
+          s.push_back(',');
+        }
+        first = false;
+        stringifyString(x.key, s);
+        s.push_back(':');
+        stringifyValue(x.val, s);
+      }
+      s.push_back('}');
+      YJSON_STATS_LEAVE();
       break;
     }
   }
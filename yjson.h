@@ -1,8 +1,12 @@
 #ifndef YJSON_H__
 #define YJSON_H__
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <iomanip>
 #include <iostream>
@@ -10,6 +14,7 @@
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -22,8 +27,33 @@ class Context;
 
 using std::string;
 using std::vector;
+
+// Number text kept as parsed (see Context::setLazyNumbers) and converted
+// when read. It is stored inline, as long as a string and without its heap
+// allocation: that fits any 64-bit integer and 17-digit doubles. Longer
+// number text is held in the string alternative of Data instead.
+class RawNumber {
+ public:
+  static constexpr size_t kCapacity = 31;
+
+  RawNumber() = default;
+  explicit RawNumber(std::string_view text)
+      : length(static_cast<std::uint8_t>(text.size())) {
+    assert(text.size() <= kCapacity);
+    std::memcpy(chars, text.data(), text.size());
+  }
+  std::string_view text() const { return std::string_view(chars, length); }
+
+ private:
+  char chars[kCapacity];
+  std::uint8_t length = 0;
+};
+
 // c++17 only allows incomplete class usage in certain containers
-using Data = std::variant<double, string, vector<Value>, vector<Entry>, void*>;
+// an ARRAY holds vector<double> instead of vector<Value> when it was parsed
+// with Context::setPackedArrays and all its elements are numbers
+using Data = std::variant<double, string, vector<Value>, vector<Entry>, void*,
+                          RawNumber, vector<double>>;
 using ValuePtr = std::shared_ptr<Value>;
 using StringPtr = std::shared_ptr<string>;
 
@@ -67,7 +97,30 @@ enum class Status : std::uint8_t {
   PARSE_MISS_KEY,
   PARSE_MISS_COLON,
   PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+  PARSE_DEPTH_EXCEEDED,
+  PARSE_INVALID_UTF8,
   STRINGIFY_OK,
+  STRINGIFY_IO_ERROR,
+  STRINGIFY_INVALID_CALL,
+  TAPE_OK,
+  TAPE_TOO_LARGE,
+  SNAPSHOT_OK,
+  SNAPSHOT_IO_ERROR,
+  SNAPSHOT_INVALID_FORMAT,
+  SNAPSHOT_VERSION_MISMATCH,
+  PATCH_OK,
+  PATCH_INVALID_OPERATION,
+  PATCH_INVALID_POINTER,
+  PATCH_PATH_NOT_FOUND,
+  PATCH_TEST_FAILED,
+  SCHEMA_OK,
+  SCHEMA_INVALID,
+  SCHEMA_TYPE_MISMATCH,
+  SCHEMA_REQUIRED_MISSING,
+  SCHEMA_ENUM_MISMATCH,
+  SCHEMA_OUT_OF_RANGE,
+  SCHEMA_PATTERN_MISMATCH,
+  CACHE_IO_ERROR,
 };
 extern string StatusStr[];
 std::ostream& operator<<(std::ostream& os, Status s);
@@ -75,11 +128,99 @@ std::ostream& operator<<(std::ostream& os, Status s);
 // std unicode
 std::pair<bool, unsigned int> parseHex4(StringPtr, size_t& pos);
 void encodeUtf8(StringPtr, unsigned int u);
+// past the UTF-8 sequence that starts with the non-ASCII byte at p,
+// nullptr when it is not well-formed: overlong, a surrogate, above
+// U+10FFFF or cut short (Unicode Table 3-7)
+inline const char* skipUtf8Sequence(const char* p, const char* end) {
+  auto c = static_cast<unsigned char>(p[0]);
+  size_t tail = 0;
+  unsigned char low = 0x80;
+  unsigned char high = 0xBF;
+  if (c >= 0xC2 && c <= 0xDF) {
+    tail = 1;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    tail = 2;
+    low = c == 0xE0 ? 0xA0 : low;   // overlong
+    high = c == 0xED ? 0x9F : high;  // surrogates
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    tail = 3;
+    low = c == 0xF0 ? 0x90 : low;   // overlong
+    high = c == 0xF4 ? 0x8F : high;  // above U+10FFFF
+  } else {
+    return nullptr;
+  }
+  if (static_cast<size_t>(end - p) <= tail) {
+    return nullptr;
+  }
+  auto c1 = static_cast<unsigned char>(p[1]);
+  if (c1 < low || c1 > high) {
+    return nullptr;
+  }
+  for (size_t i = 2; i <= tail; i++) {
+    if ((static_cast<unsigned char>(p[i]) & 0xC0) != 0x80) {
+      return nullptr;
+    }
+  }
+  return p + tail + 1;
+}
+
+// Structural hash of a node, 0 while not computed. Relaxed atomic, so that
+// threads sharing a const tree may fill it concurrently (they store the same
+// value). 32 bits fit in the padding after Value::type. Copies keep it, the
+// content is the same.
+class HashCache {
+ public:
+  HashCache() = default;
+  HashCache(const HashCache& other) noexcept : value(other.get()) {}
+  HashCache& operator=(const HashCache& other) noexcept {
+    set(other.get());
+    return *this;
+  }
+  std::uint32_t get() const { return value.load(std::memory_order_relaxed); }
+  void set(std::uint32_t hash) const {
+    value.store(hash, std::memory_order_relaxed);
+  }
+  void reset() const { set(0); }
+
+ private:
+  mutable std::atomic<std::uint32_t> value{0};
+};
+
+// Id of the RenderCache (yjson_render.h) that holds the bytes this node was
+// last written as, 0 for none. 16 bits fit in the padding before the hash.
+// Copies and moves start unmarked, and leave the moved-from node unmarked.
+class RenderMark {
+ public:
+  RenderMark() = default;
+  RenderMark(const RenderMark&) noexcept {}
+  RenderMark(RenderMark&& other) noexcept { other.reset(); }
+  RenderMark& operator=(const RenderMark&) noexcept {
+    reset();
+    return *this;
+  }
+  RenderMark& operator=(RenderMark&& other) noexcept {
+    reset();
+    other.reset();
+    return *this;
+  }
+  std::uint16_t get() const { return id.load(std::memory_order_relaxed); }
+  void set(std::uint16_t cache) const {
+    id.store(cache, std::memory_order_relaxed);
+  }
+  void reset() const { set(0); }
+
+ private:
+  mutable std::atomic<std::uint16_t> id{0};
+};
 
 // incomplete class is valid in certain c++17 STL containers
 class Value {
  public:
   Type type;
+  // both reset by parse and the setters; after editing data directly, call
+  // invalidateHash on every node from the root down to the edited one
+  RenderMark renderedBy;
+  HashCache hashCache;
   Data data;
   Value();
   Value(Type t);
@@ -91,6 +232,110 @@ class Entry {
   Value val;
 };
 
+/*YJSON SAX*/
+// Receives the events of Context::parse(json, handler) in document order.
+// Strings are decoded and only valid during the call. Returning anything
+// but PARSE_OK stops the parse, which then returns that status.
+class Handler {
+ public:
+  virtual ~Handler() = default;
+  virtual Status onNull() { return Status::PARSE_OK; }
+  virtual Status onBoolean(bool) { return Status::PARSE_OK; }
+  virtual Status onNumber(double) { return Status::PARSE_OK; }
+  virtual Status onString(std::string_view) { return Status::PARSE_OK; }
+  virtual Status onStartArray() { return Status::PARSE_OK; }
+  virtual Status onEndArray() { return Status::PARSE_OK; }
+  virtual Status onStartObject() { return Status::PARSE_OK; }
+  virtual Status onKey(std::string_view) { return Status::PARSE_OK; }
+  virtual Status onEndObject() { return Status::PARSE_OK; }
+};
+
+/*YJSON CONTEXT*/
+// Reusable parser state, keep one per thread. Parsing into a Value that
+// already holds a tree reuses its vectors and strings, so same-shaped
+// documents parse with next to no heap allocations.
+// Nesting is tracked on an explicit stack, deeper documents than
+// getMaxDepth() fail with PARSE_DEPTH_EXCEEDED instead of overflowing.
+constexpr size_t kDefaultMaxDepth = 1024;
+
+class Context {
+ public:
+  Context() = default;
+  // Value destruction and stringify still recurse, keep it moderate
+  void setMaxDepth(size_t depth) { maxDepth = depth; }
+  size_t getMaxDepth() const { return maxDepth; }
+  // keep number text instead of converting it, see RawNumber
+  void setLazyNumbers(bool lazy) { lazyNumbers = lazy; }
+  bool getLazyNumbers() const { return lazyNumbers; }
+  // store arrays of nothing but numbers as one vector<double>, see
+  // getNumberArray; ignored while numbers are lazy, their text is kept
+  void setPackedArrays(bool packed) { packedArrays = packed; }
+  bool getPackedArrays() const { return packedArrays; }
+  // parse the whole json, trailing non-whitespace is an error
+  Status parse(Value& v, std::string_view json);
+  Status parse(ValuePtr v, std::string_view json);
+  // the same syntax checks, but no tree: events go to handler as they are
+  // read, so a document can be rejected before anything is allocated
+  Status parse(std::string_view json, Handler& handler);
+  // parse one value at the very start of json, no whitespace skipped
+  Status parseValue(Value& v, std::string_view json);
+  // offset where the last call stopped: past the value or at the error
+  size_t position() const { return static_cast<size_t>(cur - begin); }
+
+ private:
+  // an open container and the number of children completed so far
+  struct Frame {
+    Value* v = nullptr;
+    // exactly one of elements/entries is set, pointing either into v when
+    // its old storage is reused or at the scratch vector of this depth
+    vector<Value>* elements = nullptr;
+    vector<Entry>* entries = nullptr;
+    size_t n = 0;
+    bool scratch = false;
+  };
+
+  // the inline ones are defined in yjson.cpp and only called there, forced
+  // into the loop of readValue
+  inline void skipWhitespace();
+  Status readValue(Value& v);
+  inline Status readScalar(Value& v);
+  bool skipLiteral(std::string_view literal);
+  Status readLiteral(Value& v, std::string_view literal, Type t);
+  Status readNumber(double& d, bool convert);
+  bool readNumberArray(Value& v);
+  Status readString(string& out);
+  inline Status nextElement(Frame& frame, Value*& v);
+  inline Status nextMember(Frame& frame, Value*& v);
+  Status readEvents(Handler& handler);
+  Status nextKey(Handler& handler);
+  template <typename T>
+  vector<T>* openContainer(Data& data, std::deque<vector<T>>& levels,
+                           Frame& frame);
+  template <typename T>
+  vector<T>& scratchLevel(std::deque<vector<T>>& levels);
+  inline void closeContainer(Value& v, const Frame& frame);
+
+  vector<Frame> stack;
+  // children of new containers collect here and are moved out into an
+  // exactly sized vector on close; a deque keeps the levels in place
+  std::deque<vector<Value>> levelElements;
+  std::deque<vector<Entry>> levelEntries;
+  size_t maxDepth = kDefaultMaxDepth;
+  bool lazyNumbers = false;
+  bool packedArrays = false;
+  const char* begin = nullptr;
+  const char* cur = nullptr;
+  const char* end = nullptr;
+  // long number text, strtod needs it NUL-terminated
+  string scratch;
+  // elements of the packed array being read
+  vector<double> numbers;
+  // closing brackets of the containers open in readEvents, and the
+  // string or key being decoded
+  vector<char> closers;
+  string text;
+};
+
 /*YJSON PARSER*/
 void parseWhitespace(StringPtr s) noexcept;
 
@@ -102,6 +347,8 @@ Status parseLiteral(StringPtr s, ValuePtr v, string&& typeStr) {
   }
   s->erase(0, typeStr.length());
   v->type = type;
+  v->renderedBy.reset();
+  v->hashCache.reset();
   return Status::PARSE_OK;
 }
 
@@ -113,7 +360,7 @@ Status parseString(StringPtr s, ValuePtr v);
 Status parseArray(StringPtr s, ValuePtr v);
 Status parseObject(StringPtr s, ValuePtr v);
 Status parseValue(StringPtr s, ValuePtr v);
-Status parse(ValuePtr v, const string& json);
+Status parse(ValuePtr v, std::string_view json);
 
 /*YJSON ACCESSOR*/
 Type getType(const ValuePtr v);
@@ -130,17 +377,54 @@ size_t getObjectSize(const ValuePtr v);
 const string getObjectKey(const ValuePtr v, const size_t& index);
 size_t getObjectKeyLength(const ValuePtr v, const size_t& index);
 ValuePtr getObjectValue(const ValuePtr v, const size_t& index);
+// Exact integer value of a number, false unless it is a whole number in
+// range. Lazily parsed integers are read from their text, so 64-bit ids
+// do not go through a double.
+bool getInt64(const ValuePtr v, std::int64_t& i);
+bool getUint64(const ValuePtr v, std::uint64_t& u);
+// the text a lazy number was parsed from, others are printed with "%.17g"
+string getNumberText(const ValuePtr v);
+// getNumber for a Value held directly
+double numberValue(const Value& v);
+// The elements of a packed array as one contiguous buffer, nullptr for any
+// other value. getArraySize and getArrayElement read both forms alike.
+const vector<double>* getNumberArray(const ValuePtr v);
+// turn a packed array into a vector<Value>, before editing its elements
+void unpackArray(Value& v);
 
 /*YJSON SETTER*/
 void setNull(const ValuePtr v);
 void setNumber(const ValuePtr v, const double& num);
 void setBoolean(const ValuePtr v, const bool& bl);
 void setString(const ValuePtr v, const string& str);
+void setNumberArray(const ValuePtr v, vector<double> numbers);
+
+/*YJSON HASH*/
+// 32-bit structural hash, computed once per node and cached; objects hash
+// the same whatever the order of their keys
+size_t hashValue(const Value& v);
+// forget the cached hash of v and its rendered bytes, not its children's
+void invalidateHash(const Value& v);
+// deep equality, objects compare as multisets of members; nodes with cached
+// hashes that differ are told apart without descending
+bool operator==(const Value& a, const Value& b);
+bool operator!=(const Value& a, const Value& b);
 
 /*YJSON GENERATOR*/
 Status stringify(const ValuePtr v, std::shared_ptr<string> s);
 Status stringifyValue(const ValuePtr v, std::shared_ptr<string> s);
+// append to s without copying subtrees
+Status stringifyValue(const Value& v, string& s);
+// quoted and escaped
+void stringifyString(std::string_view str, string& s);
+// "%.17g", which reads back as the same double
+void stringifyNumber(double d, string& s);
 
 }  // namespace yph
 
+template <>
+struct std::hash<yph::Value> {
+  size_t operator()(const yph::Value& v) const { return yph::hashValue(v); }
+};
+
 #endif /*YJSON*/
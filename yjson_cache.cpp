@@ -0,0 +1,167 @@
+#include "yjson_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace yph {
+
+/*FILE STAMPS*/
+static void fillStamp(const struct stat& st, std::uint64_t& device,
+                      std::uint64_t& inode, std::uint64_t& size,
+                      std::int64_t& mtimeNs) {
+  device = static_cast<std::uint64_t>(st.st_dev);
+  inode = static_cast<std::uint64_t>(st.st_ino);
+  size = static_cast<std::uint64_t>(st.st_size);
+  mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+            st.st_mtim.tv_nsec;
+}
+
+bool DocumentCache::Stamp::operator==(const Stamp& o) const {
+  return device == o.device && inode == o.inode && size == o.size &&
+         mtimeNs == o.mtimeNs;
+}
+
+DocumentCache::Stamp DocumentCache::statFile(const string& path) {
+  Stamp stamp;
+  struct stat st;
+  if (::stat(path.c_str(), &st) == 0) {
+    fillStamp(st, stamp.device, stamp.inode, stamp.size, stamp.mtimeNs);
+  }
+  return stamp;
+}
+
+// the stamp is taken from the open file, before it is read: a write that
+// lands while it is read changes the stamp again and is picked up later
+Status DocumentCache::load(const string& path, Context& context,
+                           Stamp& stamp, DocumentPtr& doc) {
+  stamp = Stamp();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Status::CACHE_IO_ERROR;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return Status::CACHE_IO_ERROR;
+  }
+  fillStamp(st, stamp.device, stamp.inode, stamp.size, stamp.mtimeNs);
+  string text;
+  text.reserve(stamp.size);
+  char buffer[1 << 16];
+  ssize_t n = 0;
+  while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+    text.append(buffer, n);
+  }
+  ::close(fd);
+  if (n < 0) {
+    return Status::CACHE_IO_ERROR;
+  }
+  auto tree = std::make_shared<Value>();
+  Status status = context.parse(*tree, text);
+  if (status == Status::PARSE_OK) {
+    doc = std::move(tree);
+  }
+  return status;
+}
+
+/*DOCUMENT CACHE*/
+DocumentCache::DocumentCache(std::chrono::milliseconds interval)
+    : interval(interval), poller(&DocumentCache::poll, this) {}
+
+DocumentCache::~DocumentCache() {
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    stopping = true;
+  }
+  stopped.notify_all();
+  poller.join();
+}
+
+Status DocumentCache::get(const string& path, DocumentPtr& doc) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (auto it = entries.find(path); it != entries.end()) {
+      Entry& e = *it->second;
+      doc = std::atomic_load(&e.doc);
+      (doc ? e.hits : e.errors).fetch_add(1, std::memory_order_relaxed);
+      return doc ? Status::PARSE_OK : e.status.load();
+    }
+  }
+  // loaded without the lock; when another thread got there first, its
+  // entry is kept and this one dropped
+  auto fresh = std::make_unique<Entry>();
+  Context local;
+  fresh->status = load(path, local, fresh->stamp, fresh->doc);
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  Entry& e = *entries.try_emplace(path, std::move(fresh)).first->second;
+  e.misses.fetch_add(1, std::memory_order_relaxed);
+  doc = std::atomic_load(&e.doc);
+  return doc ? Status::PARSE_OK : e.status.load();
+}
+
+DocumentStats DocumentCache::stats(const string& path) const {
+  DocumentStats stats;
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto it = entries.find(path);
+  if (it == entries.end()) {
+    return stats;
+  }
+  const Entry& e = *it->second;
+  stats.hits = e.hits.load(std::memory_order_relaxed);
+  stats.misses = e.misses.load(std::memory_order_relaxed);
+  stats.errors = e.errors.load(std::memory_order_relaxed);
+  stats.reloads = e.reloads.load(std::memory_order_relaxed);
+  stats.failures = e.failures.load(std::memory_order_relaxed);
+  stats.lastStatus = e.status.load();
+  stats.lastReloadNs = e.lastReloadNs.load(std::memory_order_relaxed);
+  stats.maxReloadNs = e.maxReloadNs.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void DocumentCache::refresh() {
+  std::lock_guard<std::mutex> guard(refreshMutex);
+  vector<std::pair<const string*, Entry*>> all;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    all.reserve(entries.size());
+    for (auto& [path, e] : entries) {
+      all.emplace_back(&path, e.get());
+    }
+  }
+  // stat, read and parse without the lock, gets go on meanwhile
+  for (auto [path, e] : all) {
+    if (statFile(*path) == e->stamp) {
+      continue;
+    }
+    auto start = std::chrono::steady_clock::now();
+    DocumentPtr doc;
+    Status status = load(*path, context, e->stamp, doc);
+    e->status = status;
+    if (status != Status::PARSE_OK) {
+      e->failures.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    std::atomic_store(&e->doc, std::move(doc));
+    auto ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+    e->reloads.fetch_add(1, std::memory_order_relaxed);
+    e->lastReloadNs.store(ns, std::memory_order_relaxed);
+    if (ns > e->maxReloadNs.load(std::memory_order_relaxed)) {
+      e->maxReloadNs.store(ns, std::memory_order_relaxed);
+    }
+  }
+}
+
+void DocumentCache::poll() {
+  std::unique_lock<std::mutex> lock(stopMutex);
+  while (!stopped.wait_for(lock, interval, [this] { return stopping; })) {
+    lock.unlock();
+    refresh();
+    lock.lock();
+  }
+}
+
+}  // namespace yph
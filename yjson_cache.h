@@ -0,0 +1,115 @@
+#ifndef YJSON_CACHE_H__
+#define YJSON_CACHE_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Parsed JSON files, for config and reference data read on request paths.
+ * The first get of a path reads and parses the file on the calling thread.
+ * After that a background thread stats every cached file once per
+ * interval. It reads and parses the files whose modification time, size
+ * or inode changed, then publishes each new tree with an atomic pointer
+ * swap, like SharedDocument. A get is then a map lookup and an atomic
+ * load: no file I/O and no parsing. Readers keep the tree they got for as
+ * long as they hold it.
+ * Polling is used instead of inotify because it also sees files replaced
+ * by rename and files on network mounts. When a changed file cannot be
+ * read or parsed, for example a config caught halfway through a deploy,
+ * the previous tree stays published and the next change is tried again.
+ */
+using DocumentPtr = std::shared_ptr<const Value>;
+
+struct DocumentStats {
+  // gets answered with a tree from the cache, and those that loaded the
+  // file, whatever came of it
+  size_t hits = 0;
+  size_t misses = 0;
+  // gets answered from the cache with the error of a file that no version
+  // of could be loaded yet
+  size_t errors = 0;
+  // new trees published by the background thread
+  size_t reloads = 0;
+  // changes that could not be read or parsed
+  size_t failures = 0;
+  // of the last load or reload
+  Status lastStatus = Status::PARSE_OK;
+  // read, parse and publish of a reload, the last one and the slowest
+  std::uint64_t lastReloadNs = 0;
+  std::uint64_t maxReloadNs = 0;
+};
+
+class DocumentCache {
+ public:
+  explicit DocumentCache(
+      std::chrono::milliseconds interval = std::chrono::seconds(1));
+  ~DocumentCache();
+  DocumentCache(const DocumentCache&) = delete;
+  DocumentCache& operator=(const DocumentCache&) = delete;
+
+  // PARSE_OK with the current tree of the file at path. Before any version
+  // of the file could be loaded: nullptr, and the parse status or
+  // CACHE_IO_ERROR.
+  Status get(const string& path, DocumentPtr& doc);
+  // zeros for a path never asked for
+  DocumentStats stats(const string& path) const;
+  // checks every file now, on the calling thread; the background thread
+  // does the same once per interval
+  void refresh();
+
+ private:
+  // what stat tells about a file, all zero when it is missing
+  struct Stamp {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    bool operator==(const Stamp& o) const;
+  };
+
+  struct Entry {
+    DocumentPtr doc;
+    // only touched by whoever loads the file: the first get, then refresh
+    Stamp stamp;
+    std::atomic<Status> status{Status::PARSE_OK};
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> errors{0};
+    std::atomic<size_t> reloads{0};
+    std::atomic<size_t> failures{0};
+    std::atomic<std::uint64_t> lastReloadNs{0};
+    std::atomic<std::uint64_t> maxReloadNs{0};
+  };
+
+  static Stamp statFile(const string& path);
+  static Status load(const string& path, Context& context, Stamp& stamp,
+                     DocumentPtr& doc);
+  void poll();
+
+  // entries are never removed, so they can be used outside the lock
+  mutable std::shared_mutex mutex;
+  std::unordered_map<string, std::unique_ptr<Entry>> entries;
+  // one refresh at a time, and the Context it parses with
+  std::mutex refreshMutex;
+  Context context;
+
+  std::chrono::milliseconds interval;
+  std::mutex stopMutex;
+  std::condition_variable stopped;
+  bool stopping = false;
+  std::thread poller;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_CACHE*/
@@ -0,0 +1,132 @@
+#include "yjson_memory.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace yph {
+
+/*MEMORY USAGE*/
+// short strings keep their text inside the object itself
+static bool onHeap(const string& s) {
+  auto self = reinterpret_cast<const char*>(&s);
+  std::less<const char*> less;
+  return less(s.data(), self) || !less(s.data(), self + sizeof(s));
+}
+
+static void countString(const string& s, size_t& used, size_t& slack) {
+  if (onHeap(s)) {
+    used += s.size() + 1;
+    slack += s.capacity() - s.size();
+  }
+}
+
+template <typename T>
+static void countVector(const vector<T>& elements, size_t& used,
+                        size_t& slack) {
+  used += elements.size() * sizeof(T);
+  slack += (elements.capacity() - elements.size()) * sizeof(T);
+}
+
+static void addUsage(const Value& v, MemoryUsage& usage) {
+  switch (v.type) {
+    case Type::NUMBER: {
+      if (auto text = std::get_if<string>(&v.data)) {
+        countString(*text, usage.numbers, usage.slack);
+      }
+      break;
+    }
+    case Type::STRING: {
+      countString(std::get<string>(v.data), usage.strings, usage.slack);
+      break;
+    }
+    case Type::ARRAY: {
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        countVector(*numbers, usage.numbers, usage.slack);
+        break;
+      }
+      auto& elements = std::get<vector<Value>>(v.data);
+      countVector(elements, usage.nodes, usage.slack);
+      for (auto& x : elements) {
+        addUsage(x, usage);
+      }
+      break;
+    }
+    case Type::OBJECT: {
+      auto& entries = std::get<vector<Entry>>(v.data);
+      countVector(entries, usage.nodes, usage.slack);
+      for (auto& x : entries) {
+        countString(x.key, usage.keys, usage.slack);
+        addUsage(x.val, usage);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+MemoryUsage memoryUsage(const Value& v) {
+  MemoryUsage usage;
+  addUsage(v, usage);
+  return usage;
+}
+
+/*COMPACTION*/
+// a fresh allocation of exactly the length, even when there is no slack,
+// so that the text lands next to its container
+static void compactString(string& s) {
+  if (onHeap(s)) {
+    string(s).swap(s);
+  }
+}
+
+template <typename T>
+static void compactVector(vector<T>& elements) {
+  vector<T> exact;
+  exact.reserve(elements.size());
+  std::move(elements.begin(), elements.end(), std::back_inserter(exact));
+  elements.swap(exact);
+}
+
+void compact(Value& v) {
+  switch (v.type) {
+    case Type::NUMBER: {
+      if (auto text = std::get_if<string>(&v.data)) {
+        compactString(*text);
+      }
+      break;
+    }
+    case Type::STRING: {
+      compactString(std::get<string>(v.data));
+      break;
+    }
+    case Type::ARRAY: {
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        compactVector(*numbers);
+        break;
+      }
+      auto& elements = std::get<vector<Value>>(v.data);
+      compactVector(elements);
+      for (auto& x : elements) {
+        compact(x);
+      }
+      break;
+    }
+    case Type::OBJECT: {
+      auto& entries = std::get<vector<Entry>>(v.data);
+      compactVector(entries);
+      for (auto& x : entries) {
+        compactString(x.key);
+        compact(x.val);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+}  // namespace yph
@@ -0,0 +1,43 @@
+#ifndef YJSON_MEMORY_H__
+#define YJSON_MEMORY_H__
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Heap accounting for Value trees, for caches that keep many documents
+ * under a memory budget. A parse sizes every container below the root
+ * exactly, moving its children out of per-depth scratch vectors; slack
+ * comes from the root's push_back growth, strings grown in place, trees
+ * reused by later parses, setters and patches. compact gives it back.
+ * Byte counts are what the tree asked the allocator for. The allocator's
+ * own headers and rounding are not included, and neither is the root
+ * Value, which lives wherever the caller put it.
+ */
+struct MemoryUsage {
+  // slots in use in the vectors of arrays (Value) and objects (Entry)
+  size_t nodes = 0;
+  // heap text of string values and of keys, terminator included; short
+  // strings are stored inline and cost nothing here
+  size_t strings = 0;
+  size_t keys = 0;
+  // packed arrays and lazy numbers too long for RawNumber
+  size_t numbers = 0;
+  // allocated and unused: vector capacity past the size, string capacity
+  // past the length
+  size_t slack = 0;
+
+  size_t total() const { return nodes + strings + keys + numbers + slack; }
+};
+
+MemoryUsage memoryUsage(const Value& v);
+
+// Rebuild every vector and heap string below v at exactly its size, each
+// container allocated right before its children, in document order. The
+// tree stays equal, hashes included; nodes move, so pointers into it do
+// not survive.
+void compact(Value& v);
+
+}  // namespace yph
+
+#endif /*YJSON_MEMORY*/
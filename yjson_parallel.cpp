@@ -0,0 +1,479 @@
+#include "yjson_parallel.h"
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+namespace yph {
+namespace {
+struct Span {
+  const char* begin;
+  const char* end;
+};
+
+bool isBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+const char* skipBlank(const char* p, const char* end) {
+  while (p < end && isBlank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Boundaries of the children of the container opening at open. Only quotes
+// and brackets are looked at, the children themselves are checked when they
+// are parsed. False when the container is not closed before end.
+bool splitChildren(const char* open, const char* end, vector<Span>& children,
+                   const char*& close) {
+  size_t depth = 0;
+  const char* start = open + 1;
+  for (const char* p = open + 1; p < end; p++) {
+    switch (*p) {
+      case '\"': {
+        // the closing quote is the first one after an even run of '\'
+        for (;;) {
+          p = static_cast<const char*>(memchr(p + 1, '\"', end - p - 1));
+          if (p == nullptr) {
+            return false;
+          }
+          const char* q = p;
+          while (*(q - 1) == '\\') {
+            q--;
+          }
+          if ((p - q) % 2 == 0) {
+            break;
+          }
+        }
+        break;
+      }
+      case '[':
+      case '{': {
+        depth++;
+        break;
+      }
+      case ']':
+      case '}': {
+        if (depth == 0) {
+          children.push_back({start, p});
+          close = p;
+          return true;
+        }
+        depth--;
+        break;
+      }
+      case ',': {
+        if (depth == 0) {
+          children.push_back({start, p});
+          start = p + 1;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
+class ParallelParser {
+ public:
+  ParallelParser(unsigned threads, const ParallelOptions& options)
+      : threads(threads),
+        minChunkBytes(std::max<size_t>(options.minChunkBytes, 1)),
+        maxDepth(options.maxDepth),
+        lazyNumbers(options.lazyNumbers),
+        packedArrays(options.packedArrays) {}
+
+  // false when json has to be parsed serially to get the error
+  bool parse(Value& v, std::string_view json) {
+    const char* end = json.data() + json.size();
+    const char* p = skipBlank(json.data(), end);
+    const char* close = nullptr;
+    return p != end && (*p == '[' || *p == '{') &&
+           parseContainer(v, p, end, 0, close) &&
+           skipBlank(close + 1, end) == end;
+  }
+
+ private:
+  // parse the container opening at open and nested level containers deep
+  bool parseContainer(Value& v, const char* open, const char* end,
+                      size_t level, const char*& close) {
+    vector<Span> children;
+    if (level >= maxDepth || !splitChildren(open, end, children, close) ||
+        *close != (*open == '[' ? ']' : '}')) {
+      return false;
+    }
+    if (*open == '[') {
+      vector<Value> elements;
+      if (!parseChildren(elements, children, level)) {
+        return false;
+      }
+      // numbers only: packed, as the serial parser reads such an array
+      bool pack = packedArrays && !lazyNumbers && !elements.empty() &&
+                  std::all_of(elements.begin(), elements.end(),
+                              [](const Value& x) {
+                                return x.type == Type::NUMBER;
+                              });
+      if (pack) {
+        vector<double> numbers;
+        numbers.reserve(elements.size());
+        for (auto& x : elements) {
+          numbers.push_back(std::get<double>(x.data));
+        }
+        v.data = std::move(numbers);
+      } else {
+        v.data = std::move(elements);
+      }
+      v.type = Type::ARRAY;
+      invalidateHash(v);
+    } else {
+      vector<Entry> entries;
+      if (!parseChildren(entries, children, level)) {
+        return false;
+      }
+      v.data = std::move(entries);
+      v.type = Type::OBJECT;
+      invalidateHash(v);
+    }
+    return true;
+  }
+
+  template <typename T>
+  bool parseChildren(vector<T>& out, const vector<Span>& children,
+                     size_t level) {
+    if (children.size() == 1 &&
+        skipBlank(children[0].begin, children[0].end) == children[0].end) {
+      return true;  // empty container
+    }
+    out.resize(children.size());
+    size_t total = children.back().end - children.front().begin;
+
+    // too few children to keep every thread busy: split the one holding
+    // most of the bytes one level down and parse the rest here
+    if (level == 0 && children.size() < threads) {
+      auto size = [](const Span& s) { return s.end - s.begin; };
+      auto largest = std::max_element(
+          children.begin(), children.end(),
+          [&](const Span& a, const Span& b) { return size(a) < size(b); });
+      if (static_cast<size_t>(size(*largest)) * 2 >= total) {
+        Context context;
+        context.setMaxDepth(maxDepth - level - 1);
+        context.setLazyNumbers(lazyNumbers);
+        context.setPackedArrays(packedArrays);
+        for (size_t i = 0; i < children.size(); i++) {
+          bool split = children.begin() + i == largest;
+          if (!parseChild(context, out[i], children[i], level, split)) {
+            return false;
+          }
+        }
+        return true;
+      }
+    }
+
+    // contiguous ranges of about the same number of bytes per thread
+    size_t n = std::min<size_t>(
+        {threads, children.size(), std::max<size_t>(total / minChunkBytes, 1)});
+    vector<size_t> bounds{0};
+    for (size_t i = 0; i < children.size() && bounds.size() < n; i++) {
+      size_t done = children[i].end - children.front().begin;
+      if (done >= total * bounds.size() / n) {
+        bounds.push_back(i + 1);
+      }
+    }
+    bounds.push_back(children.size());
+
+    std::atomic<bool> failed{false};
+    auto work = [&](size_t from, size_t to) {
+      Context context;
+      context.setMaxDepth(maxDepth - level - 1);
+      context.setLazyNumbers(lazyNumbers);
+      context.setPackedArrays(packedArrays);
+      for (size_t i = from; i < to; i++) {
+        if (failed.load(std::memory_order_relaxed)) {
+          return;
+        }
+        if (!parseChild(context, out[i], children[i], level, false)) {
+          failed.store(true, std::memory_order_relaxed);
+          return;
+        }
+      }
+    };
+    vector<std::thread> workers;
+    for (size_t k = 1; k + 1 < bounds.size(); k++) {
+      workers.emplace_back(work, bounds[k], bounds[k + 1]);
+    }
+    work(bounds[0], bounds[1]);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    return !failed.load();
+  }
+
+  // the span must hold exactly one value, padded with whitespace
+  bool parseChild(Context& context, Value& v, Span s, size_t level,
+                  bool split) {
+    const char* p = skipBlank(s.begin, s.end);
+    const char* stop = nullptr;
+    if (split && p != s.end && (*p == '[' || *p == '{')) {
+      if (!parseContainer(v, p, s.end, level + 1, stop)) {
+        return false;
+      }
+      stop++;
+    } else {
+      std::string_view json(p, s.end - p);
+      if (context.parseValue(v, json) != Status::PARSE_OK) {
+        return false;
+      }
+      stop = p + context.position();
+    }
+    return skipBlank(stop, s.end) == s.end;
+  }
+
+  bool parseChild(Context& context, Entry& e, Span s, size_t level,
+                  bool split) {
+    const char* p = skipBlank(s.begin, s.end);
+    // the key goes through the value parser, then moves into place
+    if (p == s.end || *p != '\"' ||
+        context.parseValue(e.val, std::string_view(p, s.end - p)) !=
+            Status::PARSE_OK) {
+      return false;
+    }
+    e.key = std::move(std::get<string>(e.val.data));
+    p = skipBlank(p + context.position(), s.end);
+    if (p == s.end || *p != ':') {
+      return false;
+    }
+    return parseChild(context, e.val, {p + 1, s.end}, level, split);
+  }
+
+  size_t threads;
+  size_t minChunkBytes;
+  size_t maxDepth;
+  bool lazyNumbers;
+  bool packedArrays;
+};
+
+class ParallelWriter {
+ public:
+  ParallelWriter(unsigned threads, const ParallelOptions& options)
+      : threads(threads),
+        minChunkChildren(std::max<size_t>(options.minChunkChildren, 1)) {}
+
+  void write(const Value& v, vector<string>& chunks) {
+    chunks.emplace_back();
+    writeValue(v, 0, chunks);
+  }
+
+ private:
+  static size_t childCount(const Value& v) {
+    if (auto elements = std::get_if<vector<Value>>(&v.data)) {
+      return v.type == Type::ARRAY ? elements->size() : 0;
+    }
+    if (auto entries = std::get_if<vector<Entry>>(&v.data)) {
+      return v.type == Type::OBJECT ? entries->size() : 0;
+    }
+    return 0;
+  }
+
+  static void writeChild(const Value& v, string& s) { stringifyValue(v, s); }
+
+  static void writeChild(const Entry& e, string& s) {
+    stringifyString(e.key, s);
+    s.push_back(':');
+    stringifyValue(e.val, s);
+  }
+
+  // appends v to chunks.back(), big containers add chunks of their own
+  void writeValue(const Value& v, size_t level, vector<string>& chunks) {
+    if (auto elements = std::get_if<vector<Value>>(&v.data);
+        elements && v.type == Type::ARRAY) {
+      writeContainer(*elements, '[', ']', level, chunks);
+    } else if (v.type == Type::OBJECT) {
+      writeContainer(std::get<vector<Entry>>(v.data), '{', '}', level, chunks);
+    } else {
+      stringifyValue(v, chunks.back());
+    }
+  }
+
+  template <typename T>
+  void writeContainer(const vector<T>& children, char open, char close,
+                      size_t level, vector<string>& chunks) {
+    size_t n = children.size();
+    size_t ranges = std::min<size_t>(n / minChunkChildren, threads * 4);
+    chunks.back().push_back(open);
+
+    // too few children to keep every thread busy: cut the biggest one
+    if (level == 0 && n < threads) {
+      size_t largest = 0;
+      for (size_t i = 1; i < n; i++) {
+        if (childCount(valueOf(children[i])) >
+            childCount(valueOf(children[largest]))) {
+          largest = i;
+        }
+      }
+      if (n > 0 &&
+          childCount(valueOf(children[largest])) >= 2 * minChunkChildren) {
+        for (size_t i = 0; i < n; i++) {
+          if (i > 0) {
+            chunks.back().push_back(',');
+          }
+          if (i != largest) {
+            writeChild(children[i], chunks.back());
+            continue;
+          }
+          if constexpr (std::is_same_v<T, Entry>) {
+            stringifyString(children[i].key, chunks.back());
+            chunks.back().push_back(':');
+          }
+          writeValue(valueOf(children[i]), level + 1, chunks);
+        }
+        chunks.back().push_back(close);
+        return;
+      }
+    }
+
+    if (ranges < 2) {
+      for (size_t i = 0; i < n; i++) {
+        if (i > 0) {
+          chunks.back().push_back(',');
+        }
+        writeChild(children[i], chunks.back());
+      }
+      chunks.back().push_back(close);
+      return;
+    }
+
+    // more ranges than threads so that uneven ranges balance out
+    size_t base = chunks.size();
+    chunks.resize(base + ranges);
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+      for (size_t r; (r = next.fetch_add(1)) < ranges;) {
+        string& out = chunks[base + r];
+        for (size_t i = n * r / ranges; i < n * (r + 1) / ranges; i++) {
+          if (i > 0) {
+            out.push_back(',');
+          }
+          writeChild(children[i], out);
+        }
+      }
+    };
+    vector<std::thread> workers;
+    for (size_t k = 1; k < std::min<size_t>(threads, ranges); k++) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    chunks.back().push_back(close);
+  }
+
+  static const Value& valueOf(const Value& v) { return v; }
+  static const Value& valueOf(const Entry& e) { return e.val; }
+
+  size_t threads;
+  size_t minChunkChildren;
+};
+
+// writev in batches of IOV_MAX, resuming after partial writes
+bool writeChunks(int fd, const vector<string>& chunks) {
+  vector<iovec> iov;
+  for (auto& chunk : chunks) {
+    if (!chunk.empty()) {
+      iov.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+    }
+  }
+  size_t i = 0;
+  while (i < iov.size()) {
+    int count = static_cast<int>(std::min<size_t>(iov.size() - i, IOV_MAX));
+    ssize_t written = writev(fd, &iov[i], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    size_t left = static_cast<size_t>(written);
+    while (i < iov.size() && left >= iov[i].iov_len) {
+      left -= iov[i].iov_len;
+      i++;
+    }
+    if (left > 0) {
+      iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + left;
+      iov[i].iov_len -= left;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+static unsigned threadCount(const ParallelOptions& options) {
+  unsigned threads = options.threads ? options.threads
+                                     : std::thread::hardware_concurrency();
+  return std::max(threads, 1u);
+}
+
+/*YJSON PARALLEL PARSER*/
+Status parseParallel(Value& v, std::string_view json,
+                     const ParallelOptions& options) {
+  unsigned threads = threadCount(options);
+  if (threads > 1 && json.size() >= 2 * options.minChunkBytes &&
+      ParallelParser(threads, options).parse(v, json)) {
+    return Status::PARSE_OK;
+  }
+  Context context;
+  context.setMaxDepth(options.maxDepth);
+  context.setLazyNumbers(options.lazyNumbers);
+  context.setPackedArrays(options.packedArrays);
+  return context.parse(v, json);
+}
+
+Status parseParallel(ValuePtr v, std::string_view json,
+                     const ParallelOptions& options) {
+  if (!v) {
+    return Status::PARSE_NULL_POINTER;
+  }
+  return parseParallel(*v, json, options);
+}
+
+/*YJSON PARALLEL GENERATOR*/
+Status stringifyParallel(const Value& v, vector<string>& chunks,
+                         const ParallelOptions& options) {
+  chunks.clear();
+  ParallelWriter(threadCount(options), options).write(v, chunks);
+  return Status::STRINGIFY_OK;
+}
+
+Status stringifyParallel(const ValuePtr v, std::shared_ptr<string> s,
+                         const ParallelOptions& options) {
+  vector<string> chunks;
+  stringifyParallel(*v, chunks, options);
+  size_t size = s->size();
+  for (auto& chunk : chunks) {
+    size += chunk.size();
+  }
+  s->reserve(size);
+  for (auto& chunk : chunks) {
+    s->append(chunk);
+  }
+  return Status::STRINGIFY_OK;
+}
+
+Status stringifyParallel(const ValuePtr v, int fd,
+                         const ParallelOptions& options) {
+  vector<string> chunks;
+  stringifyParallel(*v, chunks, options);
+  return writeChunks(fd, chunks) ? Status::STRINGIFY_OK
+                                 : Status::STRINGIFY_IO_ERROR;
+}
+
+}  // namespace yph
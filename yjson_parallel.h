@@ -0,0 +1,56 @@
+#ifndef YJSON_PARALLEL_H__
+#define YJSON_PARALLEL_H__
+
+#include <string_view>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Multi-threaded parse of one large top-level array or object.
+ * A quick structural scan finds the boundaries of the top-level children,
+ * which are then parsed on several threads straight into the preallocated
+ * slots of the result. When the top level has fewer children than threads
+ * and one of them holds most of the bytes (say {"data": [...]}), that child
+ * is split one level down instead.
+ * The result and the status are the same as for a serial parse: on any
+ * error the document is parsed again serially, which stops at the first
+ * error in document order.
+ */
+struct ParallelOptions {
+  // 0: std::thread::hardware_concurrency()
+  unsigned threads = 0;
+  // smaller spans are not worth a thread of their own
+  size_t minChunkBytes = size_t(1) << 20;
+  size_t maxDepth = kDefaultMaxDepth;
+  // see Context::setLazyNumbers
+  bool lazyNumbers = false;
+  // see Context::setPackedArrays
+  bool packedArrays = false;
+  // stringify: containers are cut into ranges of at least this many children
+  size_t minChunkChildren = 1024;
+};
+
+Status parseParallel(Value& v, std::string_view json,
+                     const ParallelOptions& options = ParallelOptions());
+Status parseParallel(ValuePtr v, std::string_view json,
+                     const ParallelOptions& options = ParallelOptions());
+
+/*
+ * Multi-threaded stringify. Big containers (the top level, or its largest
+ * child when the top level is small) are cut into ranges of children that
+ * are written on several threads into separate chunks. The chunks in order
+ * are byte for byte the output of stringify.
+ */
+Status stringifyParallel(const Value& v, vector<string>& chunks,
+                         const ParallelOptions& options = ParallelOptions());
+// appends the joined chunks to s
+Status stringifyParallel(const ValuePtr v, std::shared_ptr<string> s,
+                         const ParallelOptions& options = ParallelOptions());
+// writes the chunks with writev, without joining them first
+Status stringifyParallel(const ValuePtr v, int fd,
+                         const ParallelOptions& options = ParallelOptions());
+
+}  // namespace yph
+
+#endif /*YJSON_PARALLEL*/
@@ -0,0 +1,623 @@
+#include "yjson_patch.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace yph {
+namespace {
+/*JSON POINTER*/
+// unescape the reference token at the front of rest, which starts at a '/'
+bool nextToken(std::string_view& rest, string& token) {
+  size_t end = rest.find('/', 1);
+  std::string_view raw = rest.substr(1, end == rest.npos ? end : end - 1);
+  rest = end == rest.npos ? std::string_view() : rest.substr(end);
+  token.clear();
+  for (size_t i = 0; i < raw.size(); i++) {
+    if (raw[i] != '~') {
+      token.push_back(raw[i]);
+      continue;
+    }
+    if (i + 1 == raw.size() || (raw[i + 1] != '0' && raw[i + 1] != '1')) {
+      return false;
+    }
+    token.push_back(raw[++i] == '0' ? '~' : '/');
+  }
+  return true;
+}
+
+vector<Entry>::iterator findMember(vector<Entry>& entries, const string& key) {
+  return std::find_if(entries.begin(), entries.end(),
+                      [&](const Entry& e) { return e.key == key; });
+}
+
+// elements of a packed array are only addressable once it is unpacked
+Value* child(Value& v, const string& token, bool unpack) {
+  if (v.type == Type::OBJECT) {
+    auto& entries = std::get<vector<Entry>>(v.data);
+    auto it = findMember(entries, token);
+    return it == entries.end() ? nullptr : &it->val;
+  }
+  if (v.type == Type::ARRAY) {
+    if (!unpack && std::holds_alternative<vector<double>>(v.data)) {
+      return nullptr;
+    }
+    unpackArray(v);
+    auto& elements = std::get<vector<Value>>(v.data);
+    size_t index = 0;
+    return pointerIndex(token, elements.size(), false, index) ? &elements[index]
+                                                            : nullptr;
+  }
+  return nullptr;
+}
+
+// node at pointer; when the tree is about to change below it, the hash
+// cache of every node passed (the target included) is reset
+Value* walk(Value& root, std::string_view pointer, bool invalidate,
+            Status& status, bool unpack = true) {
+  status = Status::PATCH_OK;
+  if (!pointer.empty() && pointer[0] != '/') {
+    status = Status::PATCH_INVALID_POINTER;
+    return nullptr;
+  }
+  Value* v = &root;
+  string token;
+  while (!pointer.empty()) {
+    if (invalidate) {
+      invalidateHash(*v);
+    }
+    if (!nextToken(pointer, token)) {
+      status = Status::PATCH_INVALID_POINTER;
+      return nullptr;
+    }
+    if ((v = child(*v, token, unpack)) == nullptr) {
+      status = Status::PATCH_PATH_NOT_FOUND;
+      return nullptr;
+    }
+  }
+  if (invalidate) {
+    invalidateHash(*v);
+  }
+  return v;
+}
+
+// walk for reading: packed arrays stay packed, an element of one is copied
+// into element and returned from there
+const Value* lookup(const Value& root, std::string_view pointer,
+                    Value& element, Status& status) {
+  status = Status::PATCH_OK;
+  if (!pointer.empty() && pointer[0] != '/') {
+    status = Status::PATCH_INVALID_POINTER;
+    return nullptr;
+  }
+  // child only writes when unpacking
+  Value* v = const_cast<Value*>(&root);
+  string token;
+  while (!pointer.empty()) {
+    if (!nextToken(pointer, token)) {
+      status = Status::PATCH_INVALID_POINTER;
+      return nullptr;
+    }
+    auto numbers = std::get_if<vector<double>>(&v->data);
+    size_t index = 0;
+    if (numbers && v->type == Type::ARRAY && pointer.empty() &&
+        pointerIndex(token, numbers->size(), false, index)) {
+      element.data = (*numbers)[index];
+      element.type = Type::NUMBER;
+      return &element;
+    }
+    if ((v = child(*v, token, false)) == nullptr) {
+      status = Status::PATCH_PATH_NOT_FOUND;
+      return nullptr;
+    }
+  }
+  return v;
+}
+
+const Value* member(const Value& v, const char* key) {
+  for (const auto& e : std::get<vector<Entry>>(v.data)) {
+    if (e.key == key) {
+      return &e.val;
+    }
+  }
+  return nullptr;
+}
+
+const string* stringMember(const Value& v, const char* key) {
+  const Value* m = member(v, key);
+  return m && m->type == Type::STRING ? &std::get<string>(m->data) : nullptr;
+}
+
+/*JSON PATCH*/
+// how to take back one step of an operation, replayed in reverse order
+struct Undo {
+  enum class Kind {
+    RESTORE,  // put value back at path
+    ERASE,    // drop child index of the container at path
+    INSERT,   // put value (and key) back as child index of path
+  };
+  Kind kind;
+  string path;
+  size_t index;
+  string key;
+  Value value;
+  // INSERT of a moved value: it is the one the previous undo took out
+  bool fromCarry;
+};
+
+class Patcher {
+ public:
+  explicit Patcher(Value& doc) : doc(doc) {}
+
+  Status apply(const Value& op) {
+    const string* name = stringMember(op, "op");
+    const string* path = stringMember(op, "path");
+    const Value* value = member(op, "value");
+    const string* from = stringMember(op, "from");
+    if (name == nullptr || path == nullptr) {
+      return Status::PATCH_INVALID_OPERATION;
+    }
+    if (*name == "add" || *name == "replace" || *name == "test") {
+      if (value == nullptr) {
+        return Status::PATCH_INVALID_OPERATION;
+      }
+      if (*name == "test") {
+        Status status;
+        Value element;
+        const Value* target = lookup(doc, *path, element, status);
+        if (target == nullptr) {
+          return status;
+        }
+        return *target == *value ? Status::PATCH_OK : Status::PATCH_TEST_FAILED;
+      }
+      Value copy = *value;
+      return *name == "add" ? add(*path, std::move(copy))
+                            : replace(*path, std::move(copy));
+    }
+    if (*name == "remove") {
+      return remove(*path, nullptr);
+    }
+    if ((*name != "move" && *name != "copy") || from == nullptr) {
+      return Status::PATCH_INVALID_OPERATION;
+    }
+    Value moved;
+    if (*name == "copy") {
+      Status status;
+      Value element;
+      const Value* source = lookup(doc, *from, element, status);
+      if (source == nullptr) {
+        return status;
+      }
+      moved = *source;
+      return add(*path, std::move(moved));
+    }
+    if (*path == *from) {
+      return Status::PATCH_OK;
+    }
+    // a node cannot move into its own subtree
+    if (path->size() > from->size() &&
+        path->compare(0, from->size(), *from) == 0 &&
+        (*path)[from->size()] == '/') {
+      return Status::PATCH_INVALID_OPERATION;
+    }
+    if (Status status = remove(*from, &moved); status != Status::PATCH_OK) {
+      return status;
+    }
+    Status status = add(*path, std::move(moved));
+    if (status != Status::PATCH_OK) {
+      // the undo of remove cannot count on add's any more
+      log.back().value = std::move(moved);
+      log.back().fromCarry = false;
+    }
+    return status;
+  }
+
+  void rollback() {
+    Value carry;
+    Status status;
+    for (auto it = log.rbegin(); it != log.rend(); ++it) {
+      // the tree is back in the state right after this step
+      Value* target = walk(doc, it->path, true, status);
+      assert(target != nullptr);
+      unpackArray(*target);
+      switch (it->kind) {
+        case Undo::Kind::RESTORE: {
+          carry = std::move(*target);
+          *target = std::move(it->value);
+          break;
+        }
+        case Undo::Kind::ERASE: {
+          if (target->type == Type::ARRAY) {
+            auto& elements = std::get<vector<Value>>(target->data);
+            carry = std::move(elements[it->index]);
+            elements.erase(elements.begin() + it->index);
+          } else {
+            auto& entries = std::get<vector<Entry>>(target->data);
+            carry = std::move(entries[it->index].val);
+            entries.erase(entries.begin() + it->index);
+          }
+          break;
+        }
+        case Undo::Kind::INSERT: {
+          Value& v = it->fromCarry ? carry : it->value;
+          if (target->type == Type::ARRAY) {
+            auto& elements = std::get<vector<Value>>(target->data);
+            elements.insert(elements.begin() + it->index, std::move(v));
+          } else {
+            auto& entries = std::get<vector<Entry>>(target->data);
+            entries.insert(entries.begin() + it->index,
+                           Entry{std::move(it->key), std::move(v)});
+          }
+          break;
+        }
+      }
+    }
+    log.clear();
+  }
+
+ private:
+  // container of the node at path, which need not exist yet
+  Status parentOf(std::string_view path, Value*& container,
+                  std::string_view& parentPath, string& key) {
+    size_t slash = path.rfind('/');
+    if (slash == path.npos) {
+      return Status::PATCH_INVALID_POINTER;
+    }
+    parentPath = path.substr(0, slash);
+    Status status;
+    if ((container = walk(doc, parentPath, true, status)) == nullptr) {
+      return status;
+    }
+    unpackArray(*container);
+    std::string_view last = path.substr(slash);
+    return nextToken(last, key) ? Status::PATCH_OK
+                                : Status::PATCH_INVALID_POINTER;
+  }
+
+  // value is only moved from on success
+  Status add(std::string_view path, Value&& value) {
+    if (path.empty()) {
+      log.push_back({Undo::Kind::RESTORE, "", 0, "", std::move(doc), false});
+      doc = std::move(value);
+      return Status::PATCH_OK;
+    }
+    Value* container = nullptr;
+    std::string_view parentPath;
+    string key;
+    if (Status status = parentOf(path, container, parentPath, key);
+        status != Status::PATCH_OK) {
+      return status;
+    }
+    if (container->type == Type::OBJECT) {
+      auto& entries = std::get<vector<Entry>>(container->data);
+      auto it = findMember(entries, key);
+      if (it != entries.end()) {
+        log.push_back({Undo::Kind::RESTORE, string(path), 0, "",
+                       std::move(it->val), false});
+        it->val = std::move(value);
+      } else {
+        entries.push_back({std::move(key), std::move(value)});
+        log.push_back({Undo::Kind::ERASE, string(parentPath),
+                       entries.size() - 1, "", Value(), false});
+      }
+      return Status::PATCH_OK;
+    }
+    if (container->type == Type::ARRAY) {
+      auto& elements = std::get<vector<Value>>(container->data);
+      size_t index = 0;
+      if (!pointerIndex(key, elements.size(), true, index)) {
+        return Status::PATCH_PATH_NOT_FOUND;
+      }
+      elements.insert(elements.begin() + index, std::move(value));
+      log.push_back(
+          {Undo::Kind::ERASE, string(parentPath), index, "", Value(), false});
+      return Status::PATCH_OK;
+    }
+    return Status::PATCH_PATH_NOT_FOUND;
+  }
+
+  // the removed node goes to *moved when it is added elsewhere next
+  Status remove(std::string_view path, Value* moved) {
+    if (path.empty()) {
+      log.push_back({Undo::Kind::RESTORE, "", 0, "", std::move(doc), false});
+      doc = Value();
+      return Status::PATCH_OK;
+    }
+    Value* container = nullptr;
+    std::string_view parentPath;
+    string key;
+    if (Status status = parentOf(path, container, parentPath, key);
+        status != Status::PATCH_OK) {
+      return status;
+    }
+    Undo undo{Undo::Kind::INSERT, string(parentPath), 0, "", Value(),
+              moved != nullptr};
+    Value* target = nullptr;
+    if (container->type == Type::OBJECT) {
+      auto& entries = std::get<vector<Entry>>(container->data);
+      auto it = findMember(entries, key);
+      if (it == entries.end()) {
+        return Status::PATCH_PATH_NOT_FOUND;
+      }
+      undo.index = it - entries.begin();
+      target = &it->val;
+    } else if (container->type == Type::ARRAY) {
+      auto& elements = std::get<vector<Value>>(container->data);
+      if (!pointerIndex(key, elements.size(), false, undo.index)) {
+        return Status::PATCH_PATH_NOT_FOUND;
+      }
+      target = &elements[undo.index];
+    } else {
+      return Status::PATCH_PATH_NOT_FOUND;
+    }
+    (moved ? *moved : undo.value) = std::move(*target);
+    if (container->type == Type::OBJECT) {
+      auto& entries = std::get<vector<Entry>>(container->data);
+      undo.key = std::move(entries[undo.index].key);
+      entries.erase(entries.begin() + undo.index);
+    } else {
+      auto& elements = std::get<vector<Value>>(container->data);
+      elements.erase(elements.begin() + undo.index);
+    }
+    log.push_back(std::move(undo));
+    return Status::PATCH_OK;
+  }
+
+  Status replace(std::string_view path, Value&& value) {
+    Status status;
+    Value* target = walk(doc, path, true, status);
+    if (target == nullptr) {
+      return status;
+    }
+    log.push_back({Undo::Kind::RESTORE, string(path), 0, "",
+                   std::move(*target), false});
+    *target = std::move(value);
+    return Status::PATCH_OK;
+  }
+
+  Value& doc;
+  vector<Undo> log;
+};
+
+/*JSON MERGE PATCH*/
+void mergePatch(Value& target, const Value& patch) {
+  invalidateHash(target);
+  if (patch.type != Type::OBJECT) {
+    target = patch;
+    return;
+  }
+  if (target.type != Type::OBJECT) {
+    target.data = vector<Entry>();
+    target.type = Type::OBJECT;
+  }
+  auto& entries = std::get<vector<Entry>>(target.data);
+  for (const auto& m : std::get<vector<Entry>>(patch.data)) {
+    auto it = findMember(entries, m.key);
+    if (m.val.type == Type::NVLL) {
+      if (it != entries.end()) {
+        entries.erase(it);
+      }
+      continue;
+    }
+    if (it == entries.end()) {
+      entries.push_back({m.key, Value()});
+      it = entries.end() - 1;
+    }
+    mergePatch(it->val, m.val);
+  }
+}
+
+/*JSON DIFF*/
+bool same(const Value& a, const Value& b) {
+  return hashValue(a) == hashValue(b) && a == b;
+}
+
+Value stringValue(string str) {
+  Value v(Type::STRING);
+  v.data = std::move(str);
+  return v;
+}
+
+string childPath(const string& path, std::string_view token) {
+  string out = path + "/";
+  for (char ch : token) {
+    if (ch == '~') {
+      out += "~0";
+    } else if (ch == '/') {
+      out += "~1";
+    } else {
+      out.push_back(ch);
+    }
+  }
+  return out;
+}
+
+void addOp(vector<Value>& ops, const char* op, const string& path,
+           const Value* value) {
+  vector<Entry> entries;
+  entries.push_back({"op", stringValue(op)});
+  entries.push_back({"path", stringValue(path)});
+  if (value != nullptr) {
+    entries.push_back({"value", *value});
+  }
+  Value v(Type::OBJECT);
+  v.data = std::move(entries);
+  ops.push_back(std::move(v));
+}
+
+// elements of an array, a packed one is unpacked into scratch first
+const vector<Value>& elementsOf(const Value& v, Value& scratch) {
+  if (std::holds_alternative<vector<double>>(v.data)) {
+    scratch = v;
+    unpackArray(scratch);
+    return std::get<vector<Value>>(scratch.data);
+  }
+  return std::get<vector<Value>>(v.data);
+}
+
+void diffValue(const Value& from, const Value& to, const string& path,
+               vector<Value>& ops) {
+  if (same(from, to)) {
+    return;
+  }
+  if (from.type != to.type ||
+      (from.type != Type::ARRAY && from.type != Type::OBJECT)) {
+    addOp(ops, "replace", path, &to);
+    return;
+  }
+  if (from.type == Type::OBJECT) {
+    auto& a = std::get<vector<Entry>>(from.data);
+    auto& b = std::get<vector<Entry>>(to.data);
+    // first occurrence of every key, as the pointer lookup picks it
+    std::unordered_map<std::string_view, size_t> inA;
+    std::unordered_map<std::string_view, size_t> inB;
+    for (size_t i = 0; i < a.size(); i++) {
+      inA.emplace(a[i].key, i);
+    }
+    for (size_t i = 0; i < b.size(); i++) {
+      inB.emplace(b[i].key, i);
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+      if (inA[a[i].key] != i) {
+        continue;
+      }
+      auto it = inB.find(a[i].key);
+      string member = childPath(path, a[i].key);
+      if (it == inB.end()) {
+        addOp(ops, "remove", member, nullptr);
+      } else {
+        diffValue(a[i].val, b[it->second].val, member, ops);
+      }
+    }
+    for (size_t i = 0; i < b.size(); i++) {
+      if (inA.count(b[i].key) == 0 && inB[b[i].key] == i) {
+        addOp(ops, "add", childPath(path, b[i].key), &b[i].val);
+      }
+    }
+    return;
+  }
+  Value unpackedA;
+  Value unpackedB;
+  auto& a = elementsOf(from, unpackedA);
+  auto& b = elementsOf(to, unpackedB);
+  size_t n = a.size();
+  size_t m = b.size();
+  size_t prefix = 0;
+  size_t suffix = 0;
+  while (prefix < std::min(n, m) && same(a[prefix], b[prefix])) {
+    prefix++;
+  }
+  while (suffix < std::min(n, m) - prefix &&
+         same(a[n - 1 - suffix], b[m - 1 - suffix])) {
+    suffix++;
+  }
+  // the differing middles: edit them pairwise, then drop or append the rest
+  size_t midA = n - prefix - suffix;
+  size_t midB = m - prefix - suffix;
+  size_t common = std::min(midA, midB);
+  for (size_t i = 0; i < common; i++) {
+    diffValue(a[prefix + i], b[prefix + i],
+              childPath(path, std::to_string(prefix + i)), ops);
+  }
+  for (size_t i = midA; i-- > common;) {
+    addOp(ops, "remove", childPath(path, std::to_string(prefix + i)),
+          nullptr);
+  }
+  for (size_t i = common; i < midB; i++) {
+    addOp(ops, "add", childPath(path, std::to_string(prefix + i)),
+          &b[prefix + i]);
+  }
+}
+}  // namespace
+
+/*JSON POINTER*/
+Status parsePointer(std::string_view pointer, vector<string>& tokens) {
+  tokens.clear();
+  if (!pointer.empty() && pointer[0] != '/') {
+    return Status::PATCH_INVALID_POINTER;
+  }
+  while (!pointer.empty()) {
+    tokens.emplace_back();
+    if (!nextToken(pointer, tokens.back())) {
+      return Status::PATCH_INVALID_POINTER;
+    }
+  }
+  return Status::PATCH_OK;
+}
+
+bool pointerIndex(const string& token, size_t size, bool allowEnd,
+                  size_t& index) {
+  if (token == "-") {
+    index = size;
+    return allowEnd;
+  }
+  if (token.empty() || (token[0] == '0' && token.size() > 1)) {
+    return false;
+  }
+  index = 0;
+  for (char ch : token) {
+    if (ch < '0' || ch > '9' || index > size) {
+      return false;
+    }
+    index = index * 10 + (ch - '0');
+  }
+  return index < size || (allowEnd && index == size);
+}
+
+Value* resolvePointer(Value& root, std::string_view pointer) {
+  Status status;
+  return walk(root, pointer, false, status);
+}
+
+const Value* resolvePointer(const Value& root, std::string_view pointer) {
+  // walk only writes when invalidating or unpacking
+  Status status;
+  return walk(const_cast<Value&>(root), pointer, false, status, false);
+}
+
+/*JSON PATCH*/
+Status applyPatch(Value& doc, const Value& patch) {
+  if (patch.type != Type::ARRAY) {
+    return Status::PATCH_INVALID_OPERATION;
+  }
+  Patcher patcher(doc);
+  for (const auto& op : std::get<vector<Value>>(patch.data)) {
+    Status status = op.type == Type::OBJECT ? patcher.apply(op)
+                                            : Status::PATCH_INVALID_OPERATION;
+    if (status != Status::PATCH_OK) {
+      patcher.rollback();
+      return status;
+    }
+  }
+  return Status::PATCH_OK;
+}
+
+Status applyPatch(ValuePtr doc, const ValuePtr patch) {
+  assert(doc != nullptr && patch != nullptr);
+  return applyPatch(*doc, *patch);
+}
+
+Status applyMergePatch(Value& doc, const Value& patch) {
+  mergePatch(doc, patch);
+  return Status::PATCH_OK;
+}
+
+Status applyMergePatch(ValuePtr doc, const ValuePtr patch) {
+  assert(doc != nullptr && patch != nullptr);
+  return applyMergePatch(*doc, *patch);
+}
+
+/*JSON DIFF*/
+Value diff(const Value& from, const Value& to) {
+  vector<Value> ops;
+  diffValue(from, to, "", ops);
+  Value patch(Type::ARRAY);
+  patch.data = std::move(ops);
+  return patch;
+}
+
+ValuePtr diff(const ValuePtr from, const ValuePtr to) {
+  assert(from != nullptr && to != nullptr);
+  return std::make_shared<Value>(diff(*from, *to));
+}
+
+}  // namespace yph
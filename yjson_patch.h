@@ -0,0 +1,49 @@
+#ifndef YJSON_PATCH_H__
+#define YJSON_PATCH_H__
+
+#include <string_view>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * In-place editing of a Value tree:
+ *   JSON Pointer (RFC 6901)  "/a/0/b~1c" addresses a node
+ *   JSON Patch (RFC 6902)    add, remove, replace, move, copy, test
+ *   JSON Merge Patch (RFC 7396)
+ * A patch is applied all or nothing: every operation records how to undo
+ * itself, and a failing operation rolls back the ones before it. The hash
+ * cache is reset on every node along an edited path.
+ */
+
+/*JSON POINTER*/
+// unescaped reference tokens, "" is the root and has none
+Status parsePointer(std::string_view pointer, vector<string>& tokens);
+// array index token, "-" is the slot past the end and only valid (like
+// size itself) where a value is added
+bool pointerIndex(const string& token, size_t size, bool allowEnd,
+                  size_t& index);
+// nullptr when the pointer is malformed or the node does not exist.
+// Packed arrays on the way are unpacked to reach their elements, which the
+// const overload cannot do: it finds the array, but none of its elements.
+Value* resolvePointer(Value& root, std::string_view pointer);
+const Value* resolvePointer(const Value& root, std::string_view pointer);
+
+/*JSON PATCH*/
+// patch is an array of operation objects, as parsed from the RFC format
+Status applyPatch(Value& doc, const Value& patch);
+Status applyPatch(ValuePtr doc, const ValuePtr patch);
+// cannot fail, members set to null in patch are removed from doc
+Status applyMergePatch(Value& doc, const Value& patch);
+Status applyMergePatch(ValuePtr doc, const ValuePtr patch);
+
+/*JSON DIFF*/
+// A patch turning from into to. Objects are diffed member by member,
+// arrays after trimming their common prefix and suffix, so a changed
+// leaf or an inserted/removed element costs a single operation.
+Value diff(const Value& from, const Value& to);
+ValuePtr diff(const ValuePtr from, const ValuePtr to);
+
+}  // namespace yph
+
+#endif /*YJSON_PATCH*/
@@ -0,0 +1,332 @@
+#include "yjson_persistent.h"
+
+#include <algorithm>
+
+#include "yjson_patch.h"
+
+namespace yph {
+
+/*PERSISTENT CONVERSION*/
+PNodePtr freeze(const Value& v) {
+  auto n = std::make_shared<PNode>();
+  n->type = v.type;
+  switch (v.type) {
+    case Type::NVLL:
+    case Type::FALSE:
+    case Type::TRUE: {
+      break;
+    }
+    case Type::NUMBER: {
+      n->data = numberValue(v);
+      break;
+    }
+    case Type::STRING: {
+      n->data = std::get<string>(v.data);
+      break;
+    }
+    case Type::ARRAY: {
+      vector<PNodePtr> elements;
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        elements.reserve(numbers->size());
+        for (double d : *numbers) {
+          elements.push_back(makeNumber(d));
+        }
+      } else {
+        elements.reserve(std::get<vector<Value>>(v.data).size());
+        for (const auto& x : std::get<vector<Value>>(v.data)) {
+          elements.push_back(freeze(x));
+        }
+      }
+      n->data = std::move(elements);
+      break;
+    }
+    case Type::OBJECT: {
+      vector<PEntry> entries;
+      entries.reserve(std::get<vector<Entry>>(v.data).size());
+      for (const auto& x : std::get<vector<Entry>>(v.data)) {
+        entries.push_back({x.key, freeze(x.val)});
+      }
+      n->data = std::move(entries);
+      break;
+    }
+  }
+  return n;
+}
+
+void thaw(const PNodePtr& n, Value& v) {
+  assert(n != nullptr);
+  switch (n->type) {
+    case Type::NVLL:
+    case Type::FALSE:
+    case Type::TRUE: {
+      v.data = nullptr;
+      break;
+    }
+    case Type::NUMBER: {
+      v.data = std::get<double>(n->data);
+      break;
+    }
+    case Type::STRING: {
+      v.data = std::get<string>(n->data);
+      break;
+    }
+    case Type::ARRAY: {
+      auto& children = std::get<vector<PNodePtr>>(n->data);
+      vector<Value> elements(children.size());
+      for (size_t i = 0; i < children.size(); i++) {
+        thaw(children[i], elements[i]);
+      }
+      v.data = std::move(elements);
+      break;
+    }
+    case Type::OBJECT: {
+      auto& children = std::get<vector<PEntry>>(n->data);
+      vector<Entry> entries(children.size());
+      for (size_t i = 0; i < children.size(); i++) {
+        entries[i].key = children[i].key;
+        thaw(children[i].val, entries[i].val);
+      }
+      v.data = std::move(entries);
+      break;
+    }
+  }
+  v.type = n->type;
+  invalidateHash(v);
+}
+
+PNodePtr makeNumber(double num) {
+  auto n = std::make_shared<PNode>();
+  n->type = Type::NUMBER;
+  n->data = num;
+  return n;
+}
+
+PNodePtr makeString(const string& str) {
+  auto n = std::make_shared<PNode>();
+  n->type = Type::STRING;
+  n->data = str;
+  return n;
+}
+
+/*PERSISTENT ACCESSOR*/
+Type getType(const PNodePtr& n) {
+  assert(n != nullptr);
+  return n->type;
+}
+
+double getNumber(const PNodePtr& n) {
+  assert(n != nullptr && n->type == Type::NUMBER);
+  return std::get<double>(n->data);
+}
+
+bool getBoolean(const PNodePtr& n) {
+  assert(n != nullptr && (n->type == Type::TRUE || n->type == Type::FALSE));
+  return n->type == Type::TRUE;
+}
+
+const string& getString(const PNodePtr& n) {
+  assert(n != nullptr && n->type == Type::STRING);
+  return std::get<string>(n->data);
+}
+
+size_t getArraySize(const PNodePtr& n) {
+  assert(n != nullptr && n->type == Type::ARRAY);
+  return std::get<vector<PNodePtr>>(n->data).size();
+}
+
+const PNodePtr& getArrayElement(const PNodePtr& n, size_t index) {
+  assert(index < getArraySize(n));
+  return std::get<vector<PNodePtr>>(n->data)[index];
+}
+
+size_t getObjectSize(const PNodePtr& n) {
+  assert(n != nullptr && n->type == Type::OBJECT);
+  return std::get<vector<PEntry>>(n->data).size();
+}
+
+const string& getObjectKey(const PNodePtr& n, size_t index) {
+  assert(index < getObjectSize(n));
+  return std::get<vector<PEntry>>(n->data)[index].key;
+}
+
+const PNodePtr& getObjectValue(const PNodePtr& n, size_t index) {
+  assert(index < getObjectSize(n));
+  return std::get<vector<PEntry>>(n->data)[index].val;
+}
+
+static vector<PEntry>::const_iterator findMember(const vector<PEntry>& entries,
+                                                 const string& key) {
+  return std::find_if(entries.begin(), entries.end(),
+                      [&](const PEntry& e) { return e.key == key; });
+}
+
+PNodePtr findPointer(const PNodePtr& root, std::string_view pointer) {
+  vector<string> tokens;
+  if (parsePointer(pointer, tokens) != Status::PATCH_OK) {
+    return nullptr;
+  }
+  PNodePtr n = root;
+  for (const auto& token : tokens) {
+    if (n->type == Type::OBJECT) {
+      auto& entries = std::get<vector<PEntry>>(n->data);
+      auto it = findMember(entries, token);
+      if (it == entries.end()) {
+        return nullptr;
+      }
+      n = it->val;
+    } else if (n->type == Type::ARRAY) {
+      auto& elements = std::get<vector<PNodePtr>>(n->data);
+      size_t index = 0;
+      if (!pointerIndex(token, elements.size(), false, index)) {
+        return nullptr;
+      }
+      n = elements[index];
+    } else {
+      return nullptr;
+    }
+  }
+  return n;
+}
+
+/*PERSISTENT UPDATE*/
+// Rebuild node along tokens[i..]; value is the new subtree on the way down
+// and the new version of node on the way back. A null value removes.
+static Status updateAt(const PNode& node, const vector<string>& tokens,
+                       size_t i, PNodePtr& value) {
+  const string& token = tokens[i];
+  bool last = i + 1 == tokens.size();
+  // shallow copy: children are shared, only this level is duplicated
+  auto copy = std::make_shared<PNode>(node);
+  if (copy->type == Type::OBJECT) {
+    auto& entries = std::get<vector<PEntry>>(copy->data);
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&](const PEntry& e) { return e.key == token; });
+    if (it == entries.end()) {
+      if (!last || value == nullptr) {
+        return Status::PATCH_PATH_NOT_FOUND;
+      }
+      entries.push_back({token, std::move(value)});
+    } else if (!last) {
+      if (Status status = updateAt(*it->val, tokens, i + 1, value);
+          status != Status::PATCH_OK) {
+        return status;
+      }
+      it->val = std::move(value);
+    } else if (value == nullptr) {
+      entries.erase(it);
+    } else {
+      it->val = std::move(value);
+    }
+  } else if (copy->type == Type::ARRAY) {
+    auto& elements = std::get<vector<PNodePtr>>(copy->data);
+    size_t index = 0;
+    if (!pointerIndex(token, elements.size(), last && value != nullptr,
+                      index)) {
+      return Status::PATCH_PATH_NOT_FOUND;
+    }
+    if (index == elements.size()) {
+      elements.push_back(std::move(value));
+    } else if (!last) {
+      if (Status status = updateAt(*elements[index], tokens, i + 1, value);
+          status != Status::PATCH_OK) {
+        return status;
+      }
+      elements[index] = std::move(value);
+    } else if (value == nullptr) {
+      elements.erase(elements.begin() + index);
+    } else {
+      elements[index] = std::move(value);
+    }
+  } else {
+    return Status::PATCH_PATH_NOT_FOUND;
+  }
+  value = std::move(copy);
+  return Status::PATCH_OK;
+}
+
+static Status updateIn(PNodePtr& root, std::string_view pointer,
+                       PNodePtr value) {
+  assert(root != nullptr);
+  vector<string> tokens;
+  if (Status status = parsePointer(pointer, tokens);
+      status != Status::PATCH_OK) {
+    return status;
+  }
+  if (tokens.empty()) {
+    // the root itself
+    root = value ? std::move(value) : std::make_shared<const PNode>();
+    return Status::PATCH_OK;
+  }
+  if (Status status = updateAt(*root, tokens, 0, value);
+      status != Status::PATCH_OK) {
+    return status;
+  }
+  root = std::move(value);
+  return Status::PATCH_OK;
+}
+
+Status setIn(PNodePtr& root, std::string_view pointer, PNodePtr value) {
+  assert(value != nullptr);
+  return updateIn(root, pointer, std::move(value));
+}
+
+Status removeIn(PNodePtr& root, std::string_view pointer) {
+  return updateIn(root, pointer, nullptr);
+}
+
+/*PERSISTENT GENERATOR*/
+Status stringifyValue(const PNode& n, string& s) {
+  switch (n.type) {
+    case Type::NVLL: {
+      s.append("null");
+      break;
+    }
+    case Type::TRUE: {
+      s.append("true");
+      break;
+    }
+    case Type::FALSE: {
+      s.append("false");
+      break;
+    }
+    case Type::NUMBER: {
+      stringifyNumber(std::get<double>(n.data), s);
+      break;
+    }
+    case Type::STRING: {
+      stringifyString(std::get<string>(n.data), s);
+      break;
+    }
+    case Type::ARRAY: {
+      s.push_back('[');
+      bool first = true;
+      for (const auto& x : std::get<vector<PNodePtr>>(n.data)) {
+        if (!first) {
+          s.push_back(',');
+        }
+        first = false;
+        stringifyValue(*x, s);
+      }
+      s.push_back(']');
+      break;
+    }
+    case Type::OBJECT: {
+      s.push_back('{');
+      bool first = true;
+      for (const auto& x : std::get<vector<PEntry>>(n.data)) {
+        if (!first) {
+          s.push_back(',');
+        }
+        first = false;
+        stringifyString(x.key, s);
+        s.push_back(':');
+        stringifyValue(*x.val, s);
+      }
+      s.push_back('}');
+      break;
+    }
+  }
+  return Status::STRINGIFY_OK;
+}
+
+}  // namespace yph
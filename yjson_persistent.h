@@ -0,0 +1,100 @@
+#ifndef YJSON_PERSISTENT_H__
+#define YJSON_PERSISTENT_H__
+
+#include <memory>
+#include <string_view>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Immutable, structurally shared trees for documents read by many threads.
+ * A PNode never changes once built; an update copies the nodes on the path
+ * from the root to the changed node and shares every other subtree with
+ * the previous version. Taking a snapshot is copying a PNodePtr, and any
+ * number of threads may traverse one without locking.
+ */
+class PNode;
+class PEntry;
+using PNodePtr = std::shared_ptr<const PNode>;
+using PData =
+    std::variant<double, string, vector<PNodePtr>, vector<PEntry>, void*>;
+
+class PNode {
+ public:
+  Type type = Type::NVLL;
+  PData data = nullptr;
+};
+
+class PEntry {
+ public:
+  string key;
+  PNodePtr val;
+};
+
+/*PERSISTENT CONVERSION*/
+// lazy numbers are converted, PNode only holds doubles
+PNodePtr freeze(const Value& v);
+void thaw(const PNodePtr& n, Value& v);
+PNodePtr makeNumber(double num);
+PNodePtr makeString(const string& str);
+
+/*PERSISTENT ACCESSOR*/
+// the same contract as the Value accessors, children are shared, not copied
+Type getType(const PNodePtr& n);
+double getNumber(const PNodePtr& n);
+bool getBoolean(const PNodePtr& n);
+const string& getString(const PNodePtr& n);
+size_t getArraySize(const PNodePtr& n);
+const PNodePtr& getArrayElement(const PNodePtr& n, size_t index);
+size_t getObjectSize(const PNodePtr& n);
+const string& getObjectKey(const PNodePtr& n, size_t index);
+const PNodePtr& getObjectValue(const PNodePtr& n, size_t index);
+// nullptr when the JSON Pointer does not resolve
+PNodePtr findPointer(const PNodePtr& root, std::string_view pointer);
+
+/*PERSISTENT UPDATE*/
+// Replace root with a new version, the old one stays valid for whoever
+// holds it. setIn adds or replaces an object member, replaces an array
+// element or appends one at index size or "-"; its parent must exist.
+Status setIn(PNodePtr& root, std::string_view pointer, PNodePtr value);
+Status removeIn(PNodePtr& root, std::string_view pointer);
+
+/*PERSISTENT GENERATOR*/
+Status stringifyValue(const PNode& n, string& s);
+
+/*SHARED DOCUMENT*/
+// The current version of a document, published with atomic pointer swaps.
+class SharedDocument {
+ public:
+  explicit SharedDocument(PNodePtr root = std::make_shared<const PNode>())
+      : root(std::move(root)) {}
+  SharedDocument(const SharedDocument&) = delete;
+  SharedDocument& operator=(const SharedDocument&) = delete;
+
+  // O(1) snapshot, valid for as long as the caller holds it
+  PNodePtr load() const { return std::atomic_load(&root); }
+  void store(PNodePtr next) { std::atomic_store(&root, std::move(next)); }
+  // read-copy-update: f edits a private version, which is published only
+  // if no other writer got in between, otherwise f runs again on theirs
+  template <typename F>
+  Status update(F&& f) {
+    PNodePtr current = load();
+    for (;;) {
+      PNodePtr next = current;
+      if (Status status = f(next); status != Status::PATCH_OK) {
+        return status;
+      }
+      if (std::atomic_compare_exchange_weak(&root, &current, next)) {
+        return Status::PATCH_OK;
+      }
+    }
+  }
+
+ private:
+  PNodePtr root;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_PERSISTENT*/
@@ -0,0 +1,102 @@
+#include "yjson_render.h"
+
+#include <mutex>
+
+namespace yph {
+
+/*RENDER CACHE IDS*/
+// ids of the live caches, so that a mark never names two of them
+static std::mutex idMutex;
+static vector<bool> idTaken(std::size_t(1) << 16);
+
+static std::uint16_t takeId() {
+  std::lock_guard<std::mutex> lock(idMutex);
+  for (size_t i = 1; i < idTaken.size(); i++) {
+    if (!idTaken[i]) {
+      idTaken[i] = true;
+      return static_cast<std::uint16_t>(i);
+    }
+  }
+  return 0;
+}
+
+static void releaseId(std::uint16_t id) {
+  std::lock_guard<std::mutex> lock(idMutex);
+  idTaken[id] = false;
+}
+
+/*RENDER CACHE*/
+RenderCache::RenderCache() : id(takeId()) {}
+
+// nodes still marked with the id are unmarked lazily: a later cache with
+// the same id has no bytes for them
+RenderCache::~RenderCache() {
+  if (id != 0) {
+    releaseId(id);
+  }
+}
+
+Status RenderCache::stringify(const Value& v, string& s) {
+  bool fresh = rendered.empty();
+  write(v, s);
+  if (fresh) {
+    baseline = bytes;
+  } else if (bytes > 2 * baseline) {
+    clear();
+  }
+  return Status::STRINGIFY_OK;
+}
+
+void RenderCache::clear() {
+  rendered.clear();
+  bytes = 0;
+  baseline = 0;
+}
+
+// A mark with our id means the node was not edited, copied or moved since
+// it was stored under its address, so the bytes there are its own.
+void RenderCache::write(const Value& v, string& s) {
+  if (v.type != Type::ARRAY && v.type != Type::OBJECT) {
+    stringifyValue(v, s);
+    return;
+  }
+  if (id != 0 && v.renderedBy.get() == id) {
+    if (auto it = rendered.find(&v); it != rendered.end()) {
+      s.append(it->second);
+      return;
+    }
+  }
+  size_t start = s.size();
+  if (auto elements = std::get_if<vector<Value>>(&v.data)) {
+    s.push_back('[');
+    for (size_t i = 0; i < elements->size(); i++) {
+      if (i > 0) {
+        s.push_back(',');
+      }
+      write((*elements)[i], s);
+    }
+    s.push_back(']');
+  } else if (auto entries = std::get_if<vector<Entry>>(&v.data)) {
+    s.push_back('{');
+    for (size_t i = 0; i < entries->size(); i++) {
+      if (i > 0) {
+        s.push_back(',');
+      }
+      stringifyString((*entries)[i].key, s);
+      s.push_back(':');
+      write((*entries)[i].val, s);
+    }
+    s.push_back('}');
+  } else {
+    // packed numbers, no nodes below
+    stringifyValue(v, s);
+  }
+  if (id != 0 && s.size() - start >= kMinRenderedBytes) {
+    auto& cached = rendered[&v];
+    bytes = bytes - cached.size() + (s.size() - start);
+    cached.assign(s, start, s.npos);
+    v.renderedBy.set(id);
+  }
+}
+
+}  // namespace yph
@@ -0,0 +1,53 @@
+#ifndef YJSON_RENDER_H__
+#define YJSON_RENDER_H__
+
+#include <unordered_map>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Memoized stringify for documents written again after small edits.
+ * Every container rendered through a RenderCache keeps its bytes in the
+ * cache, keyed by node, and is marked with the cache's id (Value::
+ * renderedBy). A later call copies the bytes of every container still
+ * marked instead of walking it, so only the containers edited since, the
+ * path from the root down to each edit, are rendered again. Edits already
+ * clear the mark along that path: parse, the setters, JSON Patch and
+ * invalidateHash all do.
+ * Cached bytes add up to about the output size times the nesting depth.
+ * Containers smaller than kMinRenderedBytes are cheaper to write again
+ * than to look up. Bytes of nodes that no longer exist stay until the
+ * cache holds twice as much as right after a full render; it then starts
+ * over.
+ * Keep one cache per thread, like a Context; several caches may render
+ * the same const tree at the same time.
+ */
+class RenderCache {
+ public:
+  static constexpr size_t kMinRenderedBytes = 64;
+
+  RenderCache();
+  ~RenderCache();
+  RenderCache(const RenderCache&) = delete;
+  RenderCache& operator=(const RenderCache&) = delete;
+
+  // the bytes of stringifyValue(v, s), appended to s
+  Status stringify(const Value& v, string& s);
+  void clear();
+  size_t cachedBytes() const { return bytes; }
+
+ private:
+  void write(const Value& v, string& s);
+
+  // 0 when every id is taken, the cache then never stores anything
+  std::uint16_t id;
+  std::unordered_map<const Value*, string> rendered;
+  size_t bytes = 0;
+  // cached bytes right after the last render from an empty cache
+  size_t baseline = 0;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_RENDER*/
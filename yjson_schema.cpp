@@ -0,0 +1,957 @@
+#include "yjson_schema.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace yph {
+
+/*PATTERN*/
+// UTF-8 decoding that never fails: a byte that does not start a valid
+// sequence stands for itself
+static char32_t nextCodePoint(std::string_view s, size_t& i) {
+  auto byte = [&](size_t k) { return static_cast<unsigned char>(s[k]); };
+  unsigned char lead = byte(i++);
+  size_t n = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+  if (n == 0 || lead > 0xF4 || s.size() - i < n) {
+    return lead;
+  }
+  char32_t c = lead & (0x3F >> n);
+  for (size_t k = 0; k < n; k++) {
+    if ((byte(i + k) & 0xC0) != 0x80) {
+      return lead;
+    }
+    c = (c << 6) | (byte(i + k) & 0x3F);
+  }
+  i += n;
+  return c;
+}
+
+static bool isWordChar(char32_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Recursive descent into a syntax tree, which is then emitted as a program;
+// bounded repeats emit their operand once per repetition.
+class PatternCompiler {
+ public:
+  using Pattern = Schema::Pattern;
+  using Ranges = Pattern::Ranges;
+
+  explicit PatternCompiler(Pattern& pattern) : pattern(pattern) {}
+
+  // false for invalid syntax and for what an automaton cannot match
+  bool compile(std::string_view source) {
+    for (size_t i = 0; i < source.size();) {
+      text.push_back(nextCodePoint(source, i));
+    }
+    Node root;
+    if (!parseAlternatives(root, 0) || at != text.size() || !emit(root)) {
+      return false;
+    }
+    pattern.program.push_back({Pattern::Op::MATCH});
+    return true;
+  }
+
+ private:
+  static constexpr char32_t kMaxCodePoint = 0x10FFFF;
+  // bounds on the pattern, not the input: groups nested deeper, repeat
+  // counts and programs larger than these are SCHEMA_INVALID
+  static constexpr size_t kMaxNesting = 64;
+  static constexpr size_t kMaxCount = 1000;
+  static constexpr size_t kMaxProgram = 1 << 16;
+  static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+  struct Node {
+    enum Kind { EMPTY, CHAR, CLASS, ASSERTION, SEQUENCE, CHOICE, REPEAT };
+    Kind kind = EMPTY;
+    // the code point, the class index or the assertion's Op
+    std::uint32_t x = 0;
+    size_t min = 0;
+    size_t max = 0;
+    vector<Node> children;
+  };
+
+  bool more() const { return at < text.size(); }
+  bool next(char32_t c) {
+    if (more() && text[at] == c) {
+      at++;
+      return true;
+    }
+    return false;
+  }
+
+  // a|b|c
+  bool parseAlternatives(Node& node, size_t depth) {
+    if (depth > kMaxNesting) {
+      return false;
+    }
+    node.kind = Node::CHOICE;
+    do {
+      node.children.emplace_back();
+      if (!parseSequence(node.children.back(), depth)) {
+        return false;
+      }
+    } while (next('|'));
+    return true;
+  }
+
+  bool parseSequence(Node& node, size_t depth) {
+    node.kind = Node::SEQUENCE;
+    while (more() && text[at] != '|' && text[at] != ')') {
+      Node atom;
+      if (!parseAtom(atom, depth)) {
+        return false;
+      }
+      size_t min = 1;
+      size_t max = 1;
+      bool quantified = false;
+      if (!parseQuantifier(quantified, min, max)) {
+        return false;
+      }
+      if (quantified) {
+        if (atom.kind == Node::ASSERTION) {
+          return false;
+        }
+        Node repeat;
+        repeat.kind = Node::REPEAT;
+        repeat.min = min;
+        repeat.max = max;
+        repeat.children.push_back(std::move(atom));
+        atom = std::move(repeat);
+        // lazy and greedy match the same strings
+        next('?');
+      }
+      node.children.push_back(std::move(atom));
+    }
+    return true;
+  }
+
+  bool parseQuantifier(bool& quantified, size_t& min, size_t& max) {
+    quantified = true;
+    if (next('*') || next('+')) {
+      min = text[at - 1] == '+' ? 1 : 0;
+      max = kUnbounded;
+    } else if (next('?')) {
+      min = 0;
+      max = 1;
+    } else if (next('{')) {
+      if (!parseCount(min)) {
+        return false;
+      }
+      max = min;
+      if (next(',')) {
+        max = more() && text[at] == '}' ? kUnbounded : 0;
+        if (max == 0 && !parseCount(max)) {
+          return false;
+        }
+      }
+      return next('}') && min <= max;
+    } else {
+      quantified = false;
+    }
+    return true;
+  }
+
+  bool parseCount(size_t& count) {
+    size_t start = at;
+    count = 0;
+    while (more() && text[at] >= '0' && text[at] <= '9') {
+      count = count * 10 + (text[at++] - '0');
+      if (count > kMaxCount) {
+        return false;
+      }
+    }
+    return at > start;
+  }
+
+  bool parseAtom(Node& node, size_t depth) {
+    char32_t c = text[at++];
+    switch (c) {
+      case '(':
+        // (?: only, (?= (?! (?<= (?<! and named groups are not regular
+        if (next('?') && !next(':')) {
+          return false;
+        }
+        return parseAlternatives(node, depth + 1) && next(')');
+      case '^':
+      case '$':
+        node.kind = Node::ASSERTION;
+        node.x = static_cast<std::uint32_t>(
+            c == '^' ? Pattern::Op::LINE_START : Pattern::Op::LINE_END);
+        return true;
+      case '.':
+        // all but the line terminators
+        return makeClass(node, complement({{'\n', '\n'},
+                                           {'\r', '\r'},
+                                           {0x2028, 0x2029}}));
+      case '[':
+        return parseClass(node);
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        return false;
+      case '\\':
+        if (next('b') || next('B')) {
+          node.kind = Node::ASSERTION;
+          node.x = static_cast<std::uint32_t>(
+              text[at - 1] == 'b' ? Pattern::Op::WORD_BOUNDARY
+                                  : Pattern::Op::NOT_WORD_BOUNDARY);
+          return true;
+        } else {
+          Ranges set;
+          if (!parseEscape(c, set, false)) {
+            return false;
+          }
+          return set.empty() ? makeChar(node, c) : makeClass(node, set);
+        }
+      default:
+        return makeChar(node, c);
+    }
+  }
+
+  // [a-z_\d] and [^...]
+  bool parseClass(Node& node) {
+    bool negated = next('^');
+    Ranges set;
+    while (more() && text[at] != ']') {
+      char32_t lo = 0;
+      Ranges loSet;
+      if (!parseClassAtom(lo, loSet)) {
+        return false;
+      }
+      if (at + 1 < text.size() && text[at] == '-' && text[at + 1] != ']') {
+        at++;
+        char32_t hi = 0;
+        Ranges hiSet;
+        if (!parseClassAtom(hi, hiSet) || !loSet.empty() || !hiSet.empty() ||
+            lo > hi) {
+          return false;
+        }
+        set.push_back({lo, hi});
+      } else if (loSet.empty()) {
+        set.push_back({lo, lo});
+      } else {
+        set.insert(set.end(), loSet.begin(), loSet.end());
+      }
+    }
+    if (!next(']')) {
+      return false;
+    }
+    set = normalize(std::move(set));
+    return makeClass(node, negated ? complement(set) : set);
+  }
+
+  bool parseClassAtom(char32_t& c, Ranges& set) {
+    c = text[at++];
+    // \b is a backspace in a class
+    if (c == '\\' && next('b')) {
+      c = '\b';
+      return true;
+    }
+    return c != '\\' || parseEscape(c, set, true);
+  }
+
+  // after a backslash: a code point in c, or a non-empty set for \d \s \w
+  // and their negations
+  bool parseEscape(char32_t& c, Ranges& set, bool inClass) {
+    if (!more()) {
+      return false;
+    }
+    c = text[at++];
+    const Ranges digits = {{'0', '9'}};
+    const Ranges word = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+    const Ranges space = {{'\t', '\r'},     {' ', ' '},       {0xA0, 0xA0},
+                          {0x1680, 0x1680}, {0x2000, 0x200A}, {0x2028, 0x2029},
+                          {0x202F, 0x202F}, {0x205F, 0x205F}, {0x3000, 0x3000},
+                          {0xFEFF, 0xFEFF}};
+    switch (c) {
+      case 'd':
+        set = digits;
+        return true;
+      case 'D':
+        set = complement(digits);
+        return true;
+      case 'w':
+        set = word;
+        return true;
+      case 'W':
+        set = complement(word);
+        return true;
+      case 's':
+        set = space;
+        return true;
+      case 'S':
+        set = complement(space);
+        return true;
+      case 't':
+        c = '\t';
+        return true;
+      case 'n':
+        c = '\n';
+        return true;
+      case 'v':
+        c = '\v';
+        return true;
+      case 'f':
+        c = '\f';
+        return true;
+      case 'r':
+        c = '\r';
+        return true;
+      case '0':
+        // \0 then a digit would be an octal escape
+        c = 0;
+        return !more() || text[at] < '0' || text[at] > '9';
+      case 'c':
+        if (!more() || !((text[at] >= 'a' && text[at] <= 'z') ||
+                         (text[at] >= 'A' && text[at] <= 'Z'))) {
+          return false;
+        }
+        c = text[at++] % 32;
+        return true;
+      case 'x':
+        return parseHex(2, c);
+      case 'u':
+        if (!parseHex(4, c)) {
+          return false;
+        }
+        // a surrogate pair written as two escapes is one code point
+        if (c >= 0xD800 && c <= 0xDBFF && at + 1 < text.size() &&
+            text[at] == '\\' && text[at + 1] == 'u') {
+          size_t start = at;
+          char32_t low = 0;
+          at += 2;
+          if (parseHex(4, low) && low >= 0xDC00 && low <= 0xDFFF) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+          } else {
+            at = start;
+          }
+        }
+        return true;
+      case '-':
+        return inClass;
+      default:
+        // backreferences (\1, \k<name>) and unknown letters are not allowed,
+        // any other character stands for itself
+        return !isWordChar(c);
+    }
+  }
+
+  bool parseHex(size_t digits, char32_t& c) {
+    c = 0;
+    for (size_t k = 0; k < digits; k++) {
+      if (!more()) {
+        return false;
+      }
+      char32_t h = text[at++];
+      int value = h >= '0' && h <= '9'   ? h - '0'
+                  : h >= 'a' && h <= 'f' ? h - 'a' + 10
+                  : h >= 'A' && h <= 'F' ? h - 'A' + 10
+                                         : -1;
+      if (value < 0) {
+        return false;
+      }
+      c = c * 16 + value;
+    }
+    return true;
+  }
+
+  static Ranges normalize(Ranges set) {
+    std::sort(set.begin(), set.end());
+    Ranges merged;
+    for (auto& range : set) {
+      if (!merged.empty() && range.first <= merged.back().second + 1) {
+        merged.back().second = std::max(merged.back().second, range.second);
+      } else {
+        merged.push_back(range);
+      }
+    }
+    return merged;
+  }
+
+  static Ranges complement(const Ranges& set) {
+    Ranges out;
+    char32_t from = 0;
+    for (auto& [lo, hi] : normalize(set)) {
+      if (lo > from) {
+        out.push_back({from, lo - 1});
+      }
+      from = hi + 1;
+    }
+    if (from <= kMaxCodePoint) {
+      out.push_back({from, kMaxCodePoint});
+    }
+    return out;
+  }
+
+  static bool makeChar(Node& node, char32_t c) {
+    node.kind = Node::CHAR;
+    node.x = c;
+    return true;
+  }
+
+  bool makeClass(Node& node, Ranges set) {
+    node.kind = Node::CLASS;
+    node.x = static_cast<std::uint32_t>(pattern.classes.size());
+    pattern.classes.push_back(std::move(set));
+    return true;
+  }
+
+  size_t add(Pattern::Op op, std::uint32_t x = 0) {
+    pattern.program.push_back({op, x, 0});
+    return pattern.program.size() - 1;
+  }
+
+  std::uint32_t here() const {
+    return static_cast<std::uint32_t>(pattern.program.size());
+  }
+
+  bool emit(const Node& node) {
+    auto& program = pattern.program;
+    if (program.size() > kMaxProgram) {
+      return false;
+    }
+    switch (node.kind) {
+      case Node::EMPTY:
+        return true;
+      case Node::CHAR:
+        add(Pattern::Op::CHAR, node.x);
+        return true;
+      case Node::CLASS:
+        add(Pattern::Op::CLASS, node.x);
+        return true;
+      case Node::ASSERTION:
+        add(static_cast<Pattern::Op>(node.x));
+        return true;
+      case Node::SEQUENCE:
+        for (auto& child : node.children) {
+          if (!emit(child)) {
+            return false;
+          }
+        }
+        return true;
+      case Node::CHOICE: {
+        // split to each alternative but the last, each jumps to the end
+        vector<size_t> jumps;
+        for (size_t i = 0; i < node.children.size(); i++) {
+          bool last = i + 1 == node.children.size();
+          size_t split = last ? 0 : add(Pattern::Op::SPLIT, here() + 1);
+          if (!emit(node.children[i])) {
+            return false;
+          }
+          if (!last) {
+            jumps.push_back(add(Pattern::Op::JUMP));
+            program[split].y = here();
+          }
+        }
+        for (size_t jump : jumps) {
+          program[jump].x = here();
+        }
+        return true;
+      }
+      case Node::REPEAT: {
+        const Node& child = node.children[0];
+        for (size_t i = 0; i < node.min; i++) {
+          if (!emit(child)) {
+            return false;
+          }
+        }
+        if (node.max == kUnbounded) {
+          std::uint32_t loop = here();
+          size_t split = add(Pattern::Op::SPLIT, loop + 1);
+          if (!emit(child)) {
+            return false;
+          }
+          add(Pattern::Op::JUMP, loop);
+          program[split].y = here();
+          return true;
+        }
+        // each optional copy may stop the repeat
+        vector<size_t> splits;
+        for (size_t i = node.min; i < node.max; i++) {
+          splits.push_back(add(Pattern::Op::SPLIT, here() + 1));
+          if (!emit(child)) {
+            return false;
+          }
+        }
+        for (size_t split : splits) {
+          program[split].y = here();
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Pattern& pattern;
+  vector<char32_t> text;
+  size_t at = 0;
+};
+
+// Every state the automaton can be in after each code point, deduplicated:
+// at most one thread per instruction, so the work per code point is bounded
+// by the program, and a new thread starts at each position for the search.
+bool Schema::Pattern::search(std::string_view s) const {
+  // instruction to generation: the states already reached at this position
+  vector<size_t> reached(program.size(), 0);
+  size_t generation = 0;
+  vector<std::uint32_t> threads;
+  vector<std::uint32_t> next;
+  vector<std::uint32_t> stack;
+  char32_t before = 0;
+  char32_t c = 0;
+  bool atStart = true;
+  bool atEnd = false;
+  bool boundary = false;
+  // follows the instructions that consume nothing, true on a match
+  auto follow = [&](std::uint32_t start) {
+    stack.push_back(start);
+    while (!stack.empty()) {
+      std::uint32_t pc = stack.back();
+      stack.pop_back();
+      if (reached[pc] == generation) {
+        continue;
+      }
+      reached[pc] = generation;
+      const Inst& inst = program[pc];
+      switch (inst.op) {
+        case Op::SPLIT:
+          stack.push_back(inst.y);
+          stack.push_back(inst.x);
+          break;
+        case Op::JUMP:
+          stack.push_back(inst.x);
+          break;
+        case Op::LINE_START:
+          if (atStart) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        case Op::LINE_END:
+          if (atEnd) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        case Op::WORD_BOUNDARY:
+        case Op::NOT_WORD_BOUNDARY:
+          if (boundary == (inst.op == Op::WORD_BOUNDARY)) {
+            stack.push_back(pc + 1);
+          }
+          break;
+        case Op::MATCH:
+          stack.clear();
+          return true;
+        default:
+          threads.push_back(pc);
+      }
+    }
+    return false;
+  };
+  for (size_t i = 0;;) {
+    atEnd = i == s.size();
+    size_t after = i;
+    c = atEnd ? 0 : nextCodePoint(s, after);
+    boundary = (!atStart && isWordChar(before)) != (!atEnd && isWordChar(c));
+    generation++;
+    threads.clear();
+    for (std::uint32_t pc : next) {
+      if (follow(pc)) {
+        return true;
+      }
+    }
+    if (follow(0)) {
+      return true;
+    }
+    if (atEnd) {
+      return false;
+    }
+    next.clear();
+    for (std::uint32_t pc : threads) {
+      const Inst& inst = program[pc];
+      bool matches = false;
+      if (inst.op == Op::CHAR) {
+        matches = inst.x == c;
+      } else {
+        auto& ranges = classes[inst.x];
+        auto it = std::upper_bound(
+            ranges.begin(), ranges.end(), c,
+            [](char32_t d, const std::pair<char32_t, char32_t>& range) {
+              return d < range.first;
+            });
+        matches = it != ranges.begin() && c <= (it - 1)->second;
+      }
+      if (matches) {
+        next.push_back(pc + 1);
+      }
+    }
+    before = c;
+    atStart = false;
+    i = after;
+  }
+}
+
+/*SCHEMA COMPILER*/
+static bool isLength(const Value& v, size_t& length) {
+  if (v.type != Type::NUMBER) {
+    return false;
+  }
+  double d = numberValue(v);
+  if (d < 0 || d != std::floor(d) || d > 1e18) {
+    return false;
+  }
+  length = static_cast<size_t>(d);
+  return true;
+}
+
+// children of a container, none for anything else; the numbers of a packed
+// array are copied into unpacked
+static const vector<Value>& elementsOf(const Value& v,
+                                       vector<Value>& unpacked) {
+  static const vector<Value> none;
+  if (v.type != Type::ARRAY) {
+    return none;
+  }
+  if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+    unpacked.clear();
+    for (double d : *numbers) {
+      unpacked.emplace_back(Type::NUMBER).data = d;
+    }
+    return unpacked;
+  }
+  return std::get<vector<Value>>(v.data);
+}
+
+static const vector<Entry>& membersOf(const Value& v) {
+  static const vector<Entry> none;
+  return v.type == Type::OBJECT ? std::get<vector<Entry>>(v.data) : none;
+}
+
+static bool isAnnotation(const string& key) {
+  return key == "title" || key == "description" || key == "$id" ||
+         key == "$schema" || key == "$comment" || key == "default" ||
+         key == "examples";
+}
+
+Status Schema::compile(const Value& schema) {
+  nodes.assign(1, Node());
+  patterns.clear();
+  Status status = compileNode(schema, root);
+  if (status != Status::SCHEMA_OK) {
+    nodes.assign(1, Node());
+    patterns.clear();
+    root = kAny;
+  }
+  return status;
+}
+
+Status Schema::compile(std::string_view json) {
+  Value schema;
+  if (Context().parse(schema, json) != Status::PARSE_OK) {
+    return Status::SCHEMA_INVALID;
+  }
+  return compile(schema);
+}
+
+// children first, so index is only known once the whole subschema is done
+Status Schema::compileNode(const Value& schema, size_t& index) {
+  auto typeBits = [](const Value& name, std::uint8_t& bits) {
+    if (name.type != Type::STRING) {
+      return false;
+    }
+    auto& s = std::get<string>(name.data);
+    auto bit = [](Type t) { return std::uint8_t(1 << castEnum(t)); };
+    if (s == "null") {
+      bits |= bit(Type::NVLL);
+    } else if (s == "boolean") {
+      bits |= bit(Type::TRUE) | bit(Type::FALSE);
+    } else if (s == "number") {
+      bits |= bit(Type::NUMBER);
+    } else if (s == "integer") {
+      bits |= kInteger;
+    } else if (s == "string") {
+      bits |= bit(Type::STRING);
+    } else if (s == "array") {
+      bits |= bit(Type::ARRAY);
+    } else if (s == "object") {
+      bits |= bit(Type::OBJECT);
+    } else {
+      return false;
+    }
+    return true;
+  };
+  if (schema.type == Type::TRUE) {
+    index = kAny;
+    return Status::SCHEMA_OK;
+  }
+  Node node;
+  if (schema.type == Type::FALSE) {
+    node.types = 0;
+  } else if (schema.type != Type::OBJECT) {
+    return Status::SCHEMA_INVALID;
+  }
+  vector<string> required;
+  vector<Value> unpacked;
+  for (auto& [key, value] : membersOf(schema)) {
+    bool valid = true;
+    if (key == "type") {
+      node.types = 0;
+      if (value.type == Type::ARRAY) {
+        for (auto& name : elementsOf(value, unpacked)) {
+          valid = valid && typeBits(name, node.types);
+        }
+      } else {
+        valid = typeBits(value, node.types);
+      }
+    } else if (key == "enum") {
+      valid = value.type == Type::ARRAY;
+      for (auto& x : elementsOf(value, unpacked)) {
+        // containers would need the subtree, not just its events
+        valid = valid && x.type != Type::ARRAY && x.type != Type::OBJECT;
+        node.enumValues.push_back(x);
+      }
+      node.hasEnum = true;
+    } else if (key == "minimum" || key == "maximum") {
+      valid = value.type == Type::NUMBER;
+      (key == "minimum" ? node.minimum : node.maximum) =
+          valid ? numberValue(value) : 0;
+    } else if (key == "minLength") {
+      valid = isLength(value, node.minLength);
+    } else if (key == "maxLength") {
+      valid = isLength(value, node.maxLength);
+    } else if (key == "pattern") {
+      valid = value.type == Type::STRING &&
+              PatternCompiler(patterns.emplace_back())
+                  .compile(std::get<string>(value.data));
+      node.pattern = static_cast<int>(patterns.size() - 1);
+    } else if (key == "properties") {
+      valid = value.type == Type::OBJECT;
+      for (auto& property : membersOf(value)) {
+        size_t child = kAny;
+        if (Status status = compileNode(property.val, child);
+            status != Status::SCHEMA_OK) {
+          return status;
+        }
+        node.properties.push_back({property.key, child, -1});
+      }
+    } else if (key == "required") {
+      valid = value.type == Type::ARRAY;
+      for (auto& name : elementsOf(value, unpacked)) {
+        valid = valid && name.type == Type::STRING;
+        if (valid) {
+          required.push_back(std::get<string>(name.data));
+        }
+      }
+    } else if (key == "items") {
+      if (Status status = compileNode(value, node.items);
+          status != Status::SCHEMA_OK) {
+        return status;
+      }
+    } else {
+      valid = isAnnotation(key);
+    }
+    if (!valid) {
+      return Status::SCHEMA_INVALID;
+    }
+  }
+
+  // a required member may have no schema of its own
+  for (auto& name : required) {
+    auto it = std::find_if(node.properties.begin(), node.properties.end(),
+                           [&](const Property& p) { return p.key == name; });
+    if (it == node.properties.end()) {
+      node.properties.push_back({name, kAny, -1});
+      it = node.properties.end() - 1;
+    }
+    if (it->required < 0) {
+      it->required = static_cast<int>(node.requiredCount++);
+    }
+  }
+  std::stable_sort(
+      node.properties.begin(), node.properties.end(),
+      [](const Property& a, const Property& b) { return a.key < b.key; });
+  nodes.push_back(std::move(node));
+  index = nodes.size() - 1;
+  return Status::SCHEMA_OK;
+}
+
+/*SCHEMA VALIDATOR*/
+// One frame per open container: the node it is checked against and the
+// node of the child being read. Objects own a run of seen flags, one per
+// required member, so that duplicate keys are counted once.
+class SchemaValidator : public Handler {
+ public:
+  explicit SchemaValidator(const Schema& schema) : schema(schema) {}
+
+  Status onNull() override {
+    auto& node = expected();
+    return checkScalar(node, Type::NVLL, [](const Value&) { return true; });
+  }
+
+  Status onBoolean(bool b) override {
+    auto& node = expected();
+    return checkScalar(node, b ? Type::TRUE : Type::FALSE,
+                       [](const Value&) { return true; });
+  }
+
+  Status onNumber(double d) override {
+    auto& node = expected();
+    std::uint8_t bit = 1 << castEnum(Type::NUMBER);
+    if ((node.types & bit) == 0 &&
+        ((node.types & Schema::kInteger) == 0 || d != std::floor(d))) {
+      return Status::SCHEMA_TYPE_MISMATCH;
+    }
+    if (Status status = checkEnum(node, Type::NUMBER,
+                                  [&](const Value& e) {
+                                    return numberValue(e) == d;
+                                  });
+        status != Status::PARSE_OK) {
+      return status;
+    }
+    if (d < node.minimum || d > node.maximum) {
+      return Status::SCHEMA_OUT_OF_RANGE;
+    }
+    return Status::PARSE_OK;
+  }
+
+  Status onString(std::string_view s) override {
+    auto& node = expected();
+    if (Status status = checkScalar(node, Type::STRING,
+                                    [&](const Value& e) {
+                                      return std::get<string>(e.data) == s;
+                                    });
+        status != Status::PARSE_OK) {
+      return status;
+    }
+    if (node.minLength > 0 || node.maxLength < s.size()) {
+      // UTF-8 continuation bytes do not start a code point
+      size_t length = std::count_if(s.begin(), s.end(), [](char ch) {
+        return (static_cast<unsigned char>(ch) & 0xC0) != 0x80;
+      });
+      if (length < node.minLength || length > node.maxLength) {
+        return Status::SCHEMA_OUT_OF_RANGE;
+      }
+    }
+    if (node.pattern >= 0 && !schema.patterns[node.pattern].search(s)) {
+      return Status::SCHEMA_PATTERN_MISMATCH;
+    }
+    return Status::PARSE_OK;
+  }
+
+  Status onStartArray() override {
+    size_t index = expectedIndex();
+    auto& node = schema.nodes[index];
+    if (Status status = checkContainer(node, Type::ARRAY);
+        status != Status::PARSE_OK) {
+      return status;
+    }
+    frames.push_back({index, node.items, seen.size(), 0});
+    return Status::PARSE_OK;
+  }
+
+  Status onEndArray() override {
+    frames.pop_back();
+    return Status::PARSE_OK;
+  }
+
+  Status onStartObject() override {
+    size_t index = expectedIndex();
+    auto& node = schema.nodes[index];
+    if (Status status = checkContainer(node, Type::OBJECT);
+        status != Status::PARSE_OK) {
+      return status;
+    }
+    frames.push_back({index, Schema::kAny, seen.size(), 0});
+    seen.resize(seen.size() + node.requiredCount, false);
+    return Status::PARSE_OK;
+  }
+
+  Status onKey(std::string_view key) override {
+    auto& frame = frames.back();
+    auto& properties = schema.nodes[frame.node].properties;
+    auto it = std::lower_bound(properties.begin(), properties.end(), key,
+                               [](const Schema::Property& p,
+                                  std::string_view k) { return p.key < k; });
+    frame.child = Schema::kAny;
+    if (it != properties.end() && it->key == key) {
+      frame.child = it->node;
+      if (it->required >= 0 && !seen[frame.seen + it->required]) {
+        seen[frame.seen + it->required] = true;
+        frame.requiredSeen++;
+      }
+    }
+    return Status::PARSE_OK;
+  }
+
+  Status onEndObject() override {
+    auto& frame = frames.back();
+    if (frame.requiredSeen < schema.nodes[frame.node].requiredCount) {
+      return Status::SCHEMA_REQUIRED_MISSING;
+    }
+    seen.resize(frame.seen);
+    frames.pop_back();
+    return Status::PARSE_OK;
+  }
+
+ private:
+  struct Frame {
+    size_t node;
+    size_t child;
+    size_t seen;
+    size_t requiredSeen;
+  };
+
+  size_t expectedIndex() const {
+    return frames.empty() ? schema.root : frames.back().child;
+  }
+  const Schema::Node& expected() const {
+    return schema.nodes[expectedIndex()];
+  }
+
+  template <typename Equal>
+  Status checkEnum(const Schema::Node& node, Type t, Equal equal) const {
+    if (!node.hasEnum) {
+      return Status::PARSE_OK;
+    }
+    for (auto& e : node.enumValues) {
+      if (e.type == t && equal(e)) {
+        return Status::PARSE_OK;
+      }
+    }
+    return Status::SCHEMA_ENUM_MISMATCH;
+  }
+
+  template <typename Equal>
+  Status checkScalar(const Schema::Node& node, Type t, Equal equal) const {
+    if ((node.types & (1 << castEnum(t))) == 0) {
+      return Status::SCHEMA_TYPE_MISMATCH;
+    }
+    return checkEnum(node, t, equal);
+  }
+
+  Status checkContainer(const Schema::Node& node, Type t) const {
+    if ((node.types & (1 << castEnum(t))) == 0) {
+      return Status::SCHEMA_TYPE_MISMATCH;
+    }
+    // enum values are all scalars
+    return node.hasEnum ? Status::SCHEMA_ENUM_MISMATCH : Status::PARSE_OK;
+  }
+
+  const Schema& schema;
+  vector<Frame> frames;
+  vector<bool> seen;
+};
+
+Status Schema::validate(std::string_view json) const {
+  thread_local Context context;
+  return validate(context, json);
+}
+
+Status Schema::validate(Context& context, std::string_view json) const {
+  SchemaValidator validator(*this);
+  Status status = context.parse(json, validator);
+  return status == Status::PARSE_OK ? Status::SCHEMA_OK : status;
+}
+
+}  // namespace yph
@@ -0,0 +1,108 @@
+#ifndef YJSON_SCHEMA_H__
+#define YJSON_SCHEMA_H__
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <utility>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Validation against a practical subset of JSON Schema:
+ *   type (a name or a list, "integer" included), enum (of scalar values),
+ *   minimum, maximum, minLength, maxLength (in code points), pattern,
+ *   properties, required, items (one schema for every element)
+ * and true/false as schemas. compile() turns the schema into a table of
+ * nodes, one per subschema, with object properties sorted for lookup.
+ * validate() then checks a document in a single pass over the parser
+ * events, walking that table as a state machine: no Value is built and the
+ * first violation stops the parse. Annotations (title, description, $id,
+ * $schema, $comment, default, examples) are ignored, any other keyword is
+ * SCHEMA_INVALID rather than silently unchecked.
+ * A pattern is ECMAScript syntax without backreferences and lookahead,
+ * matched on code points by an automaton that runs all of its states at
+ * once: time linear in the string, and no recursion however long it is.
+ */
+class Schema {
+ public:
+  Status compile(const Value& schema);
+  Status compile(std::string_view json);
+  // SCHEMA_OK, the PARSE_* error of malformed json or the first violation
+  Status validate(std::string_view json) const;
+  // context.position() is then where validation stopped
+  Status validate(Context& context, std::string_view json) const;
+
+ private:
+  friend class SchemaValidator;
+  friend class PatternCompiler;
+  // bit 1 << Type for each accepted type, kInteger for whole numbers
+  static constexpr std::uint8_t kInteger = 0x80;
+  static constexpr std::uint8_t kAnyType = 0x7F;
+  // node accepting anything, for unlisted members and missing items
+  static constexpr size_t kAny = 0;
+
+  struct Property {
+    string key;
+    size_t node;
+    // index among the required members, or -1
+    int required;
+  };
+
+  struct Node {
+    std::uint8_t types = kAnyType;
+    bool hasEnum = false;
+    double minimum = -std::numeric_limits<double>::infinity();
+    double maximum = std::numeric_limits<double>::infinity();
+    size_t minLength = 0;
+    size_t maxLength = std::numeric_limits<size_t>::max();
+    int pattern = -1;
+    size_t items = kAny;
+    size_t requiredCount = 0;
+    vector<Property> properties;
+    vector<Value> enumValues;
+  };
+
+  // a Thompson automaton: instructions that consume one code point, and
+  // jumps, splits and assertions that consume nothing
+  struct Pattern {
+    enum class Op : std::uint8_t {
+      CHAR,
+      CLASS,
+      SPLIT,
+      JUMP,
+      LINE_START,
+      LINE_END,
+      WORD_BOUNDARY,
+      NOT_WORD_BOUNDARY,
+      MATCH
+    };
+    struct Inst {
+      Op op;
+      // the code point, the class or the jump target; y is the second
+      // target of a split
+      std::uint32_t x = 0;
+      std::uint32_t y = 0;
+    };
+    // sorted, disjoint and inclusive code point ranges
+    using Ranges = vector<std::pair<char32_t, char32_t>>;
+
+    // anywhere in s, unless anchored by ^ or $
+    bool search(std::string_view s) const;
+
+    vector<Inst> program;
+    vector<Ranges> classes;
+  };
+
+  Status compileNode(const Value& schema, size_t& index);
+
+  // until compiled, only the node accepting anything
+  vector<Node> nodes = vector<Node>(1);
+  vector<Pattern> patterns;
+  size_t root = kAny;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_SCHEMA*/
@@ -0,0 +1,257 @@
+#include "yjson_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace yph {
+
+/*SNAPSHOT WRITER*/
+Status writeSnapshot(const Tape& tape, const string& path) {
+  assert(!tape.words.empty());
+  SnapshotHeader header;
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.byteOrder = kSnapshotByteOrder;
+  header.wordCount = tape.words.size();
+  header.stringBytes = tape.strings.size();
+
+  // a unique name per writer, on the same file system as path
+  string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0) {
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+  // mkstemp creates 0600, readers may run as other users
+  fchmod(fd, 0644);
+  FILE* fp = fdopen(fd, "wb");
+  if (fp == nullptr) {
+    ::close(fd);
+    unlink(tmp.c_str());
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(tape.words.data(), sizeof(std::uint64_t), tape.words.size(),
+                   fp) == tape.words.size() &&
+            fwrite(tape.strings.data(), 1, tape.strings.size(), fp) ==
+                tape.strings.size();
+  // on disk before the rename makes it visible, or a crash can leave a
+  // renamed file with missing contents
+  ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+  return Status::SNAPSHOT_OK;
+}
+
+Status writeSnapshot(const ValuePtr v, const string& path) {
+  Tape tape;
+  if (Status status = toTape(v, tape); status != Status::TAPE_OK) {
+    return status;
+  }
+  return writeSnapshot(tape, path);
+}
+
+/*SNAPSHOT READER*/
+// The file may be truncated or corrupt: every word is checked once, so that
+// the accessors can follow offsets and indices without reading outside the
+// mapping. One value must span the whole tape, strings must lie inside the
+// string bytes, every container must end where its start word says, and
+// object members must start with a key.
+static bool validTape(const std::uint64_t* words, size_t n,
+                      size_t stringBytes) {
+  using namespace tape;
+  struct Open {
+    size_t start;
+    size_t children;
+  };
+  vector<Open> open;
+  size_t i = 0;
+  do {
+    char tag = tagOf(words[i]);
+    std::uint64_t payload = payloadOf(words[i]);
+    if (!open.empty() && tagOf(words[open.back().start]) == '{' &&
+        open.back().children % 2 == 0 && tag != 's' && tag != '}') {
+      return false;
+    }
+    if (tag != ']' && tag != '}' && !open.empty()) {
+      open.back().children++;
+    }
+    switch (tag) {
+      case 'n':
+      case 't':
+      case 'f': {
+        i++;
+        break;
+      }
+      case 'd': {
+        i += 2;
+        break;
+      }
+      case 's': {
+        if (i + 1 >= n || payload > stringBytes ||
+            words[i + 1] > stringBytes - payload) {
+          return false;
+        }
+        i += 2;
+        break;
+      }
+      case '[':
+      case '{': {
+        // the end word sits right before the index stored here
+        std::uint64_t end = payload & kIndexMask;
+        if (end < i + 2 || end > n) {
+          return false;
+        }
+        open.push_back({i, 0});
+        i++;
+        break;
+      }
+      case ']':
+      case '}': {
+        if (open.empty()) {
+          return false;
+        }
+        Open o = open.back();
+        open.pop_back();
+        std::uint64_t start = payloadOf(words[o.start]);
+        size_t size = tag == '}' ? o.children / 2 : o.children;
+        if (tagOf(words[o.start]) != (tag == ']' ? '[' : '{') ||
+            payload != o.start || (start & kIndexMask) != i + 1 ||
+            (tag == '}' && o.children % 2 != 0) ||
+            (start >> kCountShift) !=
+                std::min<std::uint64_t>(size, kCountMax)) {
+          return false;
+        }
+        i++;
+        break;
+      }
+      default: {
+        return false;
+      }
+    }
+  } while (!open.empty() && i < n);
+  return open.empty() && i == n;
+}
+
+// The root alone, in constant time: a scalar fills the tape, or the
+// container's start and end words point at each other across all of it.
+static bool validRoot(const std::uint64_t* words, size_t n,
+                      size_t stringBytes) {
+  using namespace tape;
+  std::uint64_t payload = payloadOf(words[0]);
+  switch (tagOf(words[0])) {
+    case 'n':
+    case 't':
+    case 'f':
+      return n == 1;
+    case 'd':
+      return n == 2;
+    case 's':
+      return n == 2 && payload <= stringBytes &&
+             words[1] <= stringBytes - payload;
+    case '[':
+    case '{':
+      return n >= 2 && (payload & kIndexMask) == n &&
+             tagOf(words[n - 1]) == (tagOf(words[0]) == '[' ? ']' : '}') &&
+             payloadOf(words[n - 1]) == 0;
+    default:
+      return false;
+  }
+}
+
+Snapshot::~Snapshot() { close(); }
+
+Snapshot::Snapshot(Snapshot&& other) noexcept
+    : base(other.base), length(other.length) {
+  other.base = nullptr;
+  other.length = 0;
+}
+
+Snapshot& Snapshot::operator=(Snapshot&& other) noexcept {
+  if (this != &other) {
+    close();
+    std::swap(base, other.base);
+    std::swap(length, other.length);
+  }
+  return *this;
+}
+
+Status Snapshot::open(const string& path, Verify verify) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  if (size < sizeof(SnapshotHeader)) {
+    ::close(fd);
+    return Status::SNAPSHOT_INVALID_FORMAT;
+  }
+  void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return Status::SNAPSHOT_IO_ERROR;
+  }
+
+  auto header = static_cast<const SnapshotHeader*>(addr);
+  Status status = Status::SNAPSHOT_OK;
+  if (std::memcmp(header->magic, kSnapshotMagic, sizeof(header->magic)) != 0 ||
+      header->byteOrder != kSnapshotByteOrder) {
+    status = Status::SNAPSHOT_INVALID_FORMAT;
+  } else if (header->version != kSnapshotVersion) {
+    status = Status::SNAPSHOT_VERSION_MISMATCH;
+  } else if (header->wordCount == 0 ||
+             header->wordCount > (size - sizeof(SnapshotHeader)) /
+                                     sizeof(std::uint64_t) ||
+             header->stringBytes !=
+                 size - sizeof(SnapshotHeader) -
+                     header->wordCount * sizeof(std::uint64_t)) {
+    status = Status::SNAPSHOT_INVALID_FORMAT;
+  } else {
+    auto words = reinterpret_cast<const std::uint64_t*>(header + 1);
+    bool valid = verify == Verify::FULL
+                     ? validTape(words, header->wordCount, header->stringBytes)
+                     : validRoot(words, header->wordCount, header->stringBytes);
+    if (!valid) {
+      status = Status::SNAPSHOT_INVALID_FORMAT;
+    }
+  }
+  if (status != Status::SNAPSHOT_OK) {
+    munmap(addr, size);
+    return status;
+  }
+  base = addr;
+  length = size;
+  return Status::SNAPSHOT_OK;
+}
+
+void Snapshot::close() {
+  if (base != nullptr) {
+    munmap(base, length);
+    base = nullptr;
+    length = 0;
+  }
+}
+
+TapeRef Snapshot::root() const {
+  assert(isOpen());
+  auto header = static_cast<const SnapshotHeader*>(base);
+  auto words = reinterpret_cast<const std::uint64_t*>(header + 1);
+  auto strings = reinterpret_cast<const char*>(words + header->wordCount);
+  return TapeRef(words, strings, 0);
+}
+
+}  // namespace yph
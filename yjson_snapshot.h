@@ -0,0 +1,69 @@
+#ifndef YJSON_SNAPSHOT_H__
+#define YJSON_SNAPSHOT_H__
+
+#include <cstdint>
+
+#include "yjson_tape.h"
+
+namespace yph {
+/*
+ * Binary snapshot of a tape, laid out so that it can be mmap-ed and read in
+ * place:
+ *   SnapshotHeader | tape words (8-byte aligned) | string bytes
+ * Several processes mapping the same file share it through the page cache.
+ */
+constexpr char kSnapshotMagic[8] = {'Y', 'J', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr std::uint32_t kSnapshotVersion = 1;
+// written in native order, a mismatch means the file comes from another arch
+constexpr std::uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint64_t wordCount;
+  std::uint64_t stringBytes;
+};
+static_assert(sizeof(SnapshotHeader) == 32, "header must keep words aligned");
+
+/*SNAPSHOT WRITER*/
+// the file is written next to path and renamed over it, so processes that
+// still map an older snapshot keep a consistent view
+Status writeSnapshot(const Tape& tape, const string& path);
+// TAPE_TOO_LARGE when v does not fit in a tape
+Status writeSnapshot(const ValuePtr v, const string& path);
+
+/*SNAPSHOT READER*/
+// what Snapshot::open checks before the tape is read
+enum class Verify {
+  // the header, the sizes and the root's first and last words: only those
+  // pages are touched, the rest of the tape is faulted in as it is read.
+  // For files written by a trusted process, a corrupt one misreads memory.
+  HEADER,
+  // every word of the tape, once, so that a corrupt file fails with
+  // SNAPSHOT_INVALID_FORMAT; for files from untrusted sources
+  FULL,
+};
+
+class Snapshot {
+ public:
+  Snapshot() = default;
+  ~Snapshot();
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+  Snapshot(Snapshot&& other) noexcept;
+  Snapshot& operator=(Snapshot&& other) noexcept;
+
+  Status open(const string& path, Verify verify = Verify::HEADER);
+  void close();
+  bool isOpen() const { return base != nullptr; }
+  TapeRef root() const;
+
+ private:
+  void* base = nullptr;
+  size_t length = 0;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_SNAPSHOT*/
@@ -0,0 +1,218 @@
+#include "yjson_source.h"
+
+#include <algorithm>
+
+#include "yjson_patch.h"
+
+namespace yph {
+
+/*SOURCE RANGES*/
+static size_t skipSpace(const string& text, size_t p) {
+  while (p < text.size() && (text[p] == ' ' || text[p] == '\t' ||
+                             text[p] == '\n' || text[p] == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// p is at the opening quote, the result past the closing one
+static size_t skipString(const string& text, size_t p) {
+  for (p++; text[p] != '\"'; p++) {
+    p += text[p] == '\\';
+  }
+  return p + 1;
+}
+
+// Ranges of v and its children, v being the value just parsed from the
+// text at p; only the token boundaries are looked for. Returns the end.
+// Children vectors left from a previous scan are reused.
+static size_t scanValue(const string& text, size_t p, const Value& v,
+                        SourceSpan& span) {
+  size_t start = p;
+  size_t n = 0;
+  switch (v.type) {
+    case Type::NVLL:
+    case Type::TRUE: {
+      p += 4;
+      break;
+    }
+    case Type::FALSE: {
+      p += 5;
+      break;
+    }
+    case Type::NUMBER: {
+      while (p < text.size() &&
+             std::string_view("+-.eE0123456789").find(text[p]) !=
+                 std::string_view::npos) {
+        p++;
+      }
+      break;
+    }
+    case Type::STRING: {
+      p = skipString(text, p);
+      break;
+    }
+    case Type::ARRAY:
+    case Type::OBJECT: {
+      n = v.type == Type::ARRAY ? std::get<vector<Value>>(v.data).size()
+                                : std::get<vector<Entry>>(v.data).size();
+      span.children.resize(n);
+      p = skipSpace(text, p + 1);
+      for (size_t i = 0; i < n; i++) {
+        const Value* child = nullptr;
+        if (v.type == Type::ARRAY) {
+          child = &std::get<vector<Value>>(v.data)[i];
+        } else {
+          // key and colon
+          p = skipSpace(text, skipString(text, p));
+          p = skipSpace(text, p + 1);
+          child = &std::get<vector<Entry>>(v.data)[i].val;
+        }
+        span.children[i].begin = p - start;
+        p = skipSpace(text, scanValue(text, p, *child, span.children[i]));
+        // the comma, or the closing bracket after the last child
+        p = i + 1 < n ? skipSpace(text, p + 1) : p;
+      }
+      p++;
+      break;
+    }
+  }
+  span.children.resize(n);
+  span.length = p - start;
+  return p;
+}
+
+/*SOURCE DOCUMENT*/
+Status SourceDocument::parse(std::string_view json) {
+  source.assign(json);
+  return parseAll();
+}
+
+Status SourceDocument::parseAll() {
+  reparsed += source.size();
+  last = context.parse(tree, source);
+  if (last == Status::PARSE_OK) {
+    span.begin = skipSpace(source, 0);
+    scanValue(source, span.begin, tree, span);
+  } else {
+    span = SourceSpan();
+  }
+  return last;
+}
+
+Status SourceDocument::edit(size_t offset, size_t removed,
+                            std::string_view inserted) {
+  assert(offset <= source.size() && removed <= source.size() - offset);
+  source.replace(offset, removed, inserted);
+  reparsed = 0;
+  if (last != Status::PARSE_OK || offset < span.begin ||
+      offset + removed > span.begin + span.length) {
+    return parseAll();
+  }
+
+  // down to the innermost node whose range holds the edit
+  path.clear();
+  path.push_back({&tree, &span, span.begin});
+  for (;;) {
+    auto& step = path.back();
+    auto& children = step.span->children;
+    auto it = std::upper_bound(
+        children.begin(), children.end(), offset - step.begin,
+        [](size_t o, const SourceSpan& child) { return o < child.begin; });
+    if (it == children.begin()) {
+      break;
+    }
+    --it;
+    size_t begin = step.begin + it->begin;
+    if (offset + removed > begin + it->length) {
+      break;
+    }
+    size_t i = it - children.begin();
+    Value* child = step.v->type == Type::ARRAY
+                       ? &std::get<vector<Value>>(step.v->data)[i]
+                       : &std::get<vector<Entry>>(step.v->data)[i].val;
+    path.push_back({child, &*it, begin});
+  }
+
+  // that node, then its parent; the root is parsed with its whitespace
+  for (size_t level = path.size() - 1; level > 0 && level + 2 >= path.size();
+       level--) {
+    if (reparse(level, removed, inserted.size())) {
+      return last;
+    }
+  }
+  return parseAll();
+}
+
+// the node at path[level] from its new text, false when that text is not
+// exactly one value
+bool SourceDocument::reparse(size_t level, size_t removed, size_t inserted) {
+  auto& step = path[level];
+  size_t length = step.span->length - removed + inserted;
+  std::string_view text = std::string_view(source).substr(step.begin, length);
+  reparsed += length;
+  Value fresh;
+  // the node is level containers deep: only the rest of maxDepth is left
+  size_t maxDepth = context.getMaxDepth();
+  context.setMaxDepth(maxDepth - level);
+  Status status = context.parseValue(fresh, text);
+  context.setMaxDepth(maxDepth);
+  if (status != Status::PARSE_OK || context.position() != length) {
+    return false;
+  }
+  *step.v = std::move(fresh);
+  scanValue(source, step.begin, *step.v, *step.span);
+
+  // the ancestors grow with the edit, their later children move with it
+  for (size_t up = level; up-- > 0;) {
+    auto& parent = path[up];
+    parent.span->length = parent.span->length - removed + inserted;
+    auto& siblings = parent.span->children;
+    for (size_t i = path[up + 1].span - siblings.data() + 1;
+         i < siblings.size(); i++) {
+      siblings[i].begin = siblings[i].begin - removed + inserted;
+    }
+    invalidateHash(*parent.v);
+  }
+  return true;
+}
+
+bool SourceDocument::sourceRange(std::string_view pointer, size_t& begin,
+                                 size_t& end) const {
+  vector<string> tokens;
+  if (last != Status::PARSE_OK ||
+      parsePointer(pointer, tokens) != Status::PATCH_OK) {
+    return false;
+  }
+  const Value* v = &tree;
+  const SourceSpan* s = &span;
+  begin = span.begin;
+  for (auto& token : tokens) {
+    size_t i = 0;
+    if (v->type == Type::ARRAY) {
+      auto& elements = std::get<vector<Value>>(v->data);
+      if (!pointerIndex(token, elements.size(), false, i)) {
+        return false;
+      }
+      v = &elements[i];
+    } else if (v->type == Type::OBJECT) {
+      // the first member with that key, as resolvePointer finds it
+      auto& entries = std::get<vector<Entry>>(v->data);
+      while (i < entries.size() && entries[i].key != token) {
+        i++;
+      }
+      if (i == entries.size()) {
+        return false;
+      }
+      v = &entries[i].val;
+    } else {
+      return false;
+    }
+    s = &s->children[i];
+    begin += s->begin;
+  }
+  end = begin + s->length;
+  return true;
+}
+
+}  // namespace yph
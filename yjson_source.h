@@ -0,0 +1,68 @@
+#ifndef YJSON_SOURCE_H__
+#define YJSON_SOURCE_H__
+
+#include <string_view>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * A parsed document that keeps its text and the source range of every
+ * node, for editors that re-parse on every keystroke. An edit re-parses
+ * only the innermost node whose range holds it: the new text of that range
+ * must parse as exactly one value, which then replaces the node. When it
+ * does not, the edit changed the structure around the node; its parent is
+ * tried next, and then the whole text. Ranges are kept relative to the
+ * parent, so an edit only moves the later siblings along its path.
+ */
+struct SourceSpan {
+  // offset from the start of the parent's range, from the start of the
+  // text for the root
+  size_t begin = 0;
+  size_t length = 0;
+  // one per element, or per member value in member order
+  vector<SourceSpan> children;
+};
+
+class SourceDocument {
+ public:
+  Status parse(std::string_view json);
+  // replace removed bytes at offset by inserted, then parse the new text;
+  // statuses are those of a full parse. After an error the tree is null
+  // and every edit parses the whole text until it is valid again.
+  Status edit(size_t offset, size_t removed, std::string_view inserted);
+
+  const string& text() const { return source; }
+  const Value& root() const { return tree; }
+  const SourceSpan& rootSpan() const { return span; }
+  Status status() const { return last; }
+  // absolute [begin, end) of the node at a JSON Pointer, false when there
+  // is no such node
+  bool sourceRange(std::string_view pointer, size_t& begin,
+                   size_t& end) const;
+  // bytes parsed by the last parse or edit, failed attempts included
+  size_t reparsedBytes() const { return reparsed; }
+
+ private:
+  // a node on the way down to an edit and its absolute start
+  struct Step {
+    Value* v;
+    SourceSpan* span;
+    size_t begin;
+  };
+
+  Status parseAll();
+  bool reparse(size_t level, size_t removed, size_t inserted);
+
+  Context context;
+  string source;
+  Value tree;
+  SourceSpan span;
+  Status last = Status::PARSE_EXPECT_VALUE;
+  size_t reparsed = 0;
+  vector<Step> path;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_SOURCE*/
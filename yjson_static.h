@@ -0,0 +1,664 @@
+#ifndef YJSON_STATIC_H__
+#define YJSON_STATIC_H__
+
+#include <cstdint>
+#include <string_view>
+
+#include "yjson_tape.h"
+
+namespace yph {
+/*
+ * Compile-time parsing of JSON string literals into a read-only tape:
+ *   static constexpr auto defaults = YJSON_STATIC(R"({"retries": 3})");
+ *   getNumber(getObjectValue(defaults.root(), 0));  // 3, via TapeRef
+ * The words are those parseTape would produce, so the tape accessors work
+ * unchanged and nothing is parsed at startup. Invalid JSON does not
+ * compile: the error points at the check that failed, e.g.
+ *   error: call to non-'constexpr' function 'void yph::constant::fail(...)'
+ *       fail(Status::PARSE_MISS_COLON);
+ * Numbers are converted exactly (correctly rounded, like strtod) with
+ * integer arithmetic, as floating point bit casts are not constexpr.
+ */
+template <size_t Words, size_t Chars>
+class StaticDocument {
+ public:
+  std::uint64_t words[Words] = {};
+  char strings[Chars + 1] = {};
+
+  constexpr TapeRef root() const { return TapeRef(words, strings, 0); }
+};
+
+namespace constant {
+constexpr size_t kMaxDepth = 256;
+// beyond this many significant digits the rest only matters as "nonzero",
+// exact halfway cases between doubles need at most 767
+constexpr int kMaxDigits = 800;
+
+// not a constant expression: reaching it during constant evaluation is the
+// compile error
+inline void fail(Status status) { throw status; }
+
+// unsigned integer of up to 140 * 32 bits, enough for 800 digits scaled by
+// the widest exponent of a finite double
+class BigInt {
+ public:
+  static constexpr size_t kLimbs = 140;
+
+  constexpr void mulAdd(std::uint32_t mul, std::uint32_t add) {
+    std::uint64_t carry = add;
+    for (size_t i = 0; i < n; i++) {
+      std::uint64_t t = std::uint64_t(limb[i]) * mul + carry;
+      limb[i] = static_cast<std::uint32_t>(t);
+      carry = t >> 32;
+    }
+    if (carry != 0) {
+      push(static_cast<std::uint32_t>(carry));
+    }
+  }
+
+  constexpr void mulPow10(int e) {
+    for (; e >= 9; e -= 9) {
+      mulAdd(1000000000, 0);
+    }
+    for (; e > 0; e--) {
+      mulAdd(10, 0);
+    }
+  }
+
+  constexpr void shiftLeft(size_t bits) {
+    if (n == 0) {
+      return;
+    }
+    size_t limbs = bits / 32;
+    size_t rest = bits % 32;
+    if (n + limbs + 1 > kLimbs) {
+      fail(Status::PARSE_NUMBER_TOO_BIG);
+    }
+    limb[n + limbs] = 0;
+    for (size_t i = n; i-- > 0;) {
+      std::uint64_t t = std::uint64_t(limb[i]) << rest;
+      limb[i + limbs + 1] |= static_cast<std::uint32_t>(t >> 32);
+      limb[i + limbs] = static_cast<std::uint32_t>(t);
+    }
+    for (size_t i = 0; i < limbs; i++) {
+      limb[i] = 0;
+    }
+    n += limbs + 1;
+    trim();
+  }
+
+  constexpr void shiftRight1() {
+    for (size_t i = 0; i < n; i++) {
+      limb[i] = (limb[i] >> 1) | (i + 1 < n ? limb[i + 1] << 31 : 0);
+    }
+    trim();
+  }
+
+  // this -= other, other <= this
+  constexpr void subtract(const BigInt& other) {
+    std::int64_t borrow = 0;
+    for (size_t i = 0; i < n; i++) {
+      std::int64_t t = std::int64_t(limb[i]) - borrow -
+                       (i < other.n ? std::int64_t(other.limb[i]) : 0);
+      borrow = t < 0;
+      limb[i] = static_cast<std::uint32_t>(t + (borrow << 32));
+    }
+    trim();
+  }
+
+  constexpr int compare(const BigInt& other) const {
+    if (n != other.n) {
+      return n < other.n ? -1 : 1;
+    }
+    for (size_t i = n; i-- > 0;) {
+      if (limb[i] != other.limb[i]) {
+        return limb[i] < other.limb[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+
+  constexpr size_t bitLength() const {
+    if (n == 0) {
+      return 0;
+    }
+    size_t bits = 32 * (n - 1);
+    for (std::uint32_t top = limb[n - 1]; top != 0; top >>= 1) {
+      bits++;
+    }
+    return bits;
+  }
+
+  constexpr bool isZero() const { return n == 0; }
+
+ private:
+  constexpr void push(std::uint32_t value) {
+    if (n == kLimbs) {
+      fail(Status::PARSE_NUMBER_TOO_BIG);
+    }
+    limb[n++] = value;
+  }
+
+  constexpr void trim() {
+    while (n > 0 && limb[n - 1] == 0) {
+      n--;
+    }
+  }
+
+  std::uint32_t limb[kLimbs] = {};
+  size_t n = 0;
+};
+
+constexpr size_t bitLength(std::uint64_t v) {
+  size_t bits = 0;
+  for (; v != 0; v >>= 1) {
+    bits++;
+  }
+  return bits;
+}
+
+// IEEE 754 bits of digits * 10^exp10, correctly rounded to nearest even;
+// digits and exp10 come from a validated literal
+constexpr std::uint64_t decimalBits(const BigInt& digits, int exp10,
+                                    bool negative) {
+  std::uint64_t sign = negative ? std::uint64_t(1) << 63 : 0;
+  if (digits.isZero()) {
+    return sign;
+  }
+  // value in [10^(magnitude-1), 10^magnitude)
+  int magnitude = exp10;
+  {
+    BigInt power;
+    power.mulAdd(0, 1);
+    for (; power.compare(digits) <= 0; magnitude++) {
+      power.mulAdd(10, 0);
+    }
+  }
+  if (magnitude > 309) {
+    fail(Status::PARSE_NUMBER_TOO_BIG);
+  }
+  if (magnitude < -324) {
+    return sign;  // below half the smallest subnormal
+  }
+
+  // q = floor(digits * 10^exp10 * 2^shift), 55 or 56 bits, sticky for the
+  // rest
+  BigInt num = digits;
+  BigInt den;
+  den.mulAdd(0, 1);
+  if (exp10 >= 0) {
+    num.mulPow10(exp10);
+  } else {
+    den.mulPow10(-exp10);
+  }
+  int shift = static_cast<int>(den.bitLength()) -
+              static_cast<int>(num.bitLength()) + 55;
+  if (shift > 0) {
+    num.shiftLeft(shift);
+  } else {
+    den.shiftLeft(-shift);
+  }
+  den.shiftLeft(56);
+  std::uint64_t q = 0;
+  for (int k = 56; k >= 0; k--) {
+    if (num.compare(den) >= 0) {
+      num.subtract(den);
+      q |= std::uint64_t(1) << k;
+    }
+    den.shiftRight1();
+  }
+  bool sticky = !num.isZero();
+
+  // keep 53 bits, fewer for subnormals
+  int length = static_cast<int>(bitLength(q));
+  int top = length - 1 - shift;  // exponent of the leading bit
+  int keep = top >= -1022 ? 53 : 53 - (-1022 - top);
+  if (keep < 0) {
+    return sign;
+  }
+  int drop = length - keep;
+  std::uint64_t m = q >> drop;
+  std::uint64_t rest = q & ((std::uint64_t(1) << drop) - 1);
+  std::uint64_t half = std::uint64_t(1) << (drop - 1);
+  if (rest > half || (rest == half && (sticky || (m & 1) != 0))) {
+    m++;
+  }
+  if (m == 0) {
+    return sign;
+  }
+  // value = m * 2^exp2, rounding may have carried into a new bit
+  int exp2 = drop - shift;
+  int mLength = static_cast<int>(bitLength(m));
+  int biased = exp2 + mLength - 1 + 1023;
+  if (biased >= 2047) {
+    fail(Status::PARSE_NUMBER_TOO_BIG);
+  }
+  if (biased <= 0) {
+    // subnormal: m is already aligned to 2^-1074
+    return sign | (m << (exp2 + 1074));
+  }
+  std::uint64_t fraction =
+      (m << (53 - mLength)) & ((std::uint64_t(1) << 52) - 1);
+  return sign | (std::uint64_t(biased) << 52) | fraction;
+}
+
+// Validates json with the same rules as Context::parse and emits tape words
+// to the sink: the size pass counts them, the second pass stores them.
+template <typename Sink>
+class Parser {
+ public:
+  constexpr Parser(std::string_view json, Sink& sink)
+      : json(json), sink(sink) {}
+
+  constexpr void parse() {
+    skipWhitespace();
+    if (pos == json.size()) {
+      fail(Status::PARSE_EXPECT_VALUE);
+    }
+    readValue(0);
+    skipWhitespace();
+    if (pos != json.size()) {
+      fail(Status::PARSE_ROOT_NOT_SINGULAR);
+    }
+  }
+
+ private:
+  constexpr bool atEnd() const { return pos == json.size(); }
+  constexpr char peek() const { return atEnd() ? '\0' : json[pos]; }
+
+  constexpr void skipWhitespace() {
+    while (!atEnd() && (json[pos] == ' ' || json[pos] == '\t' ||
+                        json[pos] == '\n' || json[pos] == '\r')) {
+      pos++;
+    }
+  }
+
+  constexpr void readValue(size_t depth) {
+    switch (peek()) {
+      case 'n': {
+        readLiteral("null", 'n');
+        break;
+      }
+      case 't': {
+        readLiteral("true", 't');
+        break;
+      }
+      case 'f': {
+        readLiteral("false", 'f');
+        break;
+      }
+      case '\"': {
+        readString();
+        break;
+      }
+      case '[':
+      case '{': {
+        readContainer(depth + 1);
+        break;
+      }
+      case '\0': {
+        fail(Status::PARSE_EXPECT_VALUE);
+        break;
+      }
+      default: {
+        readNumber();
+      }
+    }
+  }
+
+  constexpr void readLiteral(std::string_view literal, char tag) {
+    if (json.substr(pos, literal.size()) != literal) {
+      fail(Status::PARSE_INVALID_VALUE);
+    }
+    pos += literal.size();
+    sink.push(tape::makeWord(tag, 0));
+  }
+
+  constexpr bool isDigit(char ch) const { return ch >= '0' && ch <= '9'; }
+
+  constexpr void readNumber() {
+    bool negative = false;
+    if (peek() == '-') {
+      negative = true;
+      pos++;
+    }
+    BigInt digits;
+    int count = 0;  // significant digits kept in digits
+    bool dropped = false;
+    int exp10 = 0;
+    auto addDigit = [&](char ch, bool fraction) {
+      if (count == 0 && ch == '0') {
+        exp10 -= fraction;
+        return;
+      }
+      if (count < kMaxDigits) {
+        digits.mulAdd(10, ch - '0');
+        count++;
+        exp10 -= fraction;
+      } else {
+        dropped = dropped || ch != '0';
+        exp10 += !fraction;
+      }
+    };
+    if (peek() == '0') {
+      pos++;
+    } else if (peek() >= '1' && peek() <= '9') {
+      for (; isDigit(peek()); pos++) {
+        addDigit(peek(), false);
+      }
+    } else {
+      fail(Status::PARSE_INVALID_VALUE);
+    }
+    if (peek() == '.') {
+      pos++;
+      if (!isDigit(peek())) {
+        fail(Status::PARSE_INVALID_VALUE);
+      }
+      for (; isDigit(peek()); pos++) {
+        addDigit(peek(), true);
+      }
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      pos++;
+      bool expNegative = false;
+      if (peek() == '+' || peek() == '-') {
+        expNegative = peek() == '-';
+        pos++;
+      }
+      if (!isDigit(peek())) {
+        fail(Status::PARSE_INVALID_VALUE);
+      }
+      int exp = 0;
+      for (; isDigit(peek()); pos++) {
+        exp = exp < 100000 ? exp * 10 + (peek() - '0') : exp;
+      }
+      exp10 += expNegative ? -exp : exp;
+    }
+    if (dropped) {
+      // a nonzero tail: any digit past the kept ones rounds the same way
+      digits.mulAdd(10, 1);
+      exp10--;
+    }
+    sink.push(tape::makeWord('d', 0));
+    sink.push(decimalBits(digits, exp10, negative));
+  }
+
+  constexpr unsigned readHex4() {
+    if (json.size() - pos < 4) {
+      fail(Status::PARSE_INVALID_UNICODE_HEX);
+    }
+    unsigned u = 0;
+    for (int i = 0; i < 4; i++) {
+      char ch = json[pos++];
+      u <<= 4;
+      if (ch >= '0' && ch <= '9') {
+        u += ch - '0';
+      } else if (ch >= 'A' && ch <= 'F') {
+        u += ch - 'A' + 10;
+      } else if (ch >= 'a' && ch <= 'f') {
+        u += ch - 'a' + 10;
+      } else {
+        fail(Status::PARSE_INVALID_UNICODE_HEX);
+      }
+    }
+    return u;
+  }
+
+  constexpr void appendUtf8(unsigned u) {
+    if (u <= 0x7F) {
+      sink.pushChar(static_cast<char>(u));
+    } else if (u <= 0x7FF) {
+      sink.pushChar(static_cast<char>(0xC0 | (u >> 6)));
+      sink.pushChar(static_cast<char>(0x80 | (u & 0x3F)));
+    } else if (u <= 0xFFFF) {
+      sink.pushChar(static_cast<char>(0xE0 | (u >> 12)));
+      sink.pushChar(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+      sink.pushChar(static_cast<char>(0x80 | (u & 0x3F)));
+    } else {
+      sink.pushChar(static_cast<char>(0xF0 | (u >> 18)));
+      sink.pushChar(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+      sink.pushChar(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+      sink.pushChar(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+  }
+
+  // the bytes after the lead byte c of a UTF-8 sequence, which must be
+  // well-formed as skipUtf8Sequence checks it
+  constexpr void copyUtf8Tail(unsigned char c) {
+    size_t tail = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+    unsigned char low = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+    if (c < 0xC2 || c > 0xF4 || json.size() - pos < tail) {
+      fail(Status::PARSE_INVALID_UTF8);
+    }
+    for (size_t i = 0; i < tail; i++) {
+      auto b = static_cast<unsigned char>(json[pos + i]);
+      if (i == 0 ? b < low || b > high : (b & 0xC0) != 0x80) {
+        fail(Status::PARSE_INVALID_UTF8);
+      }
+    }
+    for (size_t i = 0; i < tail; i++) {
+      sink.pushChar(json[pos++]);
+    }
+  }
+
+  // a string word and its length word, the bytes go to the string buffer
+  constexpr void readString() {
+    size_t start = sink.push(tape::makeWord('s', sink.chars));
+    size_t offset = sink.chars;
+    sink.push(0);
+    pos++;
+    for (;;) {
+      if (atEnd()) {
+        fail(Status::PARSE_MISS_QUOTATION_MARK);
+      }
+      char ch = json[pos++];
+      if (ch == '\"') {
+        break;
+      }
+      if (ch != '\\') {
+        if (static_cast<unsigned char>(ch) < 0x20) {
+          fail(Status::PARSE_INVALID_STRING_CHAR);
+        }
+        sink.pushChar(ch);
+        if (static_cast<unsigned char>(ch) >= 0x80) {
+          copyUtf8Tail(static_cast<unsigned char>(ch));
+        }
+        continue;
+      }
+      if (atEnd()) {
+        fail(Status::PARSE_INVALID_STRING_ESCAPE);
+      }
+      switch (json[pos++]) {
+        case '\"': {
+          sink.pushChar('\"');
+          break;
+        }
+        case '\\': {
+          sink.pushChar('\\');
+          break;
+        }
+        case '/': {
+          sink.pushChar('/');
+          break;
+        }
+        case 'b': {
+          sink.pushChar('\b');
+          break;
+        }
+        case 'f': {
+          sink.pushChar('\f');
+          break;
+        }
+        case 'n': {
+          sink.pushChar('\n');
+          break;
+        }
+        case 'r': {
+          sink.pushChar('\r');
+          break;
+        }
+        case 't': {
+          sink.pushChar('\t');
+          break;
+        }
+        case 'u': {
+          unsigned u = readHex4();
+          if (u >= 0xD800 && u <= 0xDBFF) {
+            if (json.substr(pos, 2) != "\\u") {
+              fail(Status::PARSE_INVALID_UNICODE_SURROGATE);
+            }
+            pos += 2;
+            unsigned low = readHex4();
+            if (low < 0xDC00 || low > 0xDFFF) {
+              fail(Status::PARSE_INVALID_UNICODE_SURROGATE);
+            }
+            u = (((u - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
+          }
+          if (u == 0) {
+            // like Context: an escaped NUL ends the string early
+            while (!atEnd() && json[pos] != '\"') {
+              pos++;
+            }
+            if (atEnd()) {
+              fail(Status::PARSE_MISS_QUOTATION_MARK);
+            }
+            pos++;
+            sink.set(start + 1, sink.chars - offset);
+            return;
+          }
+          appendUtf8(u);
+          break;
+        }
+        default: {
+          fail(Status::PARSE_INVALID_STRING_ESCAPE);
+        }
+      }
+    }
+    sink.set(start + 1, sink.chars - offset);
+  }
+
+  constexpr void readContainer(size_t depth) {
+    if (depth > kMaxDepth) {
+      fail(Status::PARSE_DEPTH_EXCEEDED);
+    }
+    bool isArray = json[pos++] == '[';
+    char close = isArray ? ']' : '}';
+    size_t start = sink.push(0);
+    std::uint64_t count = 0;
+    skipWhitespace();
+    if (peek() != close) {
+      for (;;) {
+        if (isArray) {
+          if (atEnd() || peek() == '}') {
+            fail(Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+          }
+        } else {
+          if (atEnd() || peek() == ']') {
+            fail(Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+          }
+          if (peek() != '\"') {
+            fail(Status::PARSE_MISS_KEY);
+          }
+          readString();
+          skipWhitespace();
+          if (peek() != ':') {
+            fail(Status::PARSE_MISS_COLON);
+          }
+          pos++;
+          skipWhitespace();
+        }
+        readValue(depth);
+        count++;
+        skipWhitespace();
+        if (peek() == ',') {
+          pos++;
+          skipWhitespace();
+          if (peek() == close) {
+            fail(Status::PARSE_INVALID_VALUE);
+          }
+          if (!isArray && atEnd()) {
+            fail(Status::PARSE_MISS_KEY);
+          }
+        } else if (peek() == close) {
+          break;
+        } else {
+          fail(isArray ? Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+                       : Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+        }
+      }
+    }
+    pos++;
+    sink.push(tape::makeWord(close, start));
+    count = count < tape::kCountMax ? count : tape::kCountMax;
+    sink.set(start, tape::makeWord(isArray ? '[' : '{',
+                                   (count << tape::kCountShift) | sink.words));
+  }
+
+  std::string_view json;
+  Sink& sink;
+  size_t pos = 0;
+};
+
+// first pass: how many words and string bytes the tape needs
+class SizeSink {
+ public:
+  constexpr size_t push(std::uint64_t) { return words++; }
+  constexpr void set(size_t, std::uint64_t) {}
+  constexpr void pushChar(char) { chars++; }
+
+  size_t words = 0;
+  size_t chars = 0;
+};
+
+template <size_t Words, size_t Chars>
+class DocumentSink {
+ public:
+  constexpr explicit DocumentSink(StaticDocument<Words, Chars>& doc)
+      : doc(doc) {}
+  constexpr size_t push(std::uint64_t word) {
+    doc.words[words] = word;
+    return words++;
+  }
+  constexpr void set(size_t index, std::uint64_t word) {
+    doc.words[index] = word;
+  }
+  constexpr void pushChar(char ch) { doc.strings[chars++] = ch; }
+
+  StaticDocument<Words, Chars>& doc;
+  size_t words = 0;
+  size_t chars = 0;
+};
+}  // namespace constant
+
+struct StaticSizes {
+  size_t words;
+  size_t chars;
+};
+
+constexpr StaticSizes staticSizes(std::string_view json) {
+  constant::SizeSink sink;
+  constant::Parser<constant::SizeSink>(json, sink).parse();
+  return {sink.words, sink.chars};
+}
+
+template <size_t Words, size_t Chars>
+constexpr StaticDocument<Words, Chars> parseStatic(std::string_view json) {
+  StaticDocument<Words, Chars> doc;
+  constant::DocumentSink<Words, Chars> sink(doc);
+  constant::Parser<constant::DocumentSink<Words, Chars>>(json, sink).parse();
+  return doc;
+}
+
+}  // namespace yph
+
+// Sized and parsed at compile time, assign it to a constexpr variable.
+#define YJSON_STATIC(json)                                        \
+  ([] {                                                           \
+    constexpr std::string_view yjsonText = json;                  \
+    constexpr auto yjsonSizes = ::yph::staticSizes(yjsonText);    \
+    return ::yph::parseStatic<yjsonSizes.words, yjsonSizes.chars>( \
+        yjsonText);                                               \
+  }())
+
+#endif /*YJSON_STATIC*/
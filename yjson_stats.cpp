@@ -0,0 +1,171 @@
+#include "yjson_stats.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace yph {
+namespace stats {
+// plain thread locals, so operator new can touch them without initializers
+thread_local bool recording = false;
+thread_local size_t allocations = 0;
+thread_local size_t allocatedBytes = 0;
+}  // namespace stats
+}  // namespace yph
+
+#ifdef YJSON_STATS
+void* operator new(size_t size) {
+  if (yph::stats::recording) {
+    yph::stats::allocations++;
+    yph::stats::allocatedBytes += size;
+  }
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#endif
+
+namespace yph {
+namespace stats {
+struct State {
+  int scopes = 0;
+  size_t depth = 0;
+  Stats current;
+  Stats last;
+};
+thread_local State state;
+StatsHook hook;
+bool perfEnabled = false;
+
+#ifdef __linux__
+// one counter per event, opened lazily for the calling thread
+class PerfCounters {
+ public:
+  ~PerfCounters() {
+    for (auto fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  bool available() {
+    if (!opened) {
+      opened = true;
+      const std::uint64_t configs[] = {
+          PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+          PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+      for (int i = 0; i < 4; i++) {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[i] = static_cast<int>(
+            syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+      }
+    }
+    return fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 && fds[3] >= 0;
+  }
+
+  void start() {
+    for (auto fd : fds) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  void stop(Stats& s) {
+    std::uint64_t values[4] = {};
+    for (int i = 0; i < 4; i++) {
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+        return;
+      }
+    }
+    s.perfAvailable = true;
+    s.cycles = values[0];
+    s.instructions = values[1];
+    s.branchMisses = values[2];
+    s.cacheMisses = values[3];
+  }
+
+ private:
+  bool opened = false;
+  int fds[4] = {-1, -1, -1, -1};
+};
+thread_local PerfCounters perf;
+#endif
+
+Scope::Scope(Phase phase) : outermost(state.scopes++ == 0) {
+  if (!outermost) {
+    return;
+  }
+  state.current = Stats();
+  state.current.phase = phase;
+  state.depth = 0;
+  allocations = 0;
+  allocatedBytes = 0;
+  recording = true;
+#ifdef __linux__
+  if (perfEnabled && perf.available()) {
+    perf.start();
+  }
+#endif
+  start = std::chrono::steady_clock::now();
+}
+
+Scope::~Scope() {
+  state.scopes--;
+  if (!outermost) {
+    return;
+  }
+  auto stop = std::chrono::steady_clock::now();
+#ifdef __linux__
+  if (perfEnabled && perf.available()) {
+    perf.stop(state.current);
+  }
+#endif
+  recording = false;
+  state.current.ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+          .count();
+  state.current.allocations = allocations;
+  state.current.allocatedBytes = allocatedBytes;
+  state.last = state.current;
+  if (hook) {
+    hook(state.last);
+  }
+}
+
+void countNode(Type t) { state.current.nodes[castEnum(t)]++; }
+
+void enterContainer() {
+  if (++state.depth > state.current.maxDepth) {
+    state.current.maxDepth = state.depth;
+  }
+}
+
+void leaveContainer() { state.depth--; }
+}  // namespace stats
+
+void setStatsHook(StatsHook hook) { stats::hook = std::move(hook); }
+
+const Stats& lastStats() { return stats::state.last; }
+
+void setPerfCounters(bool enable) { stats::perfEnabled = enable; }
+
+}  // namespace yph
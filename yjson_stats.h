@@ -0,0 +1,89 @@
+#ifndef YJSON_STATS_H__
+#define YJSON_STATS_H__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Opt-in instrumentation of parse and stringify, build with -DYJSON_STATS=ON.
+ * When it is off the hooks in the parser compile to nothing and the
+ * functions below only report empty stats.
+ */
+enum class Phase : std::uint8_t {
+  PARSE,
+  STRINGIFY,
+};
+
+struct Stats {
+  Phase phase = Phase::PARSE;
+  std::uint64_t ns = 0;
+  // heap traffic of the calling thread while the phase runs
+  size_t allocations = 0;
+  size_t allocatedBytes = 0;
+  size_t nodes[castEnum(Type::OBJECT) + 1] = {};
+  size_t maxDepth = 0;
+  // hardware counters, only filled when perfAvailable
+  bool perfAvailable = false;
+  std::uint64_t cycles = 0;
+  std::uint64_t instructions = 0;
+  std::uint64_t branchMisses = 0;
+  std::uint64_t cacheMisses = 0;
+};
+
+using StatsHook = std::function<void(const Stats&)>;
+
+// called on the measuring thread after each parse/stringify, install it
+// before the worker threads start
+void setStatsHook(StatsHook hook);
+// stats of the last parse/stringify finished on the calling thread
+const Stats& lastStats();
+// read cycles/instructions/branch-misses/LLC-misses via perf_event_open,
+// silently unavailable when the kernel refuses
+void setPerfCounters(bool enable);
+
+namespace stats {
+// measures one top-level call, nested scopes are folded into the outer one
+class Scope {
+ public:
+  explicit Scope(Phase phase);
+  ~Scope();
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  bool outermost;
+  std::chrono::steady_clock::time_point start;
+};
+
+void countNode(Type t);
+void enterContainer();
+void leaveContainer();
+}  // namespace stats
+
+#ifdef YJSON_STATS
+#define YJSON_STATS_SCOPE(phase) stats::Scope yjsonStatsScope(phase)
+#define YJSON_STATS_NODE(type) stats::countNode(type)
+#define YJSON_STATS_ENTER() stats::enterContainer()
+#define YJSON_STATS_LEAVE() stats::leaveContainer()
+#else
+#define YJSON_STATS_SCOPE(phase) \
+  do {                           \
+  } while (0)
+#define YJSON_STATS_NODE(type) \
+  do {                         \
+  } while (0)
+#define YJSON_STATS_ENTER() \
+  do {                      \
+  } while (0)
+#define YJSON_STATS_LEAVE() \
+  do {                      \
+  } while (0)
+#endif
+
+}  // namespace yph
+
+#endif /*YJSON_STATS*/
@@ -0,0 +1,303 @@
+#include "yjson_tape.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace yph {
+using namespace tape;
+
+/* TOOL */
+static std::uint64_t doubleBits(double d) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static double bitsDouble(std::uint64_t bits) {
+  double d;
+  std::memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+/* TAPEREF */
+Type TapeRef::type() const {
+  switch (tagOf(word())) {
+    case 't': {
+      return Type::TRUE;
+    }
+    case 'f': {
+      return Type::FALSE;
+    }
+    case 'd': {
+      return Type::NUMBER;
+    }
+    case 's': {
+      return Type::STRING;
+    }
+    case '[': {
+      return Type::ARRAY;
+    }
+    case '{': {
+      return Type::OBJECT;
+    }
+    default: { return Type::NVLL; }
+  }
+}
+
+size_t TapeRef::skip() const {
+  switch (tagOf(word())) {
+    case 'd':
+    case 's': {
+      return index + 2;
+    }
+    case '[':
+    case '{': {
+      return payloadOf(word()) & kIndexMask;
+    }
+    default: { return index + 1; }
+  }
+}
+
+bool TapeRef::isEnd() const {
+  char tag = tagOf(word());
+  return tag == ']' || tag == '}';
+}
+
+std::string_view TapeRef::stringView() const {
+  assert(tagOf(word()) == 's');
+  return std::string_view(strings + payloadOf(word()), next());
+}
+
+/*TAPE CONVERSION*/
+static void appendString(Tape& tape, const string& str) {
+  tape.words.push_back(makeWord('s', tape.strings.size()));
+  tape.words.push_back(str.length());
+  tape.strings.append(str);
+}
+
+// false once the tape holds more than maxWords words; checked at each
+// container end, before its start word stores the index
+static bool appendValue(Tape& tape, const Value& v, size_t maxWords) {
+  switch (v.type) {
+    case Type::NVLL: {
+      tape.words.push_back(makeWord('n', 0));
+      break;
+    }
+    case Type::TRUE: {
+      tape.words.push_back(makeWord('t', 0));
+      break;
+    }
+    case Type::FALSE: {
+      tape.words.push_back(makeWord('f', 0));
+      break;
+    }
+    case Type::NUMBER: {
+      tape.words.push_back(makeWord('d', 0));
+      tape.words.push_back(doubleBits(numberValue(v)));
+      break;
+    }
+    case Type::STRING: {
+      appendString(tape, std::get<string>(v.data));
+      break;
+    }
+    case Type::ARRAY: {
+      size_t start = tape.words.size();
+      size_t n = 0;
+      tape.words.push_back(0);
+      if (auto numbers = std::get_if<vector<double>>(&v.data)) {
+        for (double d : *numbers) {
+          tape.words.push_back(makeWord('d', 0));
+          tape.words.push_back(doubleBits(d));
+        }
+        n = numbers->size();
+      } else {
+        auto& elements = std::get<vector<Value>>(v.data);
+        for (auto& el : elements) {
+          if (!appendValue(tape, el, maxWords)) {
+            return false;
+          }
+        }
+        n = elements.size();
+      }
+      tape.words.push_back(makeWord(']', start));
+      if (tape.words.size() > maxWords) {
+        return false;
+      }
+      std::uint64_t count = std::min<std::uint64_t>(n, kCountMax);
+      tape.words[start] =
+          makeWord('[', (count << kCountShift) | tape.words.size());
+      break;
+    }
+    case Type::OBJECT: {
+      auto& entries = std::get<vector<Entry>>(v.data);
+      size_t start = tape.words.size();
+      tape.words.push_back(0);
+      for (auto& en : entries) {
+        appendString(tape, en.key);
+        if (!appendValue(tape, en.val, maxWords)) {
+          return false;
+        }
+      }
+      tape.words.push_back(makeWord('}', start));
+      if (tape.words.size() > maxWords) {
+        return false;
+      }
+      std::uint64_t count =
+          std::min<std::uint64_t>(entries.size(), kCountMax);
+      tape.words[start] =
+          makeWord('{', (count << kCountShift) | tape.words.size());
+      break;
+    }
+  }
+  return true;
+}
+
+Status toTape(const ValuePtr v, Tape& tape, size_t maxWords) {
+  assert(v != nullptr);
+  tape.clear();
+  if (!appendValue(tape, *v, std::min(maxWords, kMaxWords))) {
+    tape.clear();
+    return Status::TAPE_TOO_LARGE;
+  }
+  return Status::TAPE_OK;
+}
+
+static void readValue(const TapeRef& t, Value& v) {
+  switch (t.type()) {
+    case Type::NVLL:
+    case Type::TRUE:
+    case Type::FALSE: {
+      v.data = nullptr;
+      break;
+    }
+    case Type::NUMBER: {
+      v.data = bitsDouble(t.next());
+      break;
+    }
+    case Type::STRING: {
+      v.data = string(t.stringView());
+      break;
+    }
+    case Type::ARRAY: {
+      vector<Value> elements;
+      elements.reserve(getArraySize(t));
+      for (auto el = t.child(); !el.isEnd(); el = el.sibling()) {
+        elements.emplace_back();
+        readValue(el, elements.back());
+      }
+      v.data = std::move(elements);
+      break;
+    }
+    case Type::OBJECT: {
+      vector<Entry> entries;
+      entries.reserve(getObjectSize(t));
+      for (auto key = t.child(); !key.isEnd();) {
+        auto val = key.sibling();
+        entries.emplace_back();
+        entries.back().key = string(key.stringView());
+        readValue(val, entries.back().val);
+        key = val.sibling();
+      }
+      v.data = std::move(entries);
+      break;
+    }
+  }
+  v.type = t.type();
+  invalidateHash(v);
+}
+
+void fromTape(const TapeRef& t, ValuePtr v) {
+  assert(v != nullptr);
+  readValue(t, *v);
+}
+
+Status parseTape(Tape& tape, const string& json) {
+  auto v = std::make_shared<Value>();
+  Status status = parse(v, json);
+  if (status == Status::PARSE_OK) {
+    if (toTape(v, tape) != Status::TAPE_OK) {
+      return Status::TAPE_TOO_LARGE;
+    }
+  } else {
+    tape.clear();
+  }
+  return status;
+}
+
+/*TAPE ACCESSOR*/
+Type getType(const TapeRef& t) { return t.type(); }
+
+double getNumber(const TapeRef& t) {
+  assert(t.type() == Type::NUMBER);
+  return bitsDouble(t.next());
+}
+
+bool getBoolean(const TapeRef& t) {
+  assert(t.type() == Type::TRUE || t.type() == Type::FALSE);
+  return t.type() == Type::TRUE;
+}
+
+string getString(const TapeRef& t) {
+  assert(t.type() == Type::STRING);
+  return string(t.stringView());
+}
+
+size_t getStringLength(const TapeRef& t) {
+  assert(t.type() == Type::STRING);
+  return t.next();
+}
+
+// the stored count saturates, count by walking only for huge containers
+static size_t containerSize(const TapeRef& t, size_t stride) {
+  std::uint64_t count = payloadOf(t.word()) >> kCountShift;
+  if (count < kCountMax) {
+    return count;
+  }
+  size_t n = 0;
+  for (auto el = t.child(); !el.isEnd(); el = el.sibling()) {
+    n++;
+  }
+  return n / stride;
+}
+
+size_t getArraySize(const TapeRef& t) {
+  assert(t.type() == Type::ARRAY);
+  return containerSize(t, 1);
+}
+
+TapeRef getArrayElement(const TapeRef& t, const size_t& i) {
+  assert(t.type() == Type::ARRAY && i < getArraySize(t));
+  auto el = t.child();
+  for (size_t n = 0; n < i; n++) {
+    el = el.sibling();
+  }
+  return el;
+}
+
+size_t getObjectSize(const TapeRef& t) {
+  assert(t.type() == Type::OBJECT);
+  return containerSize(t, 2);
+}
+
+static TapeRef objectKey(const TapeRef& t, size_t index) {
+  assert(t.type() == Type::OBJECT && index < getObjectSize(t));
+  auto key = t.child();
+  for (size_t n = 0; n < index; n++) {
+    key = key.sibling().sibling();
+  }
+  return key;
+}
+
+const string getObjectKey(const TapeRef& t, const size_t& index) {
+  return string(objectKey(t, index).stringView());
+}
+
+size_t getObjectKeyLength(const TapeRef& t, const size_t& index) {
+  return objectKey(t, index).next();
+}
+
+TapeRef getObjectValue(const TapeRef& t, const size_t& index) {
+  return objectKey(t, index).sibling();
+}
+
+}  // namespace yph
@@ -0,0 +1,109 @@
+#ifndef YJSON_TAPE_H__
+#define YJSON_TAPE_H__
+
+#include <cstdint>
+#include <string_view>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Read-only flat representation of a parsed document.
+ * Every node lives in one contiguous tape of 64-bit words:
+ *   high 8 bits: tag, low 56 bits: payload
+ *   'n' 't' 'f'  literals, 1 word
+ *   'd'          number, 2 words (the second one holds the double bits)
+ *   's'          string, 2 words (payload: offset into the string buffer,
+ *                second word: byte length)
+ *   '[' '{'      container start, payload: element count (high 24 bits,
+ *                saturated) | index past the matching end word (low 32 bits)
+ *   ']' '}'      container end, payload: index of the matching start word
+ * Object members are stored as a key string followed by its value, so
+ * skipping a subtree is a single jump and iteration is a linear scan.
+ * End indices have 32 bits: a tape holds at most kMaxWords words (32 GiB),
+ * toTape fails with TAPE_TOO_LARGE past that.
+ */
+namespace tape {
+constexpr int kTagShift = 56;
+constexpr std::uint64_t kPayloadMask = (std::uint64_t(1) << kTagShift) - 1;
+constexpr int kCountShift = 32;
+constexpr std::uint64_t kCountMax = 0xFFFFFF;
+constexpr std::uint64_t kIndexMask = 0xFFFFFFFF;
+constexpr size_t kMaxWords = kIndexMask;
+
+constexpr std::uint64_t makeWord(char tag, std::uint64_t payload) {
+  return (static_cast<std::uint64_t>(static_cast<unsigned char>(tag))
+          << kTagShift) |
+         (payload & kPayloadMask);
+}
+constexpr char tagOf(std::uint64_t word) {
+  return static_cast<char>(word >> kTagShift);
+}
+constexpr std::uint64_t payloadOf(std::uint64_t word) {
+  return word & kPayloadMask;
+}
+}  // namespace tape
+
+// cursor into a tape, cheap to copy; does not own the storage
+class TapeRef {
+ public:
+  TapeRef() = default;
+  constexpr TapeRef(const std::uint64_t* words, const char* strings,
+                    size_t index)
+      : words(words), strings(strings), index(index) {}
+
+  Type type() const;
+  // index of the word following this node (and its whole subtree)
+  size_t skip() const;
+  // first element (array) or first key (object)
+  TapeRef child() const { return TapeRef(words, strings, index + 1); }
+  TapeRef sibling() const { return TapeRef(words, strings, skip()); }
+  // true when this cursor points at the end word of a container
+  bool isEnd() const;
+
+  std::uint64_t word() const { return words[index]; }
+  std::uint64_t next() const { return words[index + 1]; }
+  std::string_view stringView() const;
+
+  const std::uint64_t* words = nullptr;
+  const char* strings = nullptr;
+  size_t index = 0;
+};
+
+class Tape {
+ public:
+  vector<std::uint64_t> words;
+  string strings;
+
+  TapeRef root() const { return TapeRef(words.data(), strings.data(), 0); }
+  void clear() {
+    words.clear();
+    strings.clear();
+  }
+};
+
+/*TAPE CONVERSION*/
+// TAPE_TOO_LARGE, with the tape cleared, when it would take more than
+// maxWords words; a smaller maxWords bounds the memory a tape may use
+Status toTape(const ValuePtr v, Tape& tape,
+              size_t maxWords = tape::kMaxWords);
+void fromTape(const TapeRef& t, ValuePtr v);
+// the parse status, or TAPE_TOO_LARGE
+Status parseTape(Tape& tape, const string& json);
+
+/*TAPE ACCESSOR*/
+Type getType(const TapeRef& t);
+double getNumber(const TapeRef& t);
+bool getBoolean(const TapeRef& t);
+string getString(const TapeRef& t);
+size_t getStringLength(const TapeRef& t);
+size_t getArraySize(const TapeRef& t);
+TapeRef getArrayElement(const TapeRef& t, const size_t& i);
+size_t getObjectSize(const TapeRef& t);
+const string getObjectKey(const TapeRef& t, const size_t& index);
+size_t getObjectKeyLength(const TapeRef& t, const size_t& index);
+TapeRef getObjectValue(const TapeRef& t, const size_t& index);
+
+}  // namespace yph
+
+#endif /*YJSON_TAPE*/
@@ -0,0 +1,465 @@
+#include "yjson_validate.h"
+
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace yph {
+
+/*VALIDATOR SCANNER*/
+// Each scanner returns the first byte it stops at. The SSE2 loops only
+// read whole blocks inside [p, end), the scalar loops finish the tail.
+static inline bool isSpace(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+#ifdef __SSE2__
+static inline __m128i load16(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline __m128i equal16(__m128i x, char ch) {
+  return _mm_cmpeq_epi8(x, _mm_set1_epi8(ch));
+}
+#endif
+
+static inline const char* skipSpace(const char* p, const char* end) {
+  // most tokens are not preceded by whitespace at all
+  if (p < end && static_cast<unsigned char>(*p) > ' ') {
+    return p;
+  }
+#ifdef __SSE2__
+  for (; end - p >= 16; p += 16) {
+    __m128i x = load16(p);
+    __m128i space =
+        _mm_or_si128(_mm_or_si128(equal16(x, ' '), equal16(x, '\n')),
+                     _mm_or_si128(equal16(x, '\t'), equal16(x, '\r')));
+    unsigned other = ~_mm_movemask_epi8(space) & 0xFFFF;
+    if (other != 0) {
+      return p + __builtin_ctz(other);
+    }
+  }
+#endif
+  while (p < end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// up to the next '"', '\\', control character or non-ASCII byte
+static inline const char* skipPlain(const char* p, const char* end) {
+#ifdef __SSE2__
+  const __m128i controls = _mm_set1_epi8(0x1F);
+  for (; end - p >= 16; p += 16) {
+    __m128i x = load16(p);
+    // unsigned x <= 0x1F
+    __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(x, controls), controls);
+    __m128i special =
+        _mm_or_si128(_mm_or_si128(equal16(x, '\"'), equal16(x, '\\')), control);
+    // the sign bits are the non-ASCII bytes
+    unsigned mask = _mm_movemask_epi8(_mm_or_si128(special, x));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (p < end && *p != '\"' && *p != '\\' &&
+         static_cast<unsigned char>(*p) - 0x20u < 0x60u) {
+    p++;
+  }
+  return p;
+}
+
+static inline const char* skipDigits(const char* p, const char* end) {
+#ifdef __SSE2__
+  const __m128i nine = _mm_set1_epi8(9);
+  for (; end - p >= 16; p += 16) {
+    // unsigned x - '0' <= 9
+    __m128i d = _mm_sub_epi8(load16(p), _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+    unsigned other = ~_mm_movemask_epi8(digit) & 0xFFFF;
+    if (other != 0) {
+      return p + __builtin_ctz(other);
+    }
+  }
+#endif
+  while (p < end && isDigit(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static bool isHex4(const char* p, const char* end, unsigned int& u) {
+  if (end - p < 4) {
+    return false;
+  }
+  u = 0;
+  for (int i = 0; i < 4; i++) {
+    auto ch = p[i];
+    u <<= 4;
+    if (ch >= '0' && ch <= '9') {
+      u += (ch - '0');
+    } else if (ch >= 'A' && ch <= 'F') {
+      u += (ch - 'A' + 10);
+    } else if (ch >= 'a' && ch <= 'f') {
+      u += (ch - 'a' + 10);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Would strtod overflow on the mantissa [p, last) (digits and at most one
+// '.', not all zero) whose first significant digit stands for 10^magnitude?
+static bool overflows(const char* p, const char* last, long long magnitude) {
+  if (magnitude != 308) {
+    return magnitude > 308;
+  }
+  // 2^1024 - 2^970, halfway between DBL_MAX and 2^1024; a tie rounds to
+  // the even neighbour, which is infinity
+  static const char kLimit[] =
+      "1797693134862315807937289714053034150799341327100378269361737789804449"
+      "6829276475094664901797758720709633028641669288791094655554785194040263"
+      "0657488671505820681908902000708383676273854845817711531764475730270069"
+      "8555713669596228429148198608349364752927190741684443655107043427115596"
+      "99508093042880177904174497792";
+  while (*p == '0' || *p == '.') {
+    p++;
+  }
+  for (const char* l = kLimit; *l != '\0'; p++) {
+    if (p == last) {
+      return false;  // a prefix of the limit, whose last digit is not 0
+    }
+    if (*p == '.') {
+      continue;
+    }
+    if (*p != *l) {
+      return *p > *l;
+    }
+    l++;
+  }
+  return true;
+}
+
+/*VALIDATOR*/
+// Context::readEvents without events: every check happens at the same
+// byte, so both report the same status and position.
+class Validator {
+ public:
+  explicit Validator(std::string_view json)
+      : begin(json.data()), cur(begin), end(begin + json.size()) {}
+
+  Status run() {
+    cur = skipSpace(cur, end);
+    if (cur == end) {
+      return Status::PARSE_EXPECT_VALUE;
+    }
+    Status status = readValue();
+    if (status == Status::PARSE_OK) {
+      cur = skipSpace(cur, end);
+      if (cur != end) {
+        status = Status::PARSE_ROOT_NOT_SINGULAR;
+      }
+    }
+    return status;
+  }
+
+  size_t position() const { return static_cast<size_t>(cur - begin); }
+
+ private:
+  static constexpr size_t kWordBits = 64;
+
+  void push(bool isObject) {
+    auto& word = stack[depth / kWordBits];
+    auto bit = std::uint64_t(1) << (depth % kWordBits);
+    word = isObject ? word | bit : word & ~bit;
+    depth++;
+  }
+  bool inObject() const {
+    return (stack[(depth - 1) / kWordBits] >> ((depth - 1) % kWordBits)) & 1;
+  }
+
+  Status readValue();
+  Status readLiteral(std::string_view literal);
+  Status readNumber();
+  Status readString();
+  Status nextKey();
+
+  const char* begin;
+  const char* cur;
+  const char* end;
+  // bit i set: the container open at depth i is an object
+  std::uint64_t stack[(kDefaultMaxDepth + kWordBits - 1) / kWordBits] = {};
+  size_t depth = 0;
+};
+
+Status Validator::readValue() {
+  for (;;) {
+    if (cur == end) {
+      return Status::PARSE_EXPECT_VALUE;
+    }
+    Status status = Status::PARSE_OK;
+    switch (*cur) {
+      case 'n': {
+        status = readLiteral("null");
+        break;
+      }
+      case 't': {
+        status = readLiteral("true");
+        break;
+      }
+      case 'f': {
+        status = readLiteral("false");
+        break;
+      }
+      case '\"': {
+        status = readString();
+        break;
+      }
+      case '[':
+      case '{': {
+        if (depth >= kDefaultMaxDepth) {
+          return Status::PARSE_DEPTH_EXCEEDED;
+        }
+        bool isObject = *cur == '{';
+        cur = skipSpace(cur + 1, end);
+        if (cur < end && *cur == (isObject ? '}' : ']')) {
+          cur++;
+          break;
+        }
+        push(isObject);
+        if (!isObject && (cur == end || *cur == '}')) {
+          return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+        if (isObject && (status = nextKey()) != Status::PARSE_OK) {
+          return status;
+        }
+        continue;  // descend into the first child
+      }
+      case '\0': {
+        return Status::PARSE_EXPECT_VALUE;
+      }
+      default: {
+        status = readNumber();
+      }
+    }
+    if (status != Status::PARSE_OK) {
+      return status;
+    }
+
+    // climb until a container expects another child
+    for (;;) {
+      if (depth == 0) {
+        return Status::PARSE_OK;
+      }
+      bool isObject = inObject();
+      cur = skipSpace(cur, end);
+      if (cur < end && *cur == ',') {
+        cur = skipSpace(cur + 1, end);
+        if (!isObject) {
+          if (cur < end && *cur == ']') {
+            return Status::PARSE_INVALID_VALUE;
+          }
+          if (cur == end || *cur == '}') {
+            return Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+          }
+        } else {
+          if (cur == end) {
+            return Status::PARSE_MISS_KEY;
+          }
+          if (*cur == '}') {
+            return Status::PARSE_INVALID_VALUE;
+          }
+          if (status = nextKey(); status != Status::PARSE_OK) {
+            return status;
+          }
+        }
+        break;
+      } else if (cur < end && *cur == (isObject ? '}' : ']')) {
+        cur++;
+        depth--;
+      } else {
+        return isObject ? Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET
+                        : Status::PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+      }
+    }
+  }
+}
+
+Status Validator::readLiteral(std::string_view literal) {
+  if (static_cast<size_t>(end - cur) < literal.length() ||
+      literal.compare(0, literal.length(), cur, literal.length()) != 0) {
+    return Status::PARSE_INVALID_VALUE;
+  }
+  cur += literal.length();
+  return Status::PARSE_OK;
+}
+
+Status Validator::readNumber() {
+  const char* p = cur;
+  if (p < end && *p == '-') {
+    p++;
+  }
+  const char* mantissa = p;
+  // decimal exponent of the first significant digit, before the exponent
+  long long magnitude = 0;
+  bool zero = true;
+  if (p < end && *p == '0') {
+    p++;
+  } else if (p < end && *p >= '1' && *p <= '9') {
+    const char* digits = p;
+    p = skipDigits(p, end);
+    magnitude = p - digits - 1;
+    zero = false;
+  } else {
+    cur = p;
+    return Status::PARSE_INVALID_VALUE;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    if (p == end || !isDigit(*p)) {
+      cur = p;
+      return Status::PARSE_INVALID_VALUE;
+    }
+    const char* digits = p;
+    p = skipDigits(p, end);
+    for (const char* q = digits; zero && q < p; q++) {
+      if (*q != '0') {
+        magnitude = -(q - digits) - 1;
+        zero = false;
+      }
+    }
+  }
+  const char* last = p;
+  long long exp = 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool expNegative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+      expNegative = *p == '-';
+      p++;
+    }
+    if (p == end || !isDigit(*p)) {
+      cur = p;
+      return Status::PARSE_INVALID_VALUE;
+    }
+    for (; p < end && isDigit(*p); p++) {
+      exp = exp < 100000 ? exp * 10 + (*p - '0') : exp;
+    }
+    exp = expNegative ? -exp : exp;
+  }
+  // underflow is fine, only overflow is reported
+  if (!zero && magnitude + exp >= 308 &&
+      overflows(mantissa, last, magnitude + exp)) {
+    return Status::PARSE_NUMBER_TOO_BIG;
+  }
+  cur = p;
+  return Status::PARSE_OK;
+}
+
+Status Validator::readString() {
+  cur++;
+  for (;;) {
+    cur = skipPlain(cur, end);
+    while (cur != end && static_cast<unsigned char>(*cur) >= 0x80) {
+      const char* next = skipUtf8Sequence(cur, end);
+      if (next == nullptr) {
+        return Status::PARSE_INVALID_UTF8;
+      }
+      cur = skipPlain(next, end);
+    }
+    if (cur == end) {
+      return Status::PARSE_MISS_QUOTATION_MARK;
+    }
+    auto ch = *cur++;
+    if (ch == '\"') {
+      return Status::PARSE_OK;
+    }
+    if (ch != '\\') {
+      cur--;
+      return Status::PARSE_INVALID_STRING_CHAR;
+    }
+    if (cur == end) {
+      return Status::PARSE_INVALID_STRING_ESCAPE;
+    }
+    switch (*cur++) {
+      case '\"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't': {
+        break;
+      }
+      case 'u': {
+        unsigned int u = 0;
+        if (!isHex4(cur, end, u)) {
+          return Status::PARSE_INVALID_UNICODE_HEX;
+        }
+        cur += 4;
+        if (u >= 0xD800 && u <= 0xDBFF) {
+          if (end - cur < 2 || cur[0] != '\\' || cur[1] != 'u') {
+            return Status::PARSE_INVALID_UNICODE_SURROGATE;
+          }
+          cur += 2;
+          if (!isHex4(cur, end, u)) {
+            return Status::PARSE_INVALID_UNICODE_HEX;
+          }
+          cur += 4;
+          if (u < 0xDC00 || u > 0xDFFF) {
+            return Status::PARSE_INVALID_UNICODE_SURROGATE;
+          }
+        } else if (u == 0) {
+          // like Context::readString, an escaped NUL ends the string
+          auto quote =
+              static_cast<const char*>(std::memchr(cur, '\"', end - cur));
+          if (quote == nullptr) {
+            cur = end;
+            return Status::PARSE_MISS_QUOTATION_MARK;
+          }
+          cur = quote + 1;
+          return Status::PARSE_OK;
+        }
+        break;
+      }
+      default: {
+        cur--;
+        return Status::PARSE_INVALID_STRING_ESCAPE;
+      }
+    }
+  }
+}
+
+Status Validator::nextKey() {
+  if (cur == end || *cur == ']') {
+    return Status::PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+  }
+  if (*cur != '\"') {
+    return Status::PARSE_MISS_KEY;
+  }
+  if (Status status = readString(); status != Status::PARSE_OK) {
+    return status;
+  }
+  cur = skipSpace(cur, end);
+  if (cur == end || *cur != ':') {
+    return Status::PARSE_MISS_COLON;
+  }
+  cur = skipSpace(cur + 1, end);
+  return Status::PARSE_OK;
+}
+
+std::pair<Status, size_t> validate(std::string_view json) {
+  Validator validator(json);
+  Status status = validator.run();
+  return {status,
+          status == Status::PARSE_OK ? json.size() : validator.position()};
+}
+
+}  // namespace yph
@@ -0,0 +1,24 @@
+#ifndef YJSON_VALIDATE_H__
+#define YJSON_VALIDATE_H__
+
+#include <string_view>
+#include <utility>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Syntax check without a tree: the rules and Status codes of parse(), the
+ * kDefaultMaxDepth limit included, but nothing is built or allocated.
+ * Whitespace, string contents and digit runs are skipped 16 bytes at a
+ * time with SSE2 where the target has it; nesting is tracked in a bit
+ * stack on the C++ stack, one bit per open container.
+ */
+
+// {PARSE_OK, json.size()}, or the error and the byte offset it was found
+// at, the same offset Context::position() reports after a failed parse
+std::pair<Status, size_t> validate(std::string_view json);
+
+}  // namespace yph
+
+#endif /*YJSON_VALIDATE*/
@@ -0,0 +1,161 @@
+#include "yjson_writer.h"
+
+#include <charconv>
+#include <cmath>
+
+namespace yph {
+
+/*WRITER*/
+Writer::Writer(Sink sink, size_t bufferSize, size_t maxDepth)
+    : sink(std::move(sink)), bufferSize(bufferSize), maxDepth(maxDepth) {
+  buffer.reserve(bufferSize);
+}
+
+bool Writer::beforeValue() {
+  if (last != Status::STRINGIFY_OK) {
+    return false;
+  }
+  if (open.empty() ? !first : open.back() && !keyed) {
+    last = Status::STRINGIFY_INVALID_CALL;
+    return false;
+  }
+  if (!open.empty() && !open.back() && !first) {
+    buffer.push_back(',');
+  }
+  first = false;
+  keyed = false;
+  return true;
+}
+
+Status Writer::afterToken() {
+  return buffer.size() >= bufferSize ? flush() : last;
+}
+
+Status Writer::startObject() { return start(true); }
+
+Status Writer::startArray() { return start(false); }
+
+Status Writer::start(bool object) {
+  if (last == Status::STRINGIFY_OK && open.size() == maxDepth) {
+    last = Status::STRINGIFY_INVALID_CALL;
+  }
+  if (!beforeValue()) {
+    return last;
+  }
+  buffer.push_back(object ? '{' : '[');
+  open.push_back(object);
+  first = true;
+  return afterToken();
+}
+
+Status Writer::end() {
+  if (last != Status::STRINGIFY_OK) {
+    return last;
+  }
+  if (open.empty() || keyed) {
+    return last = Status::STRINGIFY_INVALID_CALL;
+  }
+  buffer.push_back(open.back() ? '}' : ']');
+  open.pop_back();
+  // the container just closed is a value of its parent
+  first = false;
+  return afterToken();
+}
+
+Status Writer::key(std::string_view k) {
+  if (last != Status::STRINGIFY_OK) {
+    return last;
+  }
+  if (open.empty() || !open.back() || keyed) {
+    return last = Status::STRINGIFY_INVALID_CALL;
+  }
+  if (!first) {
+    buffer.push_back(',');
+  }
+  stringifyString(k, buffer);
+  buffer.push_back(':');
+  keyed = true;
+  return afterToken();
+}
+
+Status Writer::value(double d) {
+  // JSON has no NaN or infinity
+  if (last == Status::STRINGIFY_OK && !std::isfinite(d)) {
+    last = Status::STRINGIFY_INVALID_CALL;
+  }
+  if (!beforeValue()) {
+    return last;
+  }
+  stringifyNumber(d, buffer);
+  return afterToken();
+}
+
+Status Writer::integer(std::int64_t n) {
+  if (!beforeValue()) {
+    return last;
+  }
+  char digits[24];
+  buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), n).ptr);
+  return afterToken();
+}
+
+Status Writer::integer(std::uint64_t n) {
+  if (!beforeValue()) {
+    return last;
+  }
+  char digits[24];
+  buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), n).ptr);
+  return afterToken();
+}
+
+Status Writer::value(bool b) {
+  if (!beforeValue()) {
+    return last;
+  }
+  buffer.append(b ? "true" : "false");
+  return afterToken();
+}
+
+Status Writer::value(std::string_view str) {
+  if (!beforeValue()) {
+    return last;
+  }
+  stringifyString(str, buffer);
+  return afterToken();
+}
+
+Status Writer::value(std::nullptr_t) {
+  if (!beforeValue()) {
+    return last;
+  }
+  buffer.append("null");
+  return afterToken();
+}
+
+Status Writer::value(const Value& v) {
+  if (!beforeValue()) {
+    return last;
+  }
+  stringifyValue(v, buffer);
+  return afterToken();
+}
+
+Status Writer::flush() {
+  if (last != Status::STRINGIFY_OK) {
+    return last;
+  }
+  if (!buffer.empty() && !sink(buffer)) {
+    last = Status::STRINGIFY_IO_ERROR;
+  }
+  buffer.clear();
+  return last;
+}
+
+Status Writer::finish() {
+  if (last == Status::STRINGIFY_OK && (!open.empty() || first)) {
+    last = Status::STRINGIFY_INVALID_CALL;
+  }
+  return flush();
+}
+
+}  // namespace yph
@@ -0,0 +1,103 @@
+#ifndef YJSON_WRITER_H__
+#define YJSON_WRITER_H__
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+
+#include "yjson.h"
+
+namespace yph {
+/*
+ * Streaming stringify without a tree, for results emitted row by row.
+ * Calls append straight to a buffer that is handed to the sink whenever it
+ * holds bufferSize bytes, so memory stays at one buffer whatever the size
+ * of the output; a string or subtree longer than that goes out in one
+ * piece.
+ * Numbers and strings are written as stringifyValue writes them.
+ * A small stack of open containers checks the order of the calls: a key
+ * only inside an object and before each of its values, one top-level
+ * value. A misplaced call, or a NaN or infinite number, writes nothing and
+ * returns STRINGIFY_INVALID_CALL, a sink returning false
+ * STRINGIFY_IO_ERROR; every later call then returns the same status.
+ *
+ *   Writer w([&](std::string_view bytes) { return send(bytes); });
+ *   w.startArray();
+ *   for (auto& row : rows) {
+ *     w.startObject();
+ *     w.key("id");
+ *     w.value(row.id);
+ *     w.end();
+ *   }
+ *   w.end();
+ *   w.finish();
+ */
+class Writer {
+ public:
+  // false when the bytes could not be written
+  using Sink = std::function<bool(std::string_view)>;
+  static constexpr size_t kDefaultBufferSize = size_t(64) << 10;
+
+  explicit Writer(Sink sink, size_t bufferSize = kDefaultBufferSize,
+                  size_t maxDepth = kDefaultMaxDepth);
+
+  Status startObject();
+  Status startArray();
+  // closes the innermost open object or array
+  Status end();
+  Status key(std::string_view k);
+  Status value(double d);
+  // integers digit for digit, 64-bit ones past 2^53 included, as getInt64
+  // and getUint64 read them back
+  template <typename T,
+            std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>,
+                             int> = 0>
+  Status value(T n) {
+    if constexpr (std::is_signed_v<T>) {
+      return integer(static_cast<std::int64_t>(n));
+    } else {
+      return integer(static_cast<std::uint64_t>(n));
+    }
+  }
+  Status value(bool b);
+  Status value(std::string_view str);
+  // not taken for a bool
+  Status value(const char* str) { return value(std::string_view(str)); }
+  Status value(std::nullptr_t);
+  // a whole subtree, as stringifyValue writes it
+  Status value(const Value& v);
+
+  // hands the buffered bytes to the sink, also in the middle of a document
+  Status flush();
+  // STRINGIFY_INVALID_CALL until the top-level value is written and
+  // closed, then flushes
+  Status finish();
+
+  Status status() const { return last; }
+  size_t depth() const { return open.size(); }
+
+ private:
+  // before a value: the comma, or a check that a key came first
+  bool beforeValue();
+  Status afterToken();
+  Status start(bool object);
+  Status integer(std::int64_t n);
+  Status integer(std::uint64_t n);
+
+  Sink sink;
+  size_t bufferSize;
+  size_t maxDepth;
+  string buffer;
+  // true for an object, per open container
+  vector<bool> open;
+  // no value written yet in the innermost container (or at the top level)
+  bool first = true;
+  // in an object, a key was written and its value is next
+  bool keyed = false;
+  Status last = Status::STRINGIFY_OK;
+};
+
+}  // namespace yph
+
+#endif /*YJSON_WRITER*/